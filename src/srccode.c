@@ -1,13 +1,50 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <signal.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 // --- Constants and Global Limits ---
-#define MAX_STUDENTS 100
-#define MAX_TEACHERS 10
 #define SAP_ID_LENGTH 9
 
+// Records live in fixed-size chunks that are never moved or reallocated once created,
+// so a student index stays valid for as long as the student exists.
+#define STORE_CHUNK_SHIFT 10
+#define STORE_CHUNK_RECORDS (1 << STORE_CHUNK_SHIFT) // 1024 records per chunk
+#define STORE_MAX_CHUNKS 16384                        // Up to ~16.7 million records per store
+#define STORE_CAPACITY (STORE_CHUNK_RECORDS * STORE_MAX_CHUNKS)
+
+// On-disk format (see "Persistent Storage"). Bump the version whenever a persisted
+// struct changes layout; older files are then rejected instead of misread.
+#define DATA_FORMAT_VERSION 7
+#define DEFAULT_DATA_DIR "college_data"
+#define FILE_PAGE_BYTES 4096
+#define STORE_HEADER_BYTES (128 * 1024) // Store file header, padded to whole pages
+
 // --- ANSI Color Codes ---
 // Blue/Cyan/Yellow for the main theme and highlights
 #define C_RESET   "\x1b[0m"
@@ -21,451 +58,8998 @@
 
 // --- Data Structures ---
 
-// Structure for student records
+// Passwords are never stored: only a salted hash of each one (see "Password Hashing"),
+// encoded as text of at most CREDENTIAL_BYTES - 1 characters
+#define CREDENTIAL_BYTES 64
+#define STUDENT_PASSWORD_MAX 19
+#define TEACHER_PASSWORD_MAX 49
+
+// Structure for a student as typed into a form, imported or journaled
 typedef struct {
     char sap_id[SAP_ID_LENGTH + 1]; // 9-digit ID + null terminator
-    char password[20];
+    char credential[CREDENTIAL_BYTES]; // Hashed password
     char name[50];
-    // Attendance (Out of 100)
-    int attendance_maths;
-    int attendance_physics;
-    int attendance_coding;
-    // Marks (Out of 100)
-    int marks_maths;
-    int marks_physics;
-    int marks_coding;
+} StudentForm;
+
+// Structure for a stored student: 12 bytes, so five fit in a cache line. The name and
+// hashed password live in the string pool. Marks and attendance (both out of 100) are not
+// stored here either: they live in score matrices in the student store, a contiguous
+// column of bytes per subject, so class-wide figures scan 1-byte values instead of
+// whole records (see student_mark()).
+typedef struct {
+    uint32_t sap_id;   // Numeric SAP ID (printed back with %09u)
+    uint32_t name;     // String pool handles
+    uint32_t credential;
 } Student;
 
-// Structure for teacher credentials
+// Subjects are defined at runtime (see "Subject Catalog"), in the order the menus list
+// them: choice N is subject N-1. A new data directory starts with these three.
+#define SUBJECT_MAX 16
+#define SUBJECT_NAME_BYTES 24
+int subject_count = 3;
+char subject_names[SUBJECT_MAX][SUBJECT_NAME_BYTES] = { "Maths", "Physics", "Coding" };
+
+// Student store columns. Every chunk of 1024 students carries a dense students x
+// SUBJECT_MAX matrix of marks, then one of attendance, each stored a subject column at a
+// time: a column scan reads contiguous bytes, and a student's row is one byte per
+// column. Room for every possible subject is reserved up front, so adding a subject
+// never moves a score. Columns of subjects that do not exist yet are never written, so
+// their pages are never allocated, in memory or on disk.
+#define MARK_COLUMN(subject) (subject)
+#define ATTENDANCE_COLUMN(subject) (SUBJECT_MAX + (subject))
+#define STUDENT_COLUMNS (2 * SUBJECT_MAX)
+
+// Student store bit columns: the attendance log, one bit per student for every class
+// session of every subject (see "Attendance Sessions"). A subject's sessions are
+// adjacent, so one page of a chunk holds 32 of them. As with the score columns, room
+// for a whole term is reserved and only the pages of sessions actually held are touched.
+#define SESSION_MAX 128 // Class sessions per subject per term
+#define SESSION_COLUMN(subject, session) ((subject) * SESSION_MAX + (session))
+#define STUDENT_BIT_COLUMNS (SUBJECT_MAX * SESSION_MAX)
+
+static inline bool student_column_in_use(int column) {
+    return column % SUBJECT_MAX < subject_count;
+}
+
+// Structure for teacher credentials as typed into a form or journaled
 typedef struct {
     char username[50];
-    char password[50];
+    char credential[CREDENTIAL_BYTES]; // Hashed password
+} TeacherForm;
+
+// Structure for a stored teacher: string pool handles to the credentials
+typedef struct {
+    uint32_t username;
+    uint32_t credential;
 } Teacher;
 
-// Global data arrays and counters (automatically reset to 0 on every program run)
-Student students[MAX_STUDENTS];
-int student_count = 0;
+// Chunked record store: a fixed directory of chunk pointers. Chunks are allocated only
+// when the store grows into them, so memory tracks the number of records held, and the
+// directory itself is never reallocated, so record addresses never change.
+//
+// Removing a record only marks its slot dead (a tombstone) and pushes it on a free list
+// threaded through the dead records, so removal is O(1) and the next add reuses the slot.
+// Dead slots are squeezed out by store_compact(), which is the only operation that
+// moves records.
+//
+// A store is either in memory (fd == -1) or backed by a file whose chunks are mapped
+// with mmap, in which case every record write goes straight to the mapped pages.
+//
+// A store may also carry fixed-width columns (the student store keeps marks and
+// attendance this way). Each chunk is laid out as its records, one liveness byte per
+// record, then each column as a contiguous, 64-byte aligned array of
+// STORE_CHUNK_RECORDS values, so a column can be scanned a chunk at a time with SIMD.
+// Bit columns (one bit per record, STORE_CHUNK_RECORDS / 8 bytes per chunk) follow
+// from the next page boundary, so pages that hold only unused bit columns stay
+// unallocated. store_compact() leaves them to the caller's on_move.
+//
+// Store file layout: STORE_HEADER_BYTES of header, then chunk i at
+// STORE_HEADER_BYTES + i * stride, where stride is the chunk size rounded up to a page.
+typedef struct {
+    char magic[8];          // STORE_FILE_MAGIC
+    uint32_t version;       // DATA_FORMAT_VERSION
+    uint32_t record_size;   // sizeof() the record type that wrote the file
+    uint32_t column_bytes;  // Bytes per record across all columns
+    uint32_t chunk_records; // STORE_CHUNK_RECORDS
+    uint32_t clean;         // 1 only after an orderly close; otherwise recover on open
+    int32_t slots;
+    int32_t count;
+    int32_t free_head;
+    int32_t chunk_count;
+    uint64_t checkpoint_lsn; // Journal records up to this LSN are already in the store
+    uint32_t bit_columns;
+    uint16_t sessions[SUBJECT_MAX]; // Class sessions held per subject, as of the checkpoint
+    int32_t chunk_live[STORE_MAX_CHUNKS];
+} StoreFileHeader;
+
+_Static_assert(sizeof(StoreFileHeader) <= STORE_HEADER_BYTES, "store header must fit its reserved pages");
+
+#define STORE_FILE_MAGIC "CAGSDAT"
+
+typedef struct {
+    size_t record_size;
+    size_t column_width; // Bytes per value in each column
+    int column_count;
+    int bit_column_count;
+    int slots;       // Slots handed out so far (indices 0 .. slots-1, live or dead)
+    int count;       // Live records
+    int free_head;   // First dead slot available for reuse, or -1
+    int chunk_count; // Chunks allocated
+    char *chunks[STORE_MAX_CHUNKS];
+    int chunk_live[STORE_MAX_CHUNKS]; // Live records per chunk, so scans skip empty chunks
+    int fd;                           // Backing file, or -1 for an in-memory store
+    StoreFileHeader *file_header;     // Mapped first pages of the backing file
+} RecordStore;
+
+// Global stores (start empty; loaded from the data directory in persistent mode)
+RecordStore student_store = {
+    .record_size = sizeof(Student), .column_width = sizeof(uint8_t), .column_count = STUDENT_COLUMNS,
+    .bit_column_count = STUDENT_BIT_COLUMNS, .free_head = -1, .fd = -1
+};
+RecordStore teacher_store = { .record_size = sizeof(Teacher), .free_head = -1, .fd = -1 };
+
+// --- Record Store Functions ---
+
+// Each chunk holds its records, one liveness byte per record, then its columns
+static inline size_t store_columns_offset(const RecordStore* store) {
+    return ((size_t)STORE_CHUNK_RECORDS * (store->record_size + 1) + 63) & ~(size_t)63;
+}
+
+// Bit columns start on a page of their own
+static inline size_t store_bit_columns_offset(const RecordStore* store) {
+    size_t end = store_columns_offset(store) + (size_t)store->column_count * STORE_CHUNK_RECORDS * store->column_width;
+    return store->bit_column_count == 0 ? end : (end + FILE_PAGE_BYTES - 1) & ~(size_t)(FILE_PAGE_BYTES - 1);
+}
+
+static inline size_t store_chunk_bytes(const RecordStore* store) {
+    return store_bit_columns_offset(store) + (size_t)store->bit_column_count * (STORE_CHUNK_RECORDS / 8);
+}
+
+// File-backed chunks are padded to whole pages so each one can be mapped on its own
+static inline size_t store_chunk_stride(const RecordStore* store) {
+    return (store_chunk_bytes(store) + FILE_PAGE_BYTES - 1) & ~(size_t)(FILE_PAGE_BYTES - 1);
+}
+
+// Function to get the address of the record at an index
+static inline void *store_record(const RecordStore* store, int index) {
+    return store->chunks[index >> STORE_CHUNK_SHIFT]
+        + (size_t)(index & (STORE_CHUNK_RECORDS - 1)) * store->record_size;
+}
+
+static inline uint8_t *store_live_flag(const RecordStore* store, int index) {
+    return (uint8_t*)store->chunks[index >> STORE_CHUNK_SHIFT]
+        + (size_t)STORE_CHUNK_RECORDS * store->record_size + (index & (STORE_CHUNK_RECORDS - 1));
+}
+
+static inline bool store_is_live(const RecordStore* store, int index) {
+    return index >= 0 && index < store->slots && *store_live_flag(store, index);
+}
+
+// Function to get the base of one column within a chunk
+static inline void *store_column(const RecordStore* store, int chunk, int column) {
+    return store->chunks[chunk] + store_columns_offset(store)
+        + (size_t)column * STORE_CHUNK_RECORDS * store->column_width;
+}
+
+// Function to get the address of one record's value in a column
+static inline void *store_cell(const RecordStore* store, int index, int column) {
+    return (char*)store_column(store, index >> STORE_CHUNK_SHIFT, column)
+        + (size_t)(index & (STORE_CHUNK_RECORDS - 1)) * store->column_width;
+}
+
+// Function to get the words of one bit column within a chunk: record i of the chunk is
+// bit i % 64 of word i / 64
+static inline uint64_t *store_bit_column(const RecordStore* store, int chunk, int column) {
+    return (uint64_t*)(store->chunks[chunk] + store_bit_columns_offset(store)) + (size_t)column * (STORE_CHUNK_RECORDS / 64);
+}
+
+// Dead records double as free-list links: their first bytes hold the next free slot
+static inline int32_t *store_free_link(const RecordStore* store, int index) {
+    return (int32_t*)store_record(store, index);
+}
+
+static void store_mark_live(RecordStore* store, int index, bool live) {
+    *store_live_flag(store, index) = live;
+    store->chunk_live[index >> STORE_CHUNK_SHIFT] += live ? 1 : -1;
+    store->count += live ? 1 : -1;
+}
+
+// Byte offset of a chunk inside a store's backing file
+static inline off_t store_chunk_offset(const RecordStore* store, int chunk) {
+    return (off_t)STORE_HEADER_BYTES + (off_t)chunk * (off_t)store_chunk_stride(store);
+}
+
+// Function to shrink or grow the backing file to exactly the allocated chunks
+static bool store_truncate_file(const RecordStore* store) {
+    return ftruncate(store->fd, store_chunk_offset(store, store->chunk_count)) == 0;
+}
+
+// Function to get zeroed memory for a new chunk: from the heap for an in-memory store,
+// or by extending the backing file and mapping the new region
+static char *store_map_chunk(RecordStore* store, int chunk) {
+    size_t stride = store_chunk_stride(store);
+    if (store->fd == -1) {
+        // Anonymous pages arrive zeroed and are only allocated once touched
+        void *p = mmap(NULL, stride, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return p == MAP_FAILED ? NULL : p;
+    }
+    if (ftruncate(store->fd, store_chunk_offset(store, chunk + 1)) != 0) {
+        return NULL;
+    }
+    void *p = mmap(NULL, stride, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, store_chunk_offset(store, chunk));
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void store_unmap_chunk(RecordStore* store, int chunk) {
+    munmap(store->chunks[chunk], store_chunk_stride(store));
+}
+
+// Function to reserve a record slot, reusing a dead slot when one is free and
+// otherwise growing the store by a chunk if needed. Returns the index, or -1 if full.
+int store_alloc(RecordStore* store) {
+    int index;
+    if (store->free_head != -1) {
+        index = store->free_head;
+        store->free_head = *store_free_link(store, index);
+    } else {
+        index = store->slots;
+        int chunk = index >> STORE_CHUNK_SHIFT;
+        if (chunk >= STORE_MAX_CHUNKS) {
+            return -1;
+        }
+        if (chunk == store->chunk_count) {
+            store->chunks[chunk] = store_map_chunk(store, chunk);
+            if (store->chunks[chunk] == NULL) {
+                return -1;
+            }
+            store->chunk_count++;
+        }
+        // Published last, so a lock-free reader that sees the slot also sees its chunk
+        __atomic_store_n(&store->slots, store->slots + 1, __ATOMIC_RELEASE);
+    }
+    store_mark_live(store, index, true);
+    return index;
+}
+
+// Function to remove a record in O(1) by turning its slot into a tombstone
+void store_release(RecordStore* store, int index) {
+    store_mark_live(store, index, false);
+    *store_free_link(store, index) = store->free_head;
+    store->free_head = index;
+}
+
+// Function to find the first live slot at or after index (store->slots when none).
+// Chunks without live records are skipped whole.
+int store_next_live(const RecordStore* store, int index) {
+    while (index < store->slots) {
+        int chunk = index >> STORE_CHUNK_SHIFT;
+        if (store->chunk_live[chunk] == 0) {
+            index = (chunk + 1) << STORE_CHUNK_SHIFT;
+            continue;
+        }
+        if (*store_live_flag(store, index)) {
+            return index;
+        }
+        index++;
+    }
+    return store->slots;
+}
+
+// Function to find the first dead slot at or after index (store->slots when none)
+static int store_next_dead(const RecordStore* store, int index) {
+    while (index < store->slots && *store_live_flag(store, index)) {
+        index++;
+    }
+    return index;
+}
+
+// Number of tombstones currently waiting for reuse or compaction
+static inline int store_dead_slots(const RecordStore* store) {
+    return store->slots - store->count;
+}
+
+// Compaction pays off once tombstones outnumber live records; the O(slots) pass is then
+// amortized over at least as many removals as there are live records.
+static inline bool store_needs_compaction(const RecordStore* store) {
+    return store_dead_slots(store) > STORE_CHUNK_RECORDS / 4 && store_dead_slots(store) > store->count;
+}
+
+// Function to squeeze out tombstones: live records from the end of the store are moved
+// into the lowest holes, then trailing chunks are released. on_move(from, to) is called
+// for every relocated record so indexes can be repointed. This is the only operation
+// that changes a record's index, so callers must not hold indices across it.
+int store_compact(RecordStore* store, void (*on_move)(int from, int to)) {
+    int moved = 0;
+    int hole = store_next_dead(store, 0);
+    int tail = store->slots - 1;
+    while (true) {
+        while (tail >= 0 && !*store_live_flag(store, tail)) {
+            tail--;
+        }
+        if (hole >= tail) {
+            break;
+        }
+        memcpy(store_record(store, hole), store_record(store, tail), store->record_size);
+        for (int column = 0; column < store->column_count; column++) {
+            // Equal cells (mostly columns nobody uses) are not written, so they stay unallocated
+            void *to = store_cell(store, hole, column);
+            const void *from = store_cell(store, tail, column);
+            if (memcmp(to, from, store->column_width) != 0) {
+                memcpy(to, from, store->column_width);
+            }
+        }
+        store_mark_live(store, hole, true);
+        store_mark_live(store, tail, false);
+        if (on_move != NULL) {
+            on_move(tail, hole);
+        }
+        moved++;
+        hole = store_next_dead(store, hole + 1);
+    }
+
+    // Everything from count onwards is now dead
+    store->slots = store->count;
+    store->free_head = -1;
+    int needed_chunks = (store->slots + STORE_CHUNK_RECORDS - 1) >> STORE_CHUNK_SHIFT;
+    while (store->chunk_count > needed_chunks) {
+        store->chunk_count--;
+        store_unmap_chunk(store, store->chunk_count);
+        store->chunks[store->chunk_count] = NULL;
+        store->chunk_live[store->chunk_count] = 0;
+    }
+    if (store->fd != -1) {
+        store_truncate_file(store);
+    }
+    return moved;
+}
+
+// --- String Pool ---
+// Names and credentials are kept out of the fixed-size records, in a pool of 1 MB
+// chunks. A string is referred to by a 32-bit handle (its byte offset in the pool) and
+// occupies a block of whole 8-byte granules. Like the record stores, chunks never move,
+// and a released block goes on a free list (one per block size, threaded through the
+// blocks themselves) to be reused by the next string of that size, so removing a
+// student does not leave its name behind for good. Handle 0 is never handed out.
+#define STRING_POOL_CHUNK_SHIFT 20
+#define STRING_POOL_CHUNK_BYTES (1u << STRING_POOL_CHUNK_SHIFT) // 1 MB per chunk
+#define STRING_POOL_MAX_CHUNKS 4096                             // Handles address up to 4 GB
+#define STRING_GRANULE 8
+#define STRING_SIZE_CLASSES 32 // Blocks of 1..32 granules, so strings of up to 255 bytes
+
+typedef struct {
+    char magic[8];        // STRING_POOL_FILE_MAGIC
+    uint32_t version;     // DATA_FORMAT_VERSION
+    uint32_t chunk_bytes; // STRING_POOL_CHUNK_BYTES
+    uint32_t clean;       // 1 only after an orderly close; otherwise recover on open
+    uint32_t chunk_count;
+    uint64_t next;
+    uint64_t live_bytes;
+    uint32_t free_heads[STRING_SIZE_CLASSES];
+} StringPoolFileHeader;
+
+#define STRING_POOL_FILE_MAGIC "CAGSSTR"
+
+typedef struct {
+    char *chunks[STRING_POOL_MAX_CHUNKS];
+    int chunk_count;
+    uint64_t next;       // Every byte below this offset has been handed out at some point
+    uint64_t live_bytes; // Bytes in blocks that currently hold a string
+    uint32_t free_heads[STRING_SIZE_CLASSES]; // Released blocks of (class + 1) granules, or 0
+    int fd;                                   // Backing file, or -1 in memory
+    StringPoolFileHeader *file_header;
+} StringPool;
+
+StringPool string_pool = { .fd = -1 };
+
+static inline char *string_at(const StringPool* pool, uint32_t handle) {
+    return pool->chunks[handle >> STRING_POOL_CHUNK_SHIFT] + (handle & (STRING_POOL_CHUNK_BYTES - 1));
+}
+
+// Granules needed to hold a string of the given length and its null terminator
+static inline uint32_t string_granules(size_t length) {
+    return (uint32_t)((length + STRING_GRANULE) / STRING_GRANULE);
+}
+
+static inline uint32_t *string_free_link(const StringPool* pool, uint32_t handle) {
+    return (uint32_t*)string_at(pool, handle);
+}
+
+// Function to put a run of free granules (within one chunk) on the free lists
+static void string_pool_push_free(StringPool* pool, uint32_t handle, uint32_t granules) {
+    while (granules > 0) {
+        uint32_t take = granules < STRING_SIZE_CLASSES ? granules : STRING_SIZE_CLASSES;
+        *string_free_link(pool, handle) = pool->free_heads[take - 1];
+        pool->free_heads[take - 1] = handle;
+        handle += take * STRING_GRANULE;
+        granules -= take;
+    }
+}
+
+static char *string_pool_map_chunk(StringPool* pool, int chunk) {
+    if (pool->fd == -1) {
+        return calloc(1, STRING_POOL_CHUNK_BYTES);
+    }
+    off_t offset = FILE_PAGE_BYTES + (off_t)chunk * STRING_POOL_CHUNK_BYTES;
+    if (ftruncate(pool->fd, offset + STRING_POOL_CHUNK_BYTES) != 0) {
+        return NULL;
+    }
+    void *p = mmap(NULL, STRING_POOL_CHUNK_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, pool->fd, offset);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+// Function to copy a string into the pool. Returns its handle, or 0 if the pool is full
+// or the string is longer than 255 bytes.
+uint32_t string_pool_add(StringPool* pool, const char* text, size_t length) {
+    uint32_t granules = string_granules(length);
+    if (granules > STRING_SIZE_CLASSES) {
+        return 0;
+    }
+    uint32_t handle = 0;
+    for (uint32_t size = granules; size <= STRING_SIZE_CLASSES && handle == 0; size++) {
+        if (pool->free_heads[size - 1] != 0) {
+            handle = pool->free_heads[size - 1];
+            pool->free_heads[size - 1] = *string_free_link(pool, handle);
+            string_pool_push_free(pool, handle + granules * STRING_GRANULE, size - granules);
+        }
+    }
+    if (handle == 0) {
+        uint64_t bytes = (uint64_t)granules * STRING_GRANULE;
+        if (pool->next == 0) {
+            pool->next = STRING_GRANULE; // Keep handle 0 free to mean "no string"
+        }
+        uint64_t used = pool->next & (STRING_POOL_CHUNK_BYTES - 1);
+        if (used != 0 && used + bytes > STRING_POOL_CHUNK_BYTES) {
+            // Too little room left in this chunk: free the tail and start the next one
+            string_pool_push_free(pool, (uint32_t)pool->next, (uint32_t)((STRING_POOL_CHUNK_BYTES - used) / STRING_GRANULE));
+            pool->next += STRING_POOL_CHUNK_BYTES - used;
+        }
+        int chunk = (int)(pool->next >> STRING_POOL_CHUNK_SHIFT);
+        if (chunk >= STRING_POOL_MAX_CHUNKS) {
+            return 0;
+        }
+        if (chunk == pool->chunk_count) {
+            pool->chunks[chunk] = string_pool_map_chunk(pool, chunk);
+            if (pool->chunks[chunk] == NULL) {
+                return 0;
+            }
+            pool->chunk_count++;
+        }
+        handle = (uint32_t)pool->next;
+        pool->next += bytes;
+    }
+    char *dest = string_at(pool, handle);
+    memcpy(dest, text, length);
+    dest[length] = '\0';
+    pool->live_bytes += (uint64_t)granules * STRING_GRANULE;
+    return handle;
+}
+
+// Function to return a string's block to the pool for reuse
+void string_pool_release(StringPool* pool, uint32_t handle) {
+    uint32_t granules = string_granules(strlen(string_at(pool, handle)));
+    pool->live_bytes -= (uint64_t)granules * STRING_GRANULE;
+    string_pool_push_free(pool, handle, granules);
+}
+
+// Total memory held by the pool's chunks
+static inline size_t string_pool_bytes(const StringPool* pool) {
+    return (size_t)pool->chunk_count * STRING_POOL_CHUNK_BYTES;
+}
+
+static inline Student *student_at(int index) {
+    return store_record(&student_store, index);
+}
+
+static inline Teacher *teacher_at(int index) {
+    return store_record(&teacher_store, index);
+}
+
+static inline const char *student_name(int index) {
+    return string_at(&string_pool, student_at(index)->name);
+}
+
+static inline const char *student_credential(int index) {
+    return string_at(&string_pool, student_at(index)->credential);
+}
+
+static inline const char *teacher_username(int index) {
+    return string_at(&string_pool, teacher_at(index)->username);
+}
+
+static inline const char *teacher_credential(int index) {
+    return string_at(&string_pool, teacher_at(index)->credential);
+}
+
+static inline uint8_t *student_mark(int index, int subject) {
+    return store_cell(&student_store, index, MARK_COLUMN(subject));
+}
+
+static inline uint8_t *student_attendance(int index, int subject) {
+    return store_cell(&student_store, index, ATTENDANCE_COLUMN(subject));
+}
+
+// --- Utility Functions ---
+
+// Function to get the milliseconds elapsed since a CLOCK_MONOTONIC timestamp
+static double elapsed_ms(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Sequence locks let readers copy data while one writer changes it, without the
+// readers writing to shared memory. The writer makes the sequence odd, changes the
+// data, and makes it even again; a reader that saw an odd sequence, or a different one
+// after its copy, throws the copy away and tries again.
+static inline void seq_write_begin(uint32_t* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seq_write_end(uint32_t* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t seq_read_begin(const uint32_t* seq) {
+    uint32_t value;
+    int spins = 0;
+    while ((value = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) {
+        if (++spins % 64 == 0) {
+            sched_yield(); // The writer may be waiting for this CPU
+        }
+    }
+    return value;
+}
+
+static inline bool seq_read_retry(const uint32_t* seq, uint32_t start) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+// --- Screen Output ---
+// Interactive screens are built in one buffer and written with a single write() when
+// the program next waits for input, instead of as dozens of small printf calls; listing
+// 100,000 students becomes one system call. When stdout is not a terminal the colour
+// codes are dropped as text is added, so redirected output is plain text. Only the
+// interactive thread (or a command-line report) uses the screen.
+
+#define SCREEN_INITIAL_BYTES 16384
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+    bool color;  // stdout is a terminal, so the ANSI colour codes are kept
+    bool ready;
+} Screen;
+
+static Screen screen;
+
+// Function to write out everything added to the screen since the last flush
+void screen_flush(void) {
+    fflush(stdout); // Anything still printed through stdio was meant to come first
+    size_t written = 0;
+    while (written < screen.length) {
+        ssize_t n = write(STDOUT_FILENO, screen.data + written, screen.length - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break; // Nowhere to write to; the screen is dropped like printf output would be
+        }
+        written += (size_t)n;
+    }
+    screen.length = 0;
+}
+
+// Function to make room for bytes more characters; NULL if the buffer cannot grow
+static char* screen_reserve(size_t bytes) {
+    if (!screen.ready) {
+        screen.ready = true;
+        screen.color = isatty(STDOUT_FILENO);
+        atexit(screen_flush); // Exit paths must not lose a screen that was never flushed
+    }
+    if (screen.length + bytes > screen.capacity) {
+        size_t capacity = screen.capacity > 0 ? screen.capacity : SCREEN_INITIAL_BYTES;
+        while (capacity < screen.length + bytes) {
+            capacity *= 2;
+        }
+        char* data = realloc(screen.data, capacity);
+        if (data == NULL) {
+            screen_flush();
+            if (bytes > screen.capacity) {
+                return NULL;
+            }
+        } else {
+            screen.data = data;
+            screen.capacity = capacity;
+        }
+    }
+    return screen.data + screen.length;
+}
+
+// Function to remove the ANSI codes ("ESC [ ... m") from length bytes of text in place.
+// Returns the length left.
+static size_t strip_color(char* text, size_t length) {
+    char* end = text + length;
+    char* in = memchr(text, '\x1b', length);
+    if (in == NULL) {
+        return length;
+    }
+    char* out = in;
+    while (in < end) {
+        if (*in != '\x1b') {
+            *out++ = *in++;
+            continue;
+        }
+        in++;
+        if (in < end && *in == '[') {
+            in++;
+            while (in < end && !(*in >= 0x40 && *in <= 0x7e)) {
+                in++; // Parameter bytes, up to the final letter
+            }
+            if (in < end) {
+                in++;
+            }
+        }
+    }
+    return (size_t)(out - text);
+}
+
+// Function to remove the colour codes from the text added to the screen after offset from
+static void screen_strip_color(size_t from) {
+    screen.length = from + strip_color(screen.data + from, screen.length - from);
+}
+
+// Function to print a message on stderr. The colour codes are dropped unless stderr is a
+// terminal, so a log of a scripted run (--batch ... 2>log) is plain text too.
+void error_printf(const char* format, ...) {
+    char buffer[1024];
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(buffer, sizeof buffer, format, args);
+    va_end(args);
+    if (needed < 0) {
+        return;
+    }
+    char* text = buffer;
+    size_t length = (size_t)needed;
+    if (length >= sizeof buffer) {
+        char* large = malloc(length + 1);
+        if (large != NULL) {
+            va_start(args, format);
+            vsnprintf(large, length + 1, format, args);
+            va_end(args);
+            text = large;
+        } else {
+            length = sizeof buffer - 1; // Out of memory: the message is cut short
+        }
+    }
+    if (!isatty(STDERR_FILENO)) {
+        length = strip_color(text, length);
+    }
+    fwrite(text, 1, length, stderr);
+    if (text != buffer) {
+        free(text);
+    }
+}
+
+// Function to add length bytes of text to the screen as they are
+static inline void screen_append(const char* text, size_t length) {
+    char* tail = screen_reserve(length);
+    if (tail == NULL) {
+        fwrite(text, 1, length, stdout);
+        return;
+    }
+    memcpy(tail, text, length);
+    screen.length += length;
+}
+
+// Function to add an ANSI colour code, unless colours are off
+static inline void screen_color(const char* code) {
+    if (screen.color) {
+        screen_append(code, strlen(code));
+    }
+}
+
+// Function to add an unsigned number, zero-padded to width digits (0 for no padding)
+static void screen_append_uint(uint32_t value, int width) {
+    char digits[10];
+    int count = 0;
+    do {
+        digits[sizeof digits - ++count] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (count < width && count < (int)sizeof digits) {
+        digits[sizeof digits - ++count] = '0';
+    }
+    screen_append(digits + sizeof digits - count, count);
+}
+
+// Function to add text padded with spaces to at least width characters, like "%-*s"
+static void screen_append_padded(const char* text, int width) {
+    size_t length = strlen(text);
+    screen_append(text, length);
+    static const char spaces[] = "                                                  ";
+    if ((int)length < width) {
+        screen_append(spaces, (size_t)width - length < sizeof spaces - 1 ? (size_t)width - length : sizeof spaces - 1);
+    }
+}
+
+static void screen_vprintf(const char* format, va_list args) {
+    va_list retry;
+    va_copy(retry, args);
+    size_t from = screen.length;
+    char* tail = screen_reserve(256);
+    int length = tail != NULL ? vsnprintf(tail, screen.capacity - screen.length, format, args) : -1;
+    if (length >= 0 && (size_t)length >= screen.capacity - screen.length) {
+        tail = screen_reserve((size_t)length + 1);
+        length = tail != NULL ? vsnprintf(tail, (size_t)length + 1, format, retry) : -1;
+    }
+    if (tail == NULL) {
+        vprintf(format, retry); // Out of memory: print it directly
+    } else if (length > 0) {
+        screen.length += (size_t)length;
+        if (!screen.color) {
+            screen_strip_color(from);
+        }
+    }
+    va_end(retry);
+}
+
+// Function to add formatted text to the screen (printf for interactive output)
+void screen_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    screen_vprintf(format, args);
+    va_end(args);
+}
+
+// Function to add a prompt and show the screen, just before reading the user's answer
+void screen_prompt(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    screen_vprintf(format, args);
+    va_end(args);
+    screen_flush();
+}
+
+// --- Console Input ---
+// The menus read stdin through one 64 KB block buffer instead of scanf and getchar:
+// each read() brings in a block, and words, numbers and lines are cut straight out of
+// it. The functions mirror what the menus did before (scanf("%d"), scanf("%Ns"),
+// clearing the rest of the line, fgets), so bad answers are retried the same way, while
+// piped input no longer goes through libc one character at a time. Running out of
+// input ends the program cleanly instead of leaving a menu asking forever.
+
+#define INPUT_BLOCK_BYTES 65536
+
+typedef struct {
+    char data[INPUT_BLOCK_BYTES];
+    size_t next;  // First byte not consumed yet
+    size_t end;   // End of the bytes read so far
+    bool closed;  // read() found the end of input (or failed)
+} InputBuffer;
+
+static InputBuffer input;
+
+void close_data_store();
+
+// Function to read the next block of stdin; false once there is no more input
+static bool input_fill(void) {
+    if (input.closed) {
+        return false;
+    }
+    screen_flush(); // Whatever asked for the input has to be on screen before we wait
+    ssize_t n;
+    do {
+        n = read(STDIN_FILENO, input.data, sizeof input.data);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        input.closed = true;
+        return false;
+    }
+    input.next = 0;
+    input.end = (size_t)n;
+    return true;
+}
+
+// Function to end the program when stdin runs out while a menu still needs an answer
+static void input_closed(void) {
+    screen_printf(C_YELLOW "\nEnd of input; exiting.\n" C_RESET);
+    screen_flush();
+    close_data_store();
+    exit(0);
+}
+
+static inline bool input_is_space(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Function to skip the spaces and line breaks in front of the next word
+static void input_skip_space(void) {
+    while (true) {
+        while (input.next < input.end && input_is_space((unsigned char)input.data[input.next])) {
+            input.next++;
+        }
+        if (input.next < input.end) {
+            return;
+        }
+        if (!input_fill()) {
+            input_closed();
+        }
+    }
+}
+
+// Function to read the next word into out, like scanf("%Ns"). A word longer than
+// size - 1 characters is cut short and the rest of it skipped; false says so.
+bool input_word(char* out, size_t size) {
+    input_skip_space();
+    size_t length = 0;
+    bool whole = true;
+    do {
+        const char* p = input.data + input.next;
+        const char* end = input.data + input.end;
+        while (p < end && !input_is_space((unsigned char)*p)) {
+            if (length + 1 < size) {
+                out[length++] = *p;
+            } else {
+                whole = false;
+            }
+            p++;
+        }
+        input.next = p - input.data;
+    } while (input.next == input.end && input_fill());
+    out[length] = '\0';
+    return whole;
+}
+
+// Function to read the next word as a whole number, like scanf("%d"); false if it
+// does not start with one
+bool input_int(int* value) {
+    char word[16];
+    input_word(word, sizeof word);
+    const char* p = word;
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') {
+        p++;
+    }
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+    long number = 0;
+    while (*p >= '0' && *p <= '9' && number <= INT_MAX) {
+        number = number * 10 + (*p++ - '0');
+    }
+    if (number > INT_MAX) {
+        return false;
+    }
+    *value = negative ? -(int)number : (int)number;
+    return true;
+}
+
+// Function to read the next word as a SAP ID; one too long to be a SAP ID comes back empty
+void input_sap_id(char sap_id[SAP_ID_LENGTH + 1]) {
+    if (!input_word(sap_id, SAP_ID_LENGTH + 1)) {
+        sap_id[0] = '\0';
+    }
+}
+
+// Function to throw away the rest of the current line, including its line break
+void input_skip_line(void) {
+    do {
+        char* newline = memchr(input.data + input.next, '\n', input.end - input.next);
+        if (newline != NULL) {
+            input.next = newline + 1 - input.data;
+            return;
+        }
+        input.next = input.end;
+    } while (input_fill());
+}
+
+// Function to read the rest of the current line into out without its line break, like
+// fgets; longer lines are cut short. False if there is no input left at all.
+bool input_line(char* out, size_t size) {
+    if (input.next == input.end && !input_fill()) {
+        return false;
+    }
+    size_t length = 0;
+    do {
+        char* newline = memchr(input.data + input.next, '\n', input.end - input.next);
+        size_t chunk = (newline != NULL ? (size_t)(newline - input.data) : input.end) - input.next;
+        size_t copy = chunk < size - 1 - length ? chunk : size - 1 - length;
+        memcpy(out + length, input.data + input.next, copy);
+        length += copy;
+        if (newline != NULL) {
+            input.next = newline + 1 - input.data;
+            break;
+        }
+        input.next = input.end;
+    } while (input_fill());
+    out[length] = '\0';
+    return true;
+}
+
+// --- Subject Catalog ---
+// The subjects every student is scored in. The list only grows: a subject's position
+// is its column in the score matrices, so removing or reordering subjects would mix up
+// scores. The catalog is saved in subjects.db in persistent mode (see add_subject()).
+
+// Function to find a subject by name (case-insensitive), or -1
+int subject_find(const char* name) {
+    for (int subject = 0; subject < subject_count; subject++) {
+        if (strcasecmp(name, subject_names[subject]) == 0) {
+            return subject;
+        }
+    }
+    return -1;
+}
+
+// Function to check a new subject name: 1-23 letters, digits, '-' or '_', not only
+// digits (batch commands take a number as a menu choice), and not already taken
+const char* subject_name_problem(const char* name) {
+    size_t length = strlen(name);
+    if (length == 0 || length >= SUBJECT_NAME_BYTES) {
+        return "subject name must be 1-23 characters";
+    }
+    bool digits_only = true;
+    for (size_t i = 0; i < length; i++) {
+        char c = name[i];
+        bool digit = c >= '0' && c <= '9';
+        if (!digit && !(c >= 'a' && c <= 'z') && !(c >= 'A' && c <= 'Z') && c != '-' && c != '_') {
+            return "subject name may only use letters, digits, '-' and '_'";
+        }
+        digits_only &= digit;
+    }
+    if (digits_only) {
+        return "subject name cannot be a number";
+    }
+    if (subject_find(name) != -1) {
+        return "subject already exists";
+    }
+    return NULL;
+}
+
+// Function to get the width of the subject column in tables: the longest name, and at
+// least the width of the "Subject" heading
+int subject_label_width() {
+    int width = 7;
+    for (int subject = 0; subject < subject_count; subject++) {
+        int length = (int)strlen(subject_names[subject]);
+        if (length > width) {
+            width = length;
+        }
+    }
+    return width;
+}
+
+// Function to start a table rule: the corner, dashes across the subject column, then rest
+void screen_subject_rule(char corner, int width, const char* rest) {
+    static const char dashes[] = "--------------------------";
+    screen_append(&corner, 1);
+    screen_append(dashes, (size_t)width + 2);
+    screen_append(&corner, 1);
+    screen_append(rest, strlen(rest));
+}
+
+// --- Operation Metrics ---
+// Every hot-path operation (lookups, logins, edits, adds, removes, renders and
+// listings) counts itself and records its latency in a log-linear histogram, in the
+// style of HdrHistogram: each power of two is split into METRIC_SUB_BUCKETS equal
+// buckets, so any latency from 1 ns to centuries is kept to within 12.5% in a fixed
+// 4 KB per operation. Recording is two clock reads and three relaxed atomic adds, and
+// works from any thread.
+//
+// metrics_dump() writes everything in the Prometheus text format. It runs on SIGUSR1
+// (into METRICS_FILE in the data directory, for a local scraper) and from a hidden
+// teacher-portal option (choice 99, on screen).
+#define METRIC_SUB_BUCKET_BITS 3
+#define METRIC_SUB_BUCKETS (1 << METRIC_SUB_BUCKET_BITS)
+#define METRIC_BUCKETS (64 * METRIC_SUB_BUCKETS)
+#define METRICS_FILE "metrics.prom"
+
+typedef enum {
+    METRIC_LOOKUP, METRIC_LOGIN, METRIC_EDIT, METRIC_ADD, METRIC_REMOVE, METRIC_RENDER, METRIC_LIST,
+    METRIC_OPERATIONS
+} MetricOperation;
+
+static const char *metric_names[METRIC_OPERATIONS] = {
+    "lookup", "login", "edit", "add", "remove", "render", "list",
+};
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t buckets[METRIC_BUCKETS];
+} MetricHistogram;
+
+MetricHistogram metrics[METRIC_OPERATIONS];
+char metrics_path[PATH_MAX] = METRICS_FILE;
+
+static inline uint64_t metric_clock() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// Bucket for a latency: values below METRIC_SUB_BUCKETS get a bucket each, and every
+// higher power of two [2^e, 2^(e+1)) gets METRIC_SUB_BUCKETS buckets of equal width
+static inline int metric_bucket(uint64_t ns) {
+    if (ns < METRIC_SUB_BUCKETS) {
+        return (int)ns;
+    }
+    int exponent = 63 - __builtin_clzll(ns);
+    int sub = (int)(ns >> (exponent - METRIC_SUB_BUCKET_BITS)) & (METRIC_SUB_BUCKETS - 1);
+    return (exponent - METRIC_SUB_BUCKET_BITS + 1) * METRIC_SUB_BUCKETS + sub;
+}
+
+// Largest latency that falls in a bucket (the bucket's "le" bound)
+static uint64_t metric_bucket_limit(int bucket) {
+    if (bucket < METRIC_SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    int exponent = bucket / METRIC_SUB_BUCKETS + METRIC_SUB_BUCKET_BITS - 1;
+    uint64_t width = (uint64_t)1 << (exponent - METRIC_SUB_BUCKET_BITS);
+    return ((uint64_t)1 << exponent) + width * (uint64_t)(bucket % METRIC_SUB_BUCKETS + 1) - 1;
+}
+
+// Function to record one operation that started at metric_clock() == start
+static inline void metric_record(MetricOperation op, uint64_t start) {
+    uint64_t ns = metric_clock() - start;
+    MetricHistogram *h = &metrics[op];
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->buckets[metric_bucket(ns)], 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&h->max_ns, &max, ns, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Function to estimate a quantile from a snapshot of the buckets (its bucket's bound)
+static uint64_t metric_quantile(const uint64_t* buckets, uint64_t count, double quantile) {
+    uint64_t rank = (uint64_t)(quantile * (double)(count - 1)) + 1, seen = 0;
+    for (int bucket = 0; bucket < METRIC_BUCKETS; bucket++) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            return metric_bucket_limit(bucket);
+        }
+    }
+    return 0;
+}
+
+// Function to write every counter and histogram in the Prometheus text format. Values
+// are read without stopping the recorders, so a dump taken under load may be off by
+// the operations that finished while it was written.
+void metrics_dump(FILE* out) {
+    static uint64_t buckets[METRIC_BUCKETS];
+    fprintf(out, "# HELP college_operations_total Operations completed since startup.\n");
+    fprintf(out, "# TYPE college_operations_total counter\n");
+    for (int op = 0; op < METRIC_OPERATIONS; op++) {
+        fprintf(out, "college_operations_total{op=\"%s\"} %llu\n", metric_names[op],
+            (unsigned long long)__atomic_load_n(&metrics[op].count, __ATOMIC_RELAXED));
+    }
+    fprintf(out, "# HELP college_operation_latency_ns Operation latency in nanoseconds.\n");
+    fprintf(out, "# TYPE college_operation_latency_ns histogram\n");
+    for (int op = 0; op < METRIC_OPERATIONS; op++) {
+        uint64_t count = 0;
+        for (int bucket = 0; bucket < METRIC_BUCKETS; bucket++) {
+            buckets[bucket] = __atomic_load_n(&metrics[op].buckets[bucket], __ATOMIC_RELAXED);
+            count += buckets[bucket];
+        }
+        uint64_t cumulative = 0;
+        for (int bucket = 0; bucket < METRIC_BUCKETS; bucket++) {
+            if (buckets[bucket] != 0) { // Empty buckets add nothing, so they are left out
+                cumulative += buckets[bucket];
+                fprintf(out, "college_operation_latency_ns_bucket{op=\"%s\",le=\"%llu\"} %llu\n", metric_names[op],
+                    (unsigned long long)metric_bucket_limit(bucket), (unsigned long long)cumulative);
+            }
+        }
+        fprintf(out, "college_operation_latency_ns_bucket{op=\"%s\",le=\"+Inf\"} %llu\n", metric_names[op], (unsigned long long)count);
+        fprintf(out, "college_operation_latency_ns_sum{op=\"%s\"} %llu\n", metric_names[op],
+            (unsigned long long)__atomic_load_n(&metrics[op].sum_ns, __ATOMIC_RELAXED));
+        fprintf(out, "college_operation_latency_ns_count{op=\"%s\"} %llu\n", metric_names[op], (unsigned long long)count);
+        if (count > 0) {
+            static const double quantiles[] = { 0.5, 0.9, 0.99 };
+            uint64_t max = __atomic_load_n(&metrics[op].max_ns, __ATOMIC_RELAXED);
+            for (int q = 0; q < 3; q++) {
+                uint64_t bound = metric_quantile(buckets, count, quantiles[q]);
+                fprintf(out, "# %s p%g <= %llu ns\n", metric_names[op], quantiles[q] * 100,
+                    (unsigned long long)(bound < max ? bound : max));
+            }
+            fprintf(out, "# %s max = %llu ns\n", metric_names[op], (unsigned long long)max);
+        }
+    }
+}
+
+// Function to replace the metrics file with a fresh dump (written aside, then renamed,
+// so a scraper never reads half a file)
+bool metrics_write_file() {
+    char tmp_path[PATH_MAX + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", metrics_path);
+    FILE *out = fopen(tmp_path, "w");
+    if (out == NULL) {
+        return false;
+    }
+    metrics_dump(out);
+    if (fclose(out) != 0) {
+        unlink(tmp_path);
+        return false;
+    }
+    return rename(tmp_path, metrics_path) == 0;
+}
+
+// SIGUSR1 is blocked in every thread and taken here with sigwait(), so the dump runs
+// as ordinary code instead of inside a signal handler
+static void *metrics_signal_thread(void* arg) {
+    sigset_t *signals = arg;
+    int signal_number;
+    while (sigwait(signals, &signal_number) == 0) {
+        if (!metrics_write_file()) {
+            fprintf(stderr, "Warning: could not write %s: %s\n", metrics_path, strerror(errno));
+        }
+    }
+    return NULL;
+}
+
+// Function to start answering SIGUSR1 with a dump into dir (the working directory if
+// NULL). Must run before any other thread starts, so they all inherit the blocked signal.
+void metrics_start(const char* dir) {
+    if (dir != NULL) {
+        snprintf(metrics_path, sizeof(metrics_path), "%s/" METRICS_FILE, dir);
+    }
+    static sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    // The thread takes no other signal, so SIGINT still reaches the thread that waits for it
+    sigset_t all_signals, previous;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &previous);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, metrics_signal_thread, &signals) == 0) {
+        pthread_detach(thread);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+// --- Password Hashing ---
+// Passwords are stored as PBKDF2-HMAC-SHA256 hashes with a random per-password salt,
+// encoded as "$p$ITERATIONS$SALT$HASH" (crypt-style base64). The iteration count is
+// kept in each credential, so raising PASSWORD_HASH_ITERATIONS later still accepts the
+// older hashes. At the default cost one check takes several milliseconds, which is what
+// makes a stolen data directory expensive to brute-force, and why logins that arrive
+// over the network are checked on worker threads (see "Login Workers").
+#define PASSWORD_HASH_ITERATIONS 10000
+#define PASSWORD_SALT_BYTES 12 // 16 characters encoded
+#define PASSWORD_HASH_BYTES 24 // 32 characters encoded
+#define PASSWORD_MAX_ITERATIONS 10000000
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[64];
+    size_t used;
+} Sha256;
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_compress(uint32_t state[8], const uint8_t block[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void sha256_store(const uint32_t state[8], uint8_t digest[32]) {
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t)(state[i] >> 24);
+        digest[4 * i + 1] = (uint8_t)(state[i] >> 16);
+        digest[4 * i + 2] = (uint8_t)(state[i] >> 8);
+        digest[4 * i + 3] = (uint8_t)state[i];
+    }
+}
+
+static void sha256_init(Sha256* ctx) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void sha256_update(Sha256* ctx, const void* data, size_t length) {
+    const uint8_t *p = data;
+    ctx->length += length;
+    while (length > 0) {
+        size_t take = 64 - ctx->used < length ? 64 - ctx->used : length;
+        memcpy(ctx->block + ctx->used, p, take);
+        ctx->used += take;
+        p += take;
+        length -= take;
+        if (ctx->used == 64) {
+            sha256_compress(ctx->state, ctx->block);
+            ctx->used = 0;
+        }
+    }
+}
+
+static void sha256_final(Sha256* ctx, uint8_t digest[32]) {
+    uint64_t bits = ctx->length * 8;
+    ctx->block[ctx->used++] = 0x80;
+    if (ctx->used > 56) {
+        memset(ctx->block + ctx->used, 0, 64 - ctx->used);
+        sha256_compress(ctx->state, ctx->block);
+        ctx->used = 0;
+    }
+    memset(ctx->block + ctx->used, 0, 56 - ctx->used);
+    for (int i = 0; i < 8; i++) {
+        ctx->block[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    sha256_compress(ctx->state, ctx->block);
+    sha256_store(ctx->state, digest);
+}
+
+// Function to derive one block (up to 32 bytes) of PBKDF2-HMAC-SHA256. The HMAC key
+// pads are hashed once up front, so every iteration costs exactly two compressions.
+static void pbkdf2_sha256(const char* password, size_t password_length, const uint8_t* salt, size_t salt_length,
+                          uint32_t iterations, uint8_t* out, size_t out_length) {
+    uint8_t key[64] = { 0 };
+    if (password_length > sizeof(key)) {
+        Sha256 ctx;
+        sha256_init(&ctx);
+        sha256_update(&ctx, password, password_length);
+        sha256_final(&ctx, key);
+    } else {
+        memcpy(key, password, password_length);
+    }
+    uint8_t pad[64];
+    Sha256 inner, outer;
+    for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x36;
+    sha256_init(&inner);
+    sha256_update(&inner, pad, sizeof(pad));
+    for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x5c;
+    sha256_init(&outer);
+    sha256_update(&outer, pad, sizeof(pad));
+
+    // U1 = HMAC(password, salt || block number 1)
+    static const uint8_t block_number[4] = { 0, 0, 0, 1 };
+    uint8_t u[32], t[32];
+    Sha256 ctx = inner;
+    sha256_update(&ctx, salt, salt_length);
+    sha256_update(&ctx, block_number, sizeof(block_number));
+    sha256_final(&ctx, u);
+    ctx = outer;
+    sha256_update(&ctx, u, sizeof(u));
+    sha256_final(&ctx, u);
+    memcpy(t, u, sizeof(t));
+
+    // Every later HMAC hashes one 32-byte digest after a 64-byte pad: a single block
+    // whose padding and length (768 bits) never change
+    uint8_t block[64] = { 0 };
+    block[32] = 0x80;
+    block[62] = 0x03;
+    for (uint32_t round = 1; round < iterations; round++) {
+        uint32_t state[8];
+        memcpy(block, u, sizeof(u));
+        memcpy(state, inner.state, sizeof(state));
+        sha256_compress(state, block);
+        sha256_store(state, block);
+        memcpy(state, outer.state, sizeof(state));
+        sha256_compress(state, block);
+        sha256_store(state, u);
+        for (int i = 0; i < 32; i++) {
+            t[i] ^= u[i];
+        }
+    }
+    memcpy(out, t, out_length);
+    memset(key, 0, sizeof(key));
+    memset(pad, 0, sizeof(pad));
+}
+
+static const char credential_alphabet[] = "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+// Function to encode bytes (a multiple of 3) in crypt-style base64
+static char *credential_encode(char* out, const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2];
+        for (int shift = 18; shift >= 0; shift -= 6) {
+            *out++ = credential_alphabet[(v >> shift) & 63];
+        }
+    }
+    return out;
+}
+
+// Function to decode exactly length bytes (a multiple of 3). Returns the end of the
+// text used, or NULL if it is not valid.
+static const char *credential_decode(const char* text, uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t v = 0;
+        for (int digit = 0; digit < 4; digit++) {
+            const char *found = *text != '\0' ? strchr(credential_alphabet, *text) : NULL;
+            if (found == NULL) {
+                return NULL;
+            }
+            v = v << 6 | (uint32_t)(found - credential_alphabet);
+            text++;
+        }
+        data[i] = (uint8_t)(v >> 16);
+        data[i + 1] = (uint8_t)(v >> 8);
+        data[i + 2] = (uint8_t)v;
+    }
+    return text;
+}
+
+// Function to split a credential into its parts. Returns false if it is malformed.
+static bool credential_parse(const char* credential, uint32_t* iterations, uint8_t salt[PASSWORD_SALT_BYTES],
+                             uint8_t hash[PASSWORD_HASH_BYTES]) {
+    if (strncmp(credential, "$p$", 3) != 0) {
+        return false;
+    }
+    char *end;
+    errno = 0;
+    unsigned long count = strtoul(credential + 3, &end, 10);
+    if (errno != 0 || end == credential + 3 || *end != '$' || count < 1 || count > PASSWORD_MAX_ITERATIONS) {
+        return false;
+    }
+    const char *p = credential_decode(end + 1, salt, PASSWORD_SALT_BYTES);
+    if (p == NULL || *p != '$') {
+        return false;
+    }
+    p = credential_decode(p + 1, hash, PASSWORD_HASH_BYTES);
+    if (p == NULL || *p != '\0') {
+        return false;
+    }
+    *iterations = (uint32_t)count;
+    return true;
+}
+
+// Function to check that text is a well-formed credential (e.g. a pre-hashed roster entry)
+bool credential_is_valid(const char* text) {
+    uint32_t iterations;
+    uint8_t salt[PASSWORD_SALT_BYTES], hash[PASSWORD_HASH_BYTES];
+    return strlen(text) < CREDENTIAL_BYTES && credential_parse(text, &iterations, salt, hash);
+}
+
+// Function to hash a password with a fresh random salt into credential
+void hash_password(const char* password, char credential[CREDENTIAL_BYTES]) {
+    uint8_t salt[PASSWORD_SALT_BYTES], hash[PASSWORD_HASH_BYTES];
+    size_t got = 0;
+    while (got < sizeof(salt)) {
+        ssize_t n = getrandom(salt + got, sizeof(salt) - got, 0);
+        if (n == -1 && errno != EINTR) {
+            fprintf(stderr, "Fatal: no randomness for password salts (%s).\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        got += n > 0 ? (size_t)n : 0;
+    }
+    pbkdf2_sha256(password, strlen(password), salt, sizeof(salt), PASSWORD_HASH_ITERATIONS, hash, sizeof(hash));
+    char *out = credential + snprintf(credential, CREDENTIAL_BYTES, "$p$%d$", PASSWORD_HASH_ITERATIONS);
+    out = credential_encode(out, salt, sizeof(salt));
+    *out++ = '$';
+    out = credential_encode(out, hash, sizeof(hash));
+    *out = '\0';
+}
+
+// Function to check a password against a credential. The hashes are compared in
+// constant time, and a NULL or malformed credential still costs a full hash, so the
+// time taken says nothing about which part of a login was wrong.
+bool verify_password(const char* password, const char* credential) {
+    static const uint8_t decoy_salt[PASSWORD_SALT_BYTES] = { 0 };
+    uint64_t start = metric_clock();
+    uint32_t iterations = PASSWORD_HASH_ITERATIONS;
+    uint8_t salt[PASSWORD_SALT_BYTES], expected[PASSWORD_HASH_BYTES], actual[PASSWORD_HASH_BYTES];
+    bool known = credential != NULL && credential_parse(credential, &iterations, salt, expected);
+    if (!known) {
+        iterations = PASSWORD_HASH_ITERATIONS;
+        memcpy(salt, decoy_salt, sizeof(salt));
+        memset(expected, 0, sizeof(expected));
+    }
+    pbkdf2_sha256(password, strlen(password), salt, sizeof(salt), iterations, actual, sizeof(actual));
+    uint8_t difference = 0;
+    for (size_t i = 0; i < sizeof(actual); i++) {
+        difference |= actual[i] ^ expected[i];
+    }
+    metric_record(METRIC_LOGIN, start);
+    return known & (difference == 0);
+}
+
+// --- SAP ID Hash Index ---
+// Open-addressing (linear probing) table from the numeric SAP ID to the student's
+// index in the student store. Every 9-digit ID fits in a uint32_t, and UINT32_MAX can never
+// be a valid ID, so it marks an empty slot.
+#define SAP_INDEX_EMPTY UINT32_MAX
+#define SAP_INDEX_MIN_CAPACITY 64
+
+typedef struct {
+    uint32_t key;   // Numeric SAP ID
+    int32_t value;  // Index into the student store
+} SapIndexSlot;
+
+SapIndexSlot *sap_index = NULL;
+uint32_t sap_index_capacity = 0; // Always a power of two
+uint32_t sap_index_shift = 32;    // 32 - log2(capacity)
+uint32_t sap_index_size = 0;
+
+// Lock-free readers (see read_student()) may probe the table while a writer changes it.
+// Every change is made with sap_index_sequence odd, and a table replaced by a resize is
+// retired instead of freed, until sap_index_reclaim() runs at a point with no readers.
+// Readers never use the three globals above: a resize publishes the new table with its
+// capacity and shift as one view, swapped in behind a single pointer, so a reader
+// always probes a table with the size it was allocated with.
+uint32_t sap_index_sequence = 0;
+
+typedef struct {
+    SapIndexSlot *table;
+    uint32_t capacity;
+    uint32_t shift;
+} SapIndexView;
+
+SapIndexView *sap_index_view = NULL; // Stored with release, loaded with acquire
+
+typedef struct RetiredTable {
+    SapIndexSlot *table;
+    uint32_t capacity;
+    int fd;
+    SapIndexView *view; // The view that published it
+    struct RetiredTable *next;
+} RetiredTable;
+
+RetiredTable *sap_index_retired = NULL;
+
+// In persistent mode the table is the body of a mapped index file, after one header page
+typedef struct {
+    char magic[8];     // SAP_INDEX_FILE_MAGIC
+    uint32_t version;  // DATA_FORMAT_VERSION
+    uint32_t capacity;
+    uint32_t shift;
+    uint32_t size;     // Written on orderly close
+} SapIndexFileHeader;
+
+#define SAP_INDEX_FILE_MAGIC "CAGSIDX"
+
+char sap_index_path[PATH_MAX] = ""; // Empty for a heap-allocated index
+int sap_index_fd = -1;
+
+static inline SapIndexFileHeader *sap_index_file_header() {
+    return (SapIndexFileHeader*)((char*)sap_index - FILE_PAGE_BYTES);
+}
+
+static inline size_t sap_index_file_bytes(uint32_t capacity) {
+    return FILE_PAGE_BYTES + (size_t)capacity * sizeof(SapIndexSlot);
+}
+
+// Function to convert a 9-digit SAP ID string to its numeric key (false if not 9 digits)
+bool parse_sap_id(const char* sap_id, uint32_t* key) {
+    uint32_t value = 0;
+    for (int i = 0; i < SAP_ID_LENGTH; i++) {
+        if (sap_id[i] < '0' || sap_id[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (uint32_t)(sap_id[i] - '0');
+    }
+    if (sap_id[SAP_ID_LENGTH] != '\0') {
+        return false;
+    }
+    *key = value;
+    return true;
+}
+
+// Fibonacci hashing spreads consecutive SAP IDs (same batch/year) across the table
+static inline uint32_t sap_index_slot_for(uint32_t key) {
+    return (key * 2654435769u) >> sap_index_shift;
+}
+
+static void sap_index_place(uint32_t key, int32_t value) {
+    uint32_t i = sap_index_slot_for(key);
+    while (sap_index[i].key != SAP_INDEX_EMPTY) {
+        i = (i + 1) & (sap_index_capacity - 1);
+    }
+    sap_index[i].key = key;
+    sap_index[i].value = value;
+}
+
+// Function to allocate an empty table: on the heap, or as a fresh mapped file next to
+// the live index file (renamed over it once filled). Returns NULL on failure.
+static SapIndexSlot *sap_index_new_table(uint32_t capacity, uint32_t shift, int* fd_out) {
+    SapIndexSlot *table = NULL;
+    *fd_out = -1;
+    if (sap_index_path[0] == '\0') {
+        table = malloc(capacity * sizeof(SapIndexSlot));
+    } else {
+        char tmp_path[PATH_MAX + 8];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.new", sap_index_path);
+        int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            return NULL;
+        }
+        void *map = MAP_FAILED;
+        if (ftruncate(fd, sap_index_file_bytes(capacity)) == 0) {
+            map = mmap(NULL, sap_index_file_bytes(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (map == MAP_FAILED) {
+            close(fd);
+            return NULL;
+        }
+        SapIndexFileHeader *header = map;
+        memcpy(header->magic, SAP_INDEX_FILE_MAGIC, sizeof(header->magic));
+        header->version = DATA_FORMAT_VERSION;
+        header->capacity = capacity;
+        header->shift = shift;
+        table = (SapIndexSlot*)((char*)map + FILE_PAGE_BYTES);
+        *fd_out = fd;
+    }
+    if (table != NULL) {
+        for (uint32_t i = 0; i < capacity; i++) {
+            table[i].key = SAP_INDEX_EMPTY;
+        }
+    }
+    return table;
+}
+
+// Function to publish the writer's current table to readers in one pointer swap.
+// Returns the view it replaces, which readers may still be using.
+static SapIndexView *sap_index_publish() {
+    SapIndexView *view = malloc(sizeof(SapIndexView));
+    if (view == NULL) {
+        fprintf(stderr, "Fatal: out of memory while resizing the SAP ID index.\n");
+        exit(EXIT_FAILURE);
+    }
+    *view = (SapIndexView){ sap_index, sap_index_capacity, sap_index_shift };
+    return __atomic_exchange_n(&sap_index_view, view, __ATOMIC_ACQ_REL);
+}
+
+static void sap_index_release_table(SapIndexSlot* table, uint32_t capacity, int fd) {
+    if (fd == -1) {
+        free(table);
+    } else {
+        munmap((char*)table - FILE_PAGE_BYTES, sap_index_file_bytes(capacity));
+        close(fd);
+    }
+}
+
+// Function to resize the table, keeping the load factor below 70%
+void sap_index_reserve(uint32_t entries) {
+    uint32_t capacity = SAP_INDEX_MIN_CAPACITY;
+    uint32_t shift = 26; // log2(SAP_INDEX_MIN_CAPACITY) == 6
+    while ((uint64_t)capacity * 7 / 10 < entries) {
+        capacity *= 2;
+        shift--;
+    }
+    if (capacity <= sap_index_capacity) {
+        return;
+    }
+
+    SapIndexSlot *old = sap_index;
+    uint32_t old_capacity = sap_index_capacity;
+    int old_fd = sap_index_fd;
+
+    int fd;
+    sap_index = sap_index_new_table(capacity, shift, &fd);
+    if (sap_index == NULL) {
+        fprintf(stderr, "Fatal: could not allocate the SAP ID index (%s).\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    sap_index_capacity = capacity;
+    sap_index_shift = shift;
+    sap_index_fd = fd;
+
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old[i].key != SAP_INDEX_EMPTY) {
+            sap_index_place(old[i].key, old[i].value);
+        }
+    }
+    if (fd != -1) {
+        char tmp_path[PATH_MAX + 8];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.new", sap_index_path);
+        rename(tmp_path, sap_index_path);
+    }
+    // Only now that the new table is filled do readers switch to it
+    SapIndexView *old_view = sap_index_publish();
+    if (old != NULL) {
+        RetiredTable *retired = malloc(sizeof(RetiredTable));
+        if (retired == NULL) {
+            fprintf(stderr, "Fatal: out of memory while resizing the SAP ID index.\n");
+            exit(EXIT_FAILURE);
+        }
+        *retired = (RetiredTable){ old, old_capacity, old_fd, old_view, sap_index_retired };
+        sap_index_retired = retired;
+    } else {
+        free(old_view);
+    }
+}
+
+// Function to free the tables retired by resizes. Only call it when no thread can be
+// inside read_student().
+void sap_index_reclaim() {
+    while (sap_index_retired != NULL) {
+        RetiredTable *retired = sap_index_retired;
+        sap_index_retired = retired->next;
+        sap_index_release_table(retired->table, retired->capacity, retired->fd);
+        free(retired->view);
+        free(retired);
+    }
+}
+
+// Function to drop every entry (used before rebuilding the index from the store)
+void sap_index_reset() {
+    sap_index_reclaim();
+    if (sap_index != NULL) {
+        sap_index_release_table(sap_index, sap_index_capacity, sap_index_fd);
+    }
+    free(__atomic_exchange_n(&sap_index_view, NULL, __ATOMIC_ACQ_REL));
+    sap_index = NULL;
+    sap_index_capacity = 0;
+    sap_index_shift = 32;
+    sap_index_size = 0;
+    sap_index_fd = -1;
+}
+
+// Function to return the student index stored for a key, or -1
+int sap_index_lookup(uint32_t key) {
+    if (sap_index_size == 0) {
+        return -1;
+    }
+    uint32_t i = sap_index_slot_for(key);
+    while (sap_index[i].key != SAP_INDEX_EMPTY) {
+        if (sap_index[i].key == key) {
+            return sap_index[i].value;
+        }
+        i = (i + 1) & (sap_index_capacity - 1);
+    }
+    return -1;
+}
+
+// Function to add a key (or repoint an existing one) to a student index
+void sap_index_insert(uint32_t key, int value) {
+    seq_write_begin(&sap_index_sequence);
+    sap_index_reserve(sap_index_size + 1);
+    uint32_t i = sap_index_slot_for(key);
+    while (sap_index[i].key != SAP_INDEX_EMPTY && sap_index[i].key != key) {
+        i = (i + 1) & (sap_index_capacity - 1);
+    }
+    if (sap_index[i].key == SAP_INDEX_EMPTY) {
+        sap_index_size++;
+    }
+    sap_index[i].value = value;
+    __atomic_store_n(&sap_index[i].key, key, __ATOMIC_RELEASE); // Value first, for readers
+    seq_write_end(&sap_index_sequence);
+}
+
+// Function to delete a key. Uses backward-shift deletion so no tombstones are left
+// behind and probe sequences stay short after many removals.
+void sap_index_remove(uint32_t key) {
+    if (sap_index_size == 0) {
+        return;
+    }
+    uint32_t mask = sap_index_capacity - 1;
+    uint32_t i = sap_index_slot_for(key);
+    while (sap_index[i].key != key) {
+        if (sap_index[i].key == SAP_INDEX_EMPTY) {
+            return; // Not present
+        }
+        i = (i + 1) & mask;
+    }
+
+    seq_write_begin(&sap_index_sequence);
+    // Pull later members of the probe run back into the hole
+    uint32_t hole = i;
+    uint32_t j = (i + 1) & mask;
+    while (sap_index[j].key != SAP_INDEX_EMPTY) {
+        uint32_t home = sap_index_slot_for(sap_index[j].key);
+        // Move j into the hole only if its home slot is not between hole and j (cyclically)
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            sap_index[hole] = sap_index[j];
+            hole = j;
+        }
+        j = (j + 1) & mask;
+    }
+    sap_index[hole].key = SAP_INDEX_EMPTY;
+    sap_index_size--;
+    seq_write_end(&sap_index_sequence);
+}
+
+// Function to find a student's index by SAP ID (O(1) through the hash index)
+int find_student_index(const char* sap_id) {
+    uint64_t start = metric_clock();
+    uint32_t key;
+    // Not a valid SAP ID means it cannot be registered
+    int index = parse_sap_id(sap_id, &key) ? sap_index_lookup(key) : -1;
+    metric_record(METRIC_LOOKUP, start);
+    return index;
+}
+
+// Function to validate a new SAP ID and make sure it is not already taken
+bool check_new_sap_id(const char* sap_id) {
+    uint32_t key;
+    if (!parse_sap_id(sap_id, &key)) {
+        screen_printf(C_RED "Error: SAP ID must be exactly %d digits.\n" C_RESET, SAP_ID_LENGTH);
+        return false;
+    }
+    if (sap_index_lookup(key) != -1) {
+        screen_printf(C_RED "Error: SAP ID already exists. Try again.\n" C_RESET);
+        return false;
+    }
+    return true;
+}
+
+// Function to register the student at the given index in the SAP ID index
+void index_student(int index) {
+    sap_index_insert(student_at(index)->sap_id, index);
+}
+
+// Function to drop the student at the given index from the SAP ID index
+void unindex_student(int index) {
+    sap_index_remove(student_at(index)->sap_id);
+}
+
+// --- Teacher Username Index ---
+// Usernames map to teacher indices through an open-addressing table keyed by a 32-bit
+// FNV-1a hash of the name, so a login looks up one slot instead of comparing every
+// teacher's username. Each slot keeps the full hash, so the username itself is only
+// compared when the hashes match. Teachers are never removed, so no deletion is needed.
+// The table lives in memory and is rebuilt from the teacher store on open.
+typedef struct {
+    uint32_t hash;
+    int32_t index; // -1 when the slot is empty
+} TeacherIndexSlot;
+
+TeacherIndexSlot *teacher_index = NULL;
+uint32_t teacher_index_capacity = 0; // Always a power of two
+uint32_t teacher_index_size = 0;
+
+static uint32_t username_hash(const char* username) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char*)username; *p != '\0'; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
+static void teacher_index_place(uint32_t hash, int index) {
+    uint32_t i = (hash * 2654435769u) & (teacher_index_capacity - 1);
+    while (teacher_index[i].index != -1) {
+        i = (i + 1) & (teacher_index_capacity - 1);
+    }
+    teacher_index[i] = (TeacherIndexSlot){ hash, index };
+}
+
+// Function to add a stored teacher to the index, growing it to stay below 70% full
+void index_teacher(int index) {
+    if ((uint64_t)(teacher_index_size + 1) * 10 > (uint64_t)teacher_index_capacity * 7) {
+        uint32_t capacity = teacher_index_capacity ? teacher_index_capacity * 2 : 64;
+        TeacherIndexSlot *old = teacher_index;
+        uint32_t old_capacity = teacher_index_capacity;
+        teacher_index = malloc(capacity * sizeof(TeacherIndexSlot));
+        if (teacher_index == NULL) {
+            fprintf(stderr, "Fatal: out of memory while growing the teacher index.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (uint32_t i = 0; i < capacity; i++) {
+            teacher_index[i].index = -1;
+        }
+        teacher_index_capacity = capacity;
+        for (uint32_t i = 0; i < old_capacity; i++) {
+            if (old[i].index != -1) {
+                teacher_index_place(old[i].hash, old[i].index);
+            }
+        }
+        free(old);
+    }
+    teacher_index_place(username_hash(teacher_username(index)), index);
+    teacher_index_size++;
+}
+
+// Function to find a teacher's index by username, or -1
+int find_teacher_index(const char* username) {
+    if (teacher_index_size == 0) {
+        return -1;
+    }
+    uint32_t hash = username_hash(username);
+    uint32_t i = (hash * 2654435769u) & (teacher_index_capacity - 1);
+    while (teacher_index[i].index != -1) {
+        if (teacher_index[i].hash == hash && strcmp(teacher_username(teacher_index[i].index), username) == 0) {
+            return teacher_index[i].index;
+        }
+        i = (i + 1) & (teacher_index_capacity - 1);
+    }
+    return -1;
+}
+
+// Function to rebuild the index from the teacher store
+void rebuild_teacher_index() {
+    free(teacher_index);
+    teacher_index = NULL;
+    teacher_index_capacity = teacher_index_size = 0;
+    for (int i = store_next_live(&teacher_store, 0); i < teacher_store.slots; i = store_next_live(&teacher_store, i + 1)) {
+        index_teacher(i);
+    }
+}
+
+// --- Running Totals ---
+// Class-wide figures for every score column, adjusted by the difference on every write
+// so that dashboards read them instead of scanning the roster: the sum and sum of
+// squares (for the mean and variance), the number of students under the column's
+// threshold (attendance defaulters, marks below a pass) and the number of students on
+// each score, from which the lowest and highest scores are read.
+//
+// The totals are built by one scan when the data directory is opened, before the
+// journal is replayed, and are then kept in step by insert_student(), delete_student()
+// and write_student_score(). Code that writes score cells directly brackets the writes
+// with begin_score_rewrite() and end_score_rewrite(). Changed and read under
+// student_write_lock; running_totals_verify() checks them against a full recompute.
+#define ATTENDANCE_THRESHOLD 75 // Attendance below this (%) counts as a defaulter
+#define PASS_MARK 40            // Marks below this count as a fail
+
+typedef struct {
+    int64_t sum;
+    int64_t sum_squares;
+    int64_t below;         // Students under the column's threshold
+    uint32_t counts[256];  // Students on each score
+} RunningTotals;
+
+RunningTotals running_totals[STUDENT_COLUMNS];
+
+static inline int running_totals_threshold(int column) {
+    return column < SUBJECT_MAX ? PASS_MARK : ATTENDANCE_THRESHOLD;
+}
+
+// Function to count one more (delta 1) or one fewer (delta -1) student on a score
+static inline void running_totals_count(RunningTotals* t, int column, int value, int delta) {
+    t->sum += delta * value;
+    t->sum_squares += delta * value * value;
+    t->below += delta * (value < running_totals_threshold(column));
+    t->counts[value] += (uint32_t)delta;
+}
+
+// Function to count every score of one live student in or out of the totals
+static void running_totals_student(RunningTotals* totals, int index, int delta) {
+    for (int column = 0; column < STUDENT_COLUMNS; column++) {
+        if (student_column_in_use(column)) {
+            running_totals_count(&totals[column], column, *(uint8_t*)store_cell(&student_store, index, column), delta);
+        }
+    }
+}
+
+// Function to compute the totals of every live student into `totals`
+static void running_totals_scan(RunningTotals* totals) {
+    memset(totals, 0, STUDENT_COLUMNS * sizeof(RunningTotals));
+    for (int i = store_next_live(&student_store, 0); i < student_store.slots; i = store_next_live(&student_store, i + 1)) {
+        running_totals_student(totals, i, 1);
+    }
+}
+
+void running_totals_rebuild() {
+    running_totals_scan(running_totals);
+}
+
+// Function to adjust a column's totals for one changed cell
+static inline void running_totals_change(int column, int old_value, int value) {
+    running_totals_count(&running_totals[column], column, old_value, -1);
+    running_totals_count(&running_totals[column], column, value, 1);
+}
+
+// Function to count a new subject's columns, where every student starts on 0
+void running_totals_add_subject(int subject) {
+    int columns[2] = { MARK_COLUMN(subject), ATTENDANCE_COLUMN(subject) };
+    for (int c = 0; c < 2; c++) {
+        RunningTotals *t = &running_totals[columns[c]];
+        memset(t, 0, sizeof(*t));
+        t->counts[0] = (uint32_t)student_store.count;
+        t->below = 0 < running_totals_threshold(columns[c]) ? student_store.count : 0;
+    }
+}
+
+// Figures for one column, read off its totals
+typedef struct {
+    int64_t count;
+    double mean;
+    double variance;  // Population variance
+    int min;
+    int max;
+    int64_t below;
+} ColumnSummary;
+
+void running_totals_summary(int column, ColumnSummary* summary) {
+    const RunningTotals *t = &running_totals[column];
+    summary->count = student_store.count;
+    summary->below = t->below;
+    summary->mean = summary->count > 0 ? (double)t->sum / summary->count : 0;
+    summary->variance = summary->count > 0 ? (double)t->sum_squares / summary->count - summary->mean * summary->mean : 0;
+    if (summary->variance < 0) {
+        summary->variance = 0; // Rounding when every score is the same
+    }
+    summary->min = 0;
+    while (summary->min < 255 && t->counts[summary->min] == 0) summary->min++;
+    summary->max = 255;
+    while (summary->max > 0 && t->counts[summary->max] == 0) summary->max--;
+}
+
+// --- Leaderboards ---
+// Class toppers per subject and by total marks, kept up to date as marks change instead
+// of being found by sorting the roster. A board has a bucket for every possible score
+// (0-100 for a subject, up to 100 per subject for the total). Each bucket is a doubly
+// linked list of the students on that score, threaded through one link per store slot,
+// and a Fenwick tree over the bucket sizes counts the students above any score. A mark
+// change moves the student between two buckets, O(log S) for S possible scores however
+// large the roster is. A student's rank is one more than the number of students above
+// them, so tied students share a rank; the top N are read by walking down the buckets.
+//
+// A board is built from the store the first time it is touched. After that the store
+// functions keep it current: insert_student(), delete_student(), write_student_score()
+// and compaction. Code that writes score cells directly calls end_score_rewrite()
+// afterwards. Boards are changed and read under student_write_lock.
+#define LEADERBOARD_TOTAL SUBJECT_MAX // Board number of the total-marks board
+#define LEADERBOARD_COUNT (SUBJECT_MAX + 1)
+#define LEADERBOARD_UNRANKED UINT16_MAX
+#define LEADERBOARD_MAX_LISTED 100 // Most toppers a menu or batch command asks for
+
+typedef struct {
+    int32_t next;
+    int32_t prev;
+    uint16_t score;  // Bucket the student is in, or LEADERBOARD_UNRANKED
+} LeaderboardLink;
+
+typedef struct {
+    LeaderboardLink *links;  // One per store slot, leaderboard_capacity of them
+    int32_t *heads;          // First student in each bucket, -1 if none; NULL until built
+    int32_t *tree;           // Fenwick tree of bucket sizes, highest score first
+    int scores;              // Possible scores: the highest + 1
+    int32_t ranked;          // Students on the board
+} Leaderboard;
+
+Leaderboard leaderboards[LEADERBOARD_COUNT];
+int leaderboard_capacity;    // Slots that every built board has a link for
+
+static inline bool leaderboard_in_use(int board) {
+    return board < subject_count || board == LEADERBOARD_TOTAL;
+}
+
+static inline const char *leaderboard_name(int board) {
+    return board == LEADERBOARD_TOTAL ? "Total" : subject_names[board];
+}
+
+static int leaderboard_score_of(int board, int index) {
+    if (board != LEADERBOARD_TOTAL) {
+        return *student_mark(index, board);
+    }
+    int total = 0;
+    for (int subject = 0; subject < subject_count; subject++) {
+        total += *student_mark(index, subject);
+    }
+    return total;
+}
+
+// Fenwick tree positions run from the highest score (1) to the lowest (scores)
+static void leaderboard_count(Leaderboard* b, int score, int delta) {
+    for (int i = b->scores - score; i <= b->scores; i += i & -i) {
+        b->tree[i] += delta;
+    }
+}
+
+// Function to count the students on a board with a score above `score`
+static int32_t leaderboard_above(const Leaderboard* b, int score) {
+    int32_t above = 0;
+    for (int i = b->scores - score - 1; i > 0; i -= i & -i) {
+        above += b->tree[i];
+    }
+    return above;
+}
+
+// Function to make sure every built board has a link for slot `index`
+static bool leaderboard_reserve(int index) {
+    if (index < leaderboard_capacity) {
+        return true;
+    }
+    int capacity = leaderboard_capacity ? leaderboard_capacity : STORE_CHUNK_RECORDS;
+    while (capacity <= index) capacity *= 2;
+    // Every built board gets its new links before any is switched over, so running out
+    // of memory leaves all of them as they were
+    LeaderboardLink *grown[LEADERBOARD_COUNT] = { NULL };
+    for (int board = 0; board < LEADERBOARD_COUNT; board++) {
+        if (leaderboards[board].heads == NULL) {
+            continue;
+        }
+        grown[board] = malloc((size_t)capacity * sizeof(LeaderboardLink));
+        if (grown[board] == NULL) {
+            for (int i = 0; i < board; i++) {
+                free(grown[i]);
+            }
+            return false;
+        }
+    }
+    for (int board = 0; board < LEADERBOARD_COUNT; board++) {
+        Leaderboard *b = &leaderboards[board];
+        if (grown[board] == NULL) {
+            continue;
+        }
+        if (b->links != NULL) {
+            memcpy(grown[board], b->links, (size_t)leaderboard_capacity * sizeof(LeaderboardLink));
+        }
+        for (int i = leaderboard_capacity; i < capacity; i++) {
+            grown[board][i].score = LEADERBOARD_UNRANKED;
+        }
+        free(b->links);
+        b->links = grown[board];
+    }
+    leaderboard_capacity = capacity;
+    return true;
+}
+
+static void leaderboard_unlink(Leaderboard* b, int index) {
+    LeaderboardLink *link = &b->links[index];
+    if (link->score == LEADERBOARD_UNRANKED) {
+        return;
+    }
+    if (link->prev != -1) {
+        b->links[link->prev].next = link->next;
+    } else {
+        b->heads[link->score] = link->next;
+    }
+    if (link->next != -1) {
+        b->links[link->next].prev = link->prev;
+    }
+    leaderboard_count(b, link->score, -1);
+    b->ranked--;
+    link->score = LEADERBOARD_UNRANKED;
+}
+
+static void leaderboard_link(Leaderboard* b, int index, int score) {
+    LeaderboardLink *link = &b->links[index];
+    link->score = (uint16_t)score;
+    link->prev = -1;
+    link->next = b->heads[score];
+    if (link->next != -1) {
+        b->links[link->next].prev = index;
+    }
+    b->heads[score] = index;
+    leaderboard_count(b, score, 1);
+    b->ranked++;
+}
+
+// Function to free a board, so the next query builds it again from the store
+static void leaderboard_drop(int board) {
+    Leaderboard *b = &leaderboards[board];
+    free(b->heads);
+    free(b->tree);
+    free(b->links);
+    memset(b, 0, sizeof(*b));
+}
+
+// Function to build a board from every live student. Returns false if out of memory.
+static bool leaderboard_build(int board) {
+    if (!leaderboard_reserve(student_store.slots)) {
+        return false;
+    }
+    Leaderboard *b = &leaderboards[board];
+    b->scores = board == LEADERBOARD_TOTAL ? 100 * SUBJECT_MAX + 1 : 101;
+    b->heads = malloc((size_t)b->scores * sizeof(int32_t));
+    b->tree = calloc((size_t)b->scores + 1, sizeof(int32_t));
+    b->links = malloc((size_t)leaderboard_capacity * sizeof(LeaderboardLink));
+    if (b->heads == NULL || b->tree == NULL || b->links == NULL) {
+        leaderboard_drop(board);
+        return false;
+    }
+    for (int score = 0; score < b->scores; score++) {
+        b->heads[score] = -1;
+    }
+    for (int i = 0; i < leaderboard_capacity; i++) {
+        b->links[i].score = LEADERBOARD_UNRANKED;
+    }
+    b->ranked = 0;
+    for (int i = store_next_live(&student_store, 0); i < student_store.slots; i = store_next_live(&student_store, i + 1)) {
+        leaderboard_link(b, i, leaderboard_score_of(board, i));
+    }
+    return true;
+}
+
+// Function to move a student to `score` on one board
+static void leaderboard_place(int board, int index, int score) {
+    Leaderboard *b = &leaderboards[board];
+    if (b->heads == NULL) {
+        return; // Not built yet; it will read the score when it is
+    }
+    if (!leaderboard_reserve(index)) {
+        leaderboard_drop(board); // Out of memory: rather rebuilt later than left stale
+        return;
+    }
+    if (b->links[index].score != score) {
+        leaderboard_unlink(b, index);
+        leaderboard_link(b, index, score);
+    }
+}
+
+// Function to bring every board up to date with a live student's marks
+void leaderboard_rescore(int index) {
+    for (int board = 0; board < LEADERBOARD_COUNT; board++) {
+        if (leaderboard_in_use(board) && leaderboards[board].heads != NULL) {
+            leaderboard_place(board, index, leaderboard_score_of(board, index));
+        }
+    }
+}
+
+// Function to update the boards for one changed mark. The total moves by the
+// difference, so the student's other marks are not read again.
+static void leaderboard_mark_changed(int index, int subject, int old_mark, int mark) {
+    leaderboard_place(subject, index, mark);
+    const Leaderboard *total = &leaderboards[LEADERBOARD_TOTAL];
+    if (total->heads != NULL && index < leaderboard_capacity && total->links[index].score != LEADERBOARD_UNRANKED) {
+        leaderboard_place(LEADERBOARD_TOTAL, index, total->links[index].score + mark - old_mark);
+    } else {
+        leaderboard_place(LEADERBOARD_TOTAL, index, leaderboard_score_of(LEADERBOARD_TOTAL, index));
+    }
+}
+
+// Function to take a student off every board, before their slot is released
+void leaderboard_remove(int index) {
+    for (int board = 0; board < LEADERBOARD_COUNT; board++) {
+        if (leaderboards[board].heads != NULL && index < leaderboard_capacity) {
+            leaderboard_unlink(&leaderboards[board], index);
+        }
+    }
+}
+
+// Compaction: a student's record has moved from one slot to another
+void leaderboard_move(int from, int to) {
+    for (int board = 0; board < LEADERBOARD_COUNT; board++) {
+        Leaderboard *b = &leaderboards[board];
+        if (b->heads == NULL || from >= leaderboard_capacity || b->links[from].score == LEADERBOARD_UNRANKED) {
+            continue;
+        }
+        if (!leaderboard_reserve(to)) {
+            leaderboard_drop(board);
+            continue;
+        }
+        LeaderboardLink link = b->links[from];
+        b->links[to] = link;
+        b->links[from].score = LEADERBOARD_UNRANKED;
+        if (link.prev != -1) {
+            b->links[link.prev].next = to;
+        } else {
+            b->heads[link.score] = to;
+        }
+        if (link.next != -1) {
+            b->links[link.next].prev = to;
+        }
+    }
+}
+
+// Function to get a board ready to answer a query. Returns false if out of memory.
+static bool leaderboard_ready(int board) {
+    return leaderboards[board].heads != NULL || leaderboard_build(board);
+}
+
+// Function to take a student's scores out of the running totals before its cells are
+// written directly, as bulk loads do a whole row at a time
+void begin_score_rewrite(int index) {
+    running_totals_student(running_totals, index, -1);
+}
+
+// Function to count the rewritten scores back in and move the student on the boards
+void end_score_rewrite(int index) {
+    running_totals_student(running_totals, index, 1);
+    leaderboard_rescore(index);
+}
+
+// Function to build every board in use now rather than on its first query
+bool leaderboards_ready() {
+    bool ready = true;
+    for (int board = 0; board < LEADERBOARD_COUNT; board++) {
+        if (leaderboard_in_use(board)) {
+            ready = leaderboard_ready(board) && ready;
+        }
+    }
+    return ready;
+}
+
+// Function to list up to n students from the top of a board, best first, with their
+// ranks. Returns how many were listed.
+int leaderboard_top(int board, int n, int* indexes, int32_t* ranks) {
+    if (!leaderboard_ready(board)) {
+        return 0;
+    }
+    const Leaderboard *b = &leaderboards[board];
+    int listed = 0;
+    int highest = board == LEADERBOARD_TOTAL ? 100 * subject_count : 100;
+    for (int score = highest; score >= 0 && listed < n; score--) {
+        if (b->heads[score] == -1) {
+            continue;
+        }
+        int32_t rank = leaderboard_above(b, score) + 1;
+        for (int i = b->heads[score]; i != -1 && listed < n; i = b->links[i].next) {
+            indexes[listed] = i;
+            ranks[listed++] = rank;
+        }
+    }
+    return listed;
+}
+
+// Function to find a live student's rank on a board (1 for the top). Sets *out_of to
+// the number of students ranked. Returns 0 if the board cannot be built.
+int32_t leaderboard_rank(int board, int index, int32_t* out_of) {
+    if (!leaderboard_ready(board) || index >= leaderboard_capacity) {
+        return 0;
+    }
+    const Leaderboard *b = &leaderboards[board];
+    *out_of = b->ranked;
+    int score = b->links[index].score;
+    return score != LEADERBOARD_UNRANKED ? leaderboard_above(b, score) + 1 : 0;
+}
+
+// --- Name Search ---
+// Finding students by part of their name. Names are split into lowercase words (runs of
+// letters, digits and non-ASCII bytes), and each distinct word is kept once in a
+// dictionary with the list of students whose names contain it. Two indexes over the
+// dictionary find the words a search term matches:
+//
+//   - a trie (first-child/next-sibling nodes), for terms of one or two characters,
+//     which match words starting with them;
+//   - trigram postings (the words containing each three-character sequence), for longer
+//     terms, which match anywhere in a word: the words listed under the term's rarest
+//     trigram are checked with a substring compare.
+//
+// A query matches students whose names match every one of its terms, so "sha pri"
+// finds Priya Sharma. Rosters draw on a small vocabulary, so the dictionary stays small
+// while a common surname's student list runs to thousands. Adding a student appends to
+// the lists of the words in their name; removing one only clears their slot's serial
+// number, so searches skip the entries that carry the old one, and a list is swept
+// once half of it is stale.
+// The index is built the first time a search runs and kept current by insert_student()
+// and delete_student() after that; compaction drops it to be built again. It is
+// changed and read under student_write_lock.
+#define NAME_SEARCH_ALPHABET 38 // Trigram symbols: 1-26 letters, 27-36 digits, 37 anything else
+#define NAME_SEARCH_TRIGRAMS (NAME_SEARCH_ALPHABET * NAME_SEARCH_ALPHABET * NAME_SEARCH_ALPHABET)
+#define NAME_SEARCH_MAX_TERMS 8
+#define NAME_WORD_MAX 50        // Longer than any stored name
+#define NAME_SEARCH_LISTED 20   // Matches shown by the portal and batch find
+
+typedef struct {
+    int32_t *items;
+    int32_t count;
+    int32_t capacity;
+} IndexList;
+
+typedef struct {
+    int32_t index;
+    uint32_t serial;      // Stale unless it matches the slot's serial
+} NamePosting;
+
+typedef struct {
+    uint32_t text;        // Offset of the lowercase word in name_index.text
+    uint8_t length;
+    NamePosting *students; // The students whose names contain the word
+    int32_t count;
+    int32_t capacity;
+    int32_t stale;
+} NameWord;
+
+typedef struct {
+    uint32_t serial;      // Given to the student in this slot when indexed; 0 if none
+    uint32_t mark;        // Query generation and terms matched so far
+} NameSlot;
+
+typedef struct {
+    int32_t first_child;
+    int32_t next_sibling;
+    int32_t word;         // Dictionary word ending at this node, or -1
+    char c;
+} NameTrieNode;
+
+typedef struct {
+    bool built;
+    NameWord *words;
+    int32_t word_count;
+    int32_t word_capacity;
+    char *text;           // Every dictionary word, back to back
+    size_t text_used;
+    size_t text_capacity;
+    int32_t *word_table;  // Open addressing by word hash: word numbers, -1 if empty
+    uint32_t word_table_capacity;
+    NameTrieNode *trie;   // Node 0 is the root
+    int32_t trie_count;
+    int32_t trie_capacity;
+    IndexList *trigrams;  // Word numbers for each trigram
+    NameSlot *slots;      // Per store slot
+    int32_t slot_capacity;
+    uint32_t serials;     // Last serial given out
+    uint32_t generation;
+} NameIndex;
+
+NameIndex name_index;
+
+static bool index_list_add(IndexList* list, int32_t value) {
+    if (list->count == list->capacity) {
+        int32_t capacity = list->capacity ? list->capacity * 2 : 4;
+        int32_t *items = realloc(list->items, (size_t)capacity * sizeof(int32_t));
+        if (items == NULL) {
+            return false;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = value;
+    return true;
+}
+
+static bool name_slots_reserve(int32_t slots) {
+    if (slots <= name_index.slot_capacity) {
+        return true;
+    }
+    int32_t capacity = slots + slots / 2 + 1024;
+    NameSlot *grown = realloc(name_index.slots, (size_t)capacity * sizeof(NameSlot));
+    if (grown == NULL) {
+        return false;
+    }
+    memset(grown + name_index.slot_capacity, 0, (size_t)(capacity - name_index.slot_capacity) * sizeof(NameSlot));
+    name_index.slots = grown;
+    name_index.slot_capacity = capacity;
+    return true;
+}
+
+// Name words are runs of ASCII letters and digits and of non-ASCII bytes (UTF-8 letters)
+static inline bool name_word_char(unsigned char c) {
+    return c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline int name_symbol(unsigned char c) {
+    if (c >= 'a' && c <= 'z') return c - 'a' + 1;
+    if (c >= '0' && c <= '9') return c - '0' + 27;
+    return 37;
+}
+
+static inline int name_trigram(const char* p) {
+    return (name_symbol((unsigned char)p[0]) * NAME_SEARCH_ALPHABET + name_symbol((unsigned char)p[1]))
+           * NAME_SEARCH_ALPHABET + name_symbol((unsigned char)p[2]);
+}
+
+// Function to copy the next word of a name or query into `word`, lowercased, and move
+// *p past it. Returns the word's length, or 0 at the end.
+static int name_next_word(const char** p, char word[NAME_WORD_MAX + 1]) {
+    const unsigned char *s = (const unsigned char*)*p;
+    while (*s != '\0' && !name_word_char(*s)) s++;
+    int length = 0;
+    while (name_word_char(*s)) {
+        if (length < NAME_WORD_MAX) {
+            word[length++] = (char)(*s >= 'A' && *s <= 'Z' ? *s + ('a' - 'A') : *s);
+        }
+        s++;
+    }
+    word[length] = '\0';
+    *p = (const char*)s;
+    return length;
+}
+
+static inline const char *name_word_text(int32_t word) {
+    return name_index.text + name_index.words[word].text;
+}
+
+static uint32_t name_word_hash(const char* word, int length) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)word[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Function to find a dictionary word, or -1
+static int32_t name_word_find(const char* word, int length) {
+    if (name_index.word_table_capacity == 0) {
+        return -1;
+    }
+    uint32_t mask = name_index.word_table_capacity - 1;
+    for (uint32_t i = name_word_hash(word, length) & mask; name_index.word_table[i] != -1; i = (i + 1) & mask) {
+        int32_t candidate = name_index.word_table[i];
+        if (name_index.words[candidate].length == length && memcmp(name_word_text(candidate), word, length) == 0) {
+            return candidate;
+        }
+    }
+    return -1;
+}
+
+static bool name_word_table_grow() {
+    uint32_t capacity = name_index.word_table_capacity ? name_index.word_table_capacity * 2 : 1024;
+    int32_t *table = malloc(capacity * sizeof(int32_t));
+    if (table == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < capacity; i++) {
+        table[i] = -1;
+    }
+    for (int32_t word = 0; word < name_index.word_count; word++) {
+        uint32_t i = name_word_hash(name_word_text(word), name_index.words[word].length) & (capacity - 1);
+        while (table[i] != -1) i = (i + 1) & (capacity - 1);
+        table[i] = word;
+    }
+    free(name_index.word_table);
+    name_index.word_table = table;
+    name_index.word_table_capacity = capacity;
+    return true;
+}
+
+// Function to add a node to the trie as the first child of `parent`
+static int32_t name_trie_add(int32_t parent, char c) {
+    if (name_index.trie_count == name_index.trie_capacity) {
+        int32_t capacity = name_index.trie_capacity * 2;
+        NameTrieNode *trie = realloc(name_index.trie, (size_t)capacity * sizeof(NameTrieNode));
+        if (trie == NULL) {
+            return -1;
+        }
+        name_index.trie = trie;
+        name_index.trie_capacity = capacity;
+    }
+    int32_t node = name_index.trie_count++;
+    name_index.trie[node] = (NameTrieNode){ -1, name_index.trie[parent].first_child, -1, c };
+    name_index.trie[parent].first_child = node;
+    return node;
+}
+
+static int32_t name_trie_child(int32_t node, char c) {
+    for (int32_t child = name_index.trie[node].first_child; child != -1; child = name_index.trie[child].next_sibling) {
+        if (name_index.trie[child].c == c) {
+            return child;
+        }
+    }
+    return -1;
+}
+
+// Function to add a new word to the dictionary, the trie and the trigram postings.
+// Returns its number, or -1 if out of memory.
+static int32_t name_word_add(const char* text, int length) {
+    if ((uint64_t)(name_index.word_count + 1) * 10 > (uint64_t)name_index.word_table_capacity * 7
+        && !name_word_table_grow()) {
+        return -1;
+    }
+    if (name_index.word_count == name_index.word_capacity) {
+        int32_t capacity = name_index.word_capacity ? name_index.word_capacity * 2 : 1024;
+        NameWord *words = realloc(name_index.words, (size_t)capacity * sizeof(NameWord));
+        if (words == NULL) {
+            return -1;
+        }
+        name_index.words = words;
+        name_index.word_capacity = capacity;
+    }
+    if (name_index.text_used + (size_t)length + 1 > name_index.text_capacity) {
+        size_t capacity = name_index.text_capacity ? name_index.text_capacity * 2 : 1 << 16;
+        char *text = realloc(name_index.text, capacity);
+        if (text == NULL) {
+            return -1;
+        }
+        name_index.text = text;
+        name_index.text_capacity = capacity;
+    }
+    int32_t word = name_index.word_count++;
+    NameWord *w = &name_index.words[word];
+    *w = (NameWord){ (uint32_t)name_index.text_used, (uint8_t)length, NULL, 0, 0, 0 };
+    memcpy(name_index.text + name_index.text_used, text, length);
+    name_index.text[name_index.text_used + length] = '\0';
+    name_index.text_used += (size_t)length + 1;
+
+    uint32_t mask = name_index.word_table_capacity - 1;
+    uint32_t i = name_word_hash(text, length) & mask;
+    while (name_index.word_table[i] != -1) i = (i + 1) & mask;
+    name_index.word_table[i] = word;
+
+    int32_t node = 0;
+    for (int k = 0; k < length && node != -1; k++) {
+        int32_t child = name_trie_child(node, text[k]);
+        node = child != -1 ? child : name_trie_add(node, text[k]);
+    }
+    if (node != -1) {
+        name_index.trie[node].word = word;
+    }
+    for (int k = 0; k + 3 <= length; k++) {
+        IndexList *list = &name_index.trigrams[name_trigram(text + k)];
+        if (list->count == 0 || list->items[list->count - 1] != word) { // "ana" twice in "ananya"
+            index_list_add(list, word);
+        }
+    }
+    return word;
+}
+
+// Function to add a live student's name words to the index
+void name_index_add(int index) {
+    if (!name_index.built || !name_slots_reserve(index + 1)) {
+        return;
+    }
+    if (++name_index.serials == 0) {
+        name_index.serials = 1; // 0 marks an empty slot
+    }
+    uint32_t serial = name_index.serials;
+    name_index.slots[index].serial = serial;
+    const char *p = student_name(index);
+    char word[NAME_WORD_MAX + 1];
+    int length;
+    while ((length = name_next_word(&p, word)) > 0) {
+        int32_t found = name_word_find(word, length);
+        if (found == -1) {
+            found = name_word_add(word, length);
+        }
+        if (found == -1) {
+            continue;
+        }
+        NameWord *w = &name_index.words[found];
+        if (w->count > 0 && w->students[w->count - 1].serial == serial) {
+            continue; // The word appeared earlier in the same name
+        }
+        if (w->count == w->capacity) {
+            int32_t capacity = w->capacity ? w->capacity * 2 : 4;
+            NamePosting *students = realloc(w->students, (size_t)capacity * sizeof(NamePosting));
+            if (students == NULL) {
+                continue;
+            }
+            w->students = students;
+            w->capacity = capacity;
+        }
+        w->students[w->count++] = (NamePosting){ index, serial };
+    }
+}
+
+// Function to take a student out of the index, before their slot is released
+void name_index_remove(int index) {
+    if (!name_index.built || index >= name_index.slot_capacity) {
+        return;
+    }
+    const NameSlot *slots = name_index.slots;
+    name_index.slots[index].serial = 0;
+    const char *p = student_name(index);
+    char word[NAME_WORD_MAX + 1];
+    int length;
+    while ((length = name_next_word(&p, word)) > 0) {
+        int32_t found = name_word_find(word, length);
+        if (found == -1) {
+            continue;
+        }
+        NameWord *w = &name_index.words[found];
+        if (++w->stale * 2 <= w->count) {
+            continue;
+        }
+        int32_t kept = 0;
+        for (int32_t i = 0; i < w->count; i++) {
+            if (slots[w->students[i].index].serial == w->students[i].serial) {
+                w->students[kept++] = w->students[i];
+            }
+        }
+        w->count = kept;
+        w->stale = 0;
+    }
+}
+
+// Function to free the index; the next search builds it again
+void name_index_discard() {
+    for (int32_t word = 0; word < name_index.word_count; word++) {
+        free(name_index.words[word].students);
+    }
+    if (name_index.trigrams != NULL) {
+        for (int trigram = 0; trigram < NAME_SEARCH_TRIGRAMS; trigram++) {
+            free(name_index.trigrams[trigram].items);
+        }
+    }
+    free(name_index.words);
+    free(name_index.text);
+    free(name_index.word_table);
+    free(name_index.trie);
+    free(name_index.trigrams);
+    free(name_index.slots);
+    memset(&name_index, 0, sizeof(name_index));
+}
+
+// Function to build the index from every live student. Returns false if out of memory.
+static bool name_index_build() {
+    name_index.trigrams = calloc(NAME_SEARCH_TRIGRAMS, sizeof(IndexList));
+    name_index.trie = malloc(1024 * sizeof(NameTrieNode));
+    if (name_index.trigrams == NULL || name_index.trie == NULL) {
+        free(name_index.trigrams);
+        free(name_index.trie);
+        name_index.trigrams = NULL;
+        name_index.trie = NULL;
+        return false;
+    }
+    name_index.trie[0] = (NameTrieNode){ -1, -1, -1, 0 };
+    name_index.trie_count = 1;
+    name_index.trie_capacity = 1024;
+    name_index.built = true;
+    name_slots_reserve(student_store.slots);
+    for (int i = store_next_live(&student_store, 0); i < student_store.slots; i = store_next_live(&student_store, i + 1)) {
+        name_index_add(i);
+    }
+    return true;
+}
+
+// Function to build the index now rather than on the first search
+bool name_index_ready() {
+    return name_index.built || name_index_build();
+}
+
+// Function to call visit() for every dictionary word that a search term matches
+static void name_term_words(const char* term, int length, void (*visit)(int32_t word, void* context), void* context) {
+    if (length < 3) {
+        int32_t node = 0;
+        for (int k = 0; k < length && node != -1; k++) {
+            node = name_trie_child(node, term[k]);
+        }
+        if (node == -1) {
+            return;
+        }
+        // Every word below the node starts with the term; walk the subtree in place
+        int32_t stack[NAME_WORD_MAX + 2]; // One pending sibling per level
+        int depth = 0;
+        stack[depth++] = node;
+        while (depth > 0) {
+            int32_t n = stack[--depth];
+            if (name_index.trie[n].word != -1) {
+                visit(name_index.trie[n].word, context);
+            }
+            if (name_index.trie[n].next_sibling != -1 && n != node) {
+                stack[depth++] = name_index.trie[n].next_sibling;
+            }
+            if (name_index.trie[n].first_child != -1) {
+                stack[depth++] = name_index.trie[n].first_child;
+            }
+        }
+        return;
+    }
+    const IndexList *rarest = NULL;
+    for (int k = 0; k + 3 <= length; k++) {
+        const IndexList *list = &name_index.trigrams[name_trigram(term + k)];
+        if (rarest == NULL || list->count < rarest->count) {
+            rarest = list;
+        }
+    }
+    for (int32_t i = 0; i < rarest->count; i++) {
+        int32_t word = rarest->items[i];
+        if (name_index.words[word].length >= length && strstr(name_word_text(word), term) != NULL) {
+            visit(word, context);
+        }
+    }
+}
+
+typedef struct {
+    uint32_t from;        // Mark a student must hold to go on matching
+    uint32_t to;          // Mark once this term matches too
+    bool first;           // Any student may start matching
+    bool last;            // Matching this term completes a match
+    int *results;         // Matches so far in name order, at most max
+    int listed;
+    int max;
+    int total;
+} NameSearch;
+
+// Function to advance every student holding one word by one term of the search
+static void name_search_word(int32_t word, void* context) {
+    NameSearch *search = context;
+    const NameWord *w = &name_index.words[word];
+    NameSlot *slots = name_index.slots;
+    for (int32_t i = 0; i < w->count; i++) {
+        int index = w->students[i].index;
+        NameSlot *slot = &slots[index];
+        // Marks left by earlier searches are all below this one's; a student reached
+        // through a second matching word already holds `to`
+        if (slot->serial != w->students[i].serial
+            || (search->first ? slot->mark >= search->to : slot->mark != search->from)) {
+            continue;
+        }
+        slot->mark = search->to;
+        if (!search->last) {
+            continue;
+        }
+        search->total++;
+        // Keep the first max matches in the name listing's order (names ignoring case,
+        // then SAP ID), shifting later ones down
+        const char *name = student_name(index);
+        uint32_t sap_id = student_at(index)->sap_id;
+        int at = search->listed;
+        while (at > 0) {
+            int other = search->results[at - 1];
+            int by_name = strcasecmp(name, student_name(other));
+            if (by_name > 0 || (by_name == 0 && sap_id > student_at(other)->sap_id)) {
+                break;
+            }
+            at--;
+        }
+        if (at < search->max) {
+            int end = search->listed < search->max ? search->listed : search->max - 1;
+            memmove(&search->results[at + 1], &search->results[at], (size_t)(end - at) * sizeof(int));
+            search->results[at] = index;
+            if (search->listed < search->max) {
+                search->listed++;
+            }
+        }
+    }
+}
+
+// Function to find the students whose names match every word of `query`: a word of
+// one or two characters matches the start of a name word, a longer one any part of it,
+// ignoring case. Fills `results` with up to max of them in name order and sets *total
+// to the number found (none if the query has no words). Returns how many were listed,
+// or -1 if the index cannot be built.
+int search_students_by_name(const char* query, int* results, int max, int* total) {
+    char terms[NAME_SEARCH_MAX_TERMS][NAME_WORD_MAX + 1];
+    int lengths[NAME_SEARCH_MAX_TERMS];
+    int term_count = 0;
+    *total = 0;
+    while (term_count < NAME_SEARCH_MAX_TERMS && (lengths[term_count] = name_next_word(&query, terms[term_count])) > 0) {
+        // Longest first: longer terms match fewer students, so later terms visit fewer marks
+        int at = term_count++;
+        while (at > 0 && lengths[at - 1] < lengths[at]) {
+            char swap[NAME_WORD_MAX + 1];
+            memcpy(swap, terms[at], sizeof(swap));
+            memcpy(terms[at], terms[at - 1], sizeof(swap));
+            memcpy(terms[at - 1], swap, sizeof(swap));
+            int length = lengths[at];
+            lengths[at] = lengths[at - 1];
+            lengths[at - 1] = length;
+            at--;
+        }
+    }
+    if (term_count == 0) {
+        return 0;
+    }
+    if (!name_index_ready()) {
+        return -1;
+    }
+    // Each search takes a fresh band of marks, so none need clearing between searches
+    if (name_index.generation >= UINT32_MAX / (NAME_SEARCH_MAX_TERMS + 1) - 1) {
+        for (int32_t i = 0; i < name_index.slot_capacity; i++) {
+            name_index.slots[i].mark = 0;
+        }
+        name_index.generation = 0;
+    }
+    uint32_t base = ++name_index.generation * (NAME_SEARCH_MAX_TERMS + 1);
+    NameSearch search = { 0, 0, false, false, results, 0, max, 0 };
+    for (int t = 0; t < term_count; t++) {
+        search.from = base + (uint32_t)t;
+        search.to = search.from + 1;
+        search.first = t == 0;
+        search.last = t == term_count - 1;
+        name_term_words(terms[t], lengths[t], name_search_word, &search);
+    }
+    *total = search.total;
+    return search.listed;
+}
+
+// --- Ordered Listing ---
+// The roster in SAP ID or name order, a page at a time. Each order is a treap over the
+// store slots (a binary search tree whose nodes are also heap-ordered by a priority,
+// which keeps it balanced with high probability). A slot's node holds its links in
+// both trees with copies of the keys they compare: the SAP ID, a priority hashed from
+// it, and the first eight bytes of the name in lower case. Names sort ignoring case,
+// then by SAP ID, and only names that share their first eight bytes are read from the
+// string pool on the way down.
+//
+// A page starts from a cursor: the SAP ID and name of the row it follows (or
+// precedes, going back). The cursor is a key, not a position, so adds and removes
+// between pages never make a listing skip or repeat a student. Finding the first row
+// walks down the tree once, and each further row comes from the path kept on a stack,
+// so a page costs O(log n + page size). The trees are built, from one sort of the
+// roster per order, the first time a page is asked for; insert_student(),
+// delete_student() and compaction keep them current after that. They are changed and
+// read under student_write_lock.
+#define ORDER_SAP_ID 0
+#define ORDER_NAME 1
+#define ORDER_COUNT 2
+#define ORDER_PAGE_DEFAULT 20
+#define ORDER_PAGE_MAX 200
+
+typedef struct {
+    int32_t left[ORDER_COUNT];
+    int32_t right[ORDER_COUNT];
+    uint32_t sap_id;
+    uint32_t priority;
+    uint64_t name_prefix;  // Big-endian, so it compares like the bytes
+} OrderNode;
+
+typedef struct {
+    OrderNode *nodes;      // Per store slot
+    int32_t capacity;
+    int32_t roots[ORDER_COUNT];
+    bool built;
+    int32_t *stack;        // Tree path for a walk; shared, as the lock is
+    int32_t stack_capacity;
+} StudentOrders;
+
+// A position in a listing: the key of the row a page starts after (or before)
+typedef struct {
+    uint32_t sap_id;
+    uint64_t name_prefix;
+    char name[sizeof(((StudentForm*)0)->name)];
+} StudentCursor;
+
+StudentOrders student_orders;
+
+static uint64_t order_name_prefix(const char* name) {
+    uint64_t prefix = 0;
+    for (int i = 0; i < 8; i++) {
+        unsigned char c = (unsigned char)*name;
+        if (c != '\0') {
+            name++;
+        }
+        prefix = prefix << 8 | (c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+    }
+    return prefix;
+}
+
+static inline uint32_t order_priority(uint32_t sap_id) {
+    uint32_t x = sap_id * 0x9E3779B1u;
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    return x;
+}
+
+// Function to compare two keys in an order (<0 if the first sorts first). A name is
+// only read if the prefixes tie, and `name` may be NULL if `index` holds the key.
+static int order_compare(int order, uint32_t sap_id, uint64_t name_prefix, const char* name, int index, int other) {
+    const OrderNode *node = &student_orders.nodes[other];
+    if (order == ORDER_NAME) {
+        if (name_prefix != node->name_prefix) {
+            return name_prefix < node->name_prefix ? -1 : 1;
+        }
+        int by_name = strcasecmp(name != NULL ? name : student_name(index), student_name(other));
+        if (by_name != 0) {
+            return by_name;
+        }
+    }
+    return sap_id < node->sap_id ? -1 : sap_id > node->sap_id;
+}
+
+static inline int order_compare_nodes(int order, int a, int b) {
+    const OrderNode *node = &student_orders.nodes[a];
+    return order_compare(order, node->sap_id, node->name_prefix, NULL, a, b);
+}
+
+static inline int order_compare_cursor(int order, const StudentCursor* cursor, int index) {
+    return order_compare(order, cursor->sap_id, cursor->name_prefix, cursor->name, -1, index);
+}
+
+static bool order_reserve(int index) {
+    if (index < student_orders.capacity) {
+        return true;
+    }
+    int32_t capacity = index + index / 2 + 1024;
+    OrderNode *nodes = realloc(student_orders.nodes, (size_t)capacity * sizeof(OrderNode));
+    if (nodes == NULL) {
+        return false;
+    }
+    student_orders.nodes = nodes;
+    student_orders.capacity = capacity;
+    return true;
+}
+
+static bool order_stack_reserve(int32_t depth) {
+    if (depth < student_orders.stack_capacity) {
+        return true;
+    }
+    int32_t capacity = depth + depth / 2 + 64;
+    int32_t *stack = realloc(student_orders.stack, (size_t)capacity * sizeof(int32_t));
+    if (stack == NULL) {
+        return false;
+    }
+    student_orders.stack = stack;
+    student_orders.stack_capacity = capacity;
+    return true;
+}
+
+// Function to copy a live student's keys into their node
+static void order_node_fill(int index) {
+    OrderNode *node = &student_orders.nodes[index];
+    node->sap_id = student_at(index)->sap_id;
+    node->priority = order_priority(node->sap_id);
+    node->name_prefix = order_name_prefix(student_name(index));
+}
+
+// Function to insert a node into the subtree at `root`. Returns the subtree's new root.
+static int32_t order_insert(int order, int32_t root, int32_t index) {
+    if (root == -1) {
+        return index;
+    }
+    OrderNode *nodes = student_orders.nodes;
+    if (order_compare_nodes(order, index, root) < 0) {
+        int32_t child = order_insert(order, nodes[root].left[order], index);
+        nodes[root].left[order] = child;
+        if (nodes[child].priority > nodes[root].priority) { // Rotate right
+            nodes[root].left[order] = nodes[child].right[order];
+            nodes[child].right[order] = root;
+            return child;
+        }
+    } else {
+        int32_t child = order_insert(order, nodes[root].right[order], index);
+        nodes[root].right[order] = child;
+        if (nodes[child].priority > nodes[root].priority) { // Rotate left
+            nodes[root].right[order] = nodes[child].left[order];
+            nodes[child].left[order] = root;
+            return child;
+        }
+    }
+    return root;
+}
+
+// Function to join two subtrees, every node of `a` sorting before every node of `b`
+static int32_t order_merge(int order, int32_t a, int32_t b) {
+    if (a == -1 || b == -1) {
+        return a == -1 ? b : a;
+    }
+    OrderNode *nodes = student_orders.nodes;
+    if (nodes[a].priority > nodes[b].priority) {
+        nodes[a].right[order] = order_merge(order, nodes[a].right[order], b);
+        return a;
+    }
+    nodes[b].left[order] = order_merge(order, a, nodes[b].left[order]);
+    return b;
+}
+
+static int32_t order_erase(int order, int32_t root, int32_t index) {
+    if (root == -1) {
+        return -1;
+    }
+    OrderNode *nodes = student_orders.nodes;
+    if (root == index) {
+        return order_merge(order, nodes[index].left[order], nodes[index].right[order]);
+    }
+    if (order_compare_nodes(order, index, root) < 0) {
+        nodes[root].left[order] = order_erase(order, nodes[root].left[order], index);
+    } else {
+        nodes[root].right[order] = order_erase(order, nodes[root].right[order], index);
+    }
+    return root;
+}
+
+static int order_sort_key; // Order being sorted by student_orders_build()
+
+static int order_sort_compare(const void* a, const void* b) {
+    return order_compare_nodes(order_sort_key, *(const int*)a, *(const int*)b);
+}
+
+// Function to build both trees from every live student: each is sorted once and then
+// assembled in one left-to-right pass, keeping the right spine of the tree so far on
+// the stack (each node pops the lower-priority nodes off it and takes them as its left
+// subtree). Returns false if out of memory.
+static bool student_orders_build() {
+    int32_t count = student_store.count;
+    int *sorted = malloc(((size_t)count + 1) * sizeof(int));
+    if (sorted == NULL || !order_reserve(student_store.slots) || !order_stack_reserve(count + 1)) {
+        free(sorted);
+        return false;
+    }
+    int32_t n = 0;
+    for (int i = store_next_live(&student_store, 0); i < student_store.slots; i = store_next_live(&student_store, i + 1)) {
+        order_node_fill(i);
+        sorted[n++] = i;
+    }
+    OrderNode *nodes = student_orders.nodes;
+    for (int order = 0; order < ORDER_COUNT; order++) {
+        order_sort_key = order;
+        qsort(sorted, (size_t)n, sizeof(int), order_sort_compare);
+        int32_t *spine = student_orders.stack;
+        int32_t depth = 0;
+        for (int32_t i = 0; i < n; i++) {
+            int32_t index = sorted[i];
+            int32_t last = -1;
+            while (depth > 0 && nodes[spine[depth - 1]].priority < nodes[index].priority) {
+                last = spine[--depth];
+            }
+            nodes[index].left[order] = last;
+            nodes[index].right[order] = -1;
+            if (depth > 0) {
+                nodes[spine[depth - 1]].right[order] = index;
+            }
+            spine[depth++] = index;
+        }
+        student_orders.roots[order] = depth > 0 ? spine[0] : -1;
+    }
+    student_orders.built = true;
+    free(sorted);
+    return true;
+}
+
+// Function to build the orders now rather than for the first page
+bool student_orders_ready() {
+    return student_orders.built || student_orders_build();
+}
+
+// Function to add a live student to both orders
+void student_order_add(int index) {
+    if (!student_orders.built || !order_reserve(index)) {
+        return;
+    }
+    order_node_fill(index);
+    for (int order = 0; order < ORDER_COUNT; order++) {
+        student_orders.nodes[index].left[order] = -1;
+        student_orders.nodes[index].right[order] = -1;
+        student_orders.roots[order] = order_insert(order, student_orders.roots[order], index);
+    }
+}
+
+// Function to take a student out of both orders, before their slot is released
+void student_order_remove(int index) {
+    if (!student_orders.built) {
+        return;
+    }
+    for (int order = 0; order < ORDER_COUNT; order++) {
+        student_orders.roots[order] = order_erase(order, student_orders.roots[order], index);
+    }
+}
+
+// Compaction: a student's node moves with their record, and its parent (found by
+// walking down to it with its key) is pointed at the new slot
+void student_order_move(int from, int to) {
+    if (!student_orders.built || !order_reserve(to)) {
+        return;
+    }
+    OrderNode *nodes = student_orders.nodes;
+    nodes[to] = nodes[from];
+    for (int order = 0; order < ORDER_COUNT; order++) {
+        int32_t *link = &student_orders.roots[order];
+        while (*link != from && *link != -1) {
+            link = order_compare_nodes(order, to, *link) < 0 ? &nodes[*link].left[order] : &nodes[*link].right[order];
+        }
+        *link = to;
+    }
+}
+
+// Function to set a cursor to a key, for a page that starts after (or at) it
+void student_cursor_set(StudentCursor* cursor, uint32_t sap_id, const char* name) {
+    cursor->sap_id = sap_id;
+    snprintf(cursor->name, sizeof(cursor->name), "%s", name);
+    cursor->name_prefix = order_name_prefix(cursor->name);
+}
+
+void student_cursor_at(StudentCursor* cursor, int index) {
+    student_cursor_set(cursor, student_at(index)->sap_id, student_name(index));
+}
+
+// Going backward is the same walk as going forward with left and right swapped
+static inline int32_t order_child(int order, int32_t index, bool right) {
+    const OrderNode *node = &student_orders.nodes[index];
+    return right ? node->right[order] : node->left[order];
+}
+
+// Function to list up to max students in an order, starting after `cursor` (from the
+// beginning if it is NULL), or before it going backward, nearest first. With
+// `inclusive`, a student whose key equals the cursor's is listed too. Returns how many
+// were listed, or -1 if the orders cannot be built.
+int student_page(int order, const StudentCursor* cursor, bool inclusive, bool backward, int* indexes, int max) {
+    if (!student_orders_ready()) {
+        return -1;
+    }
+    int32_t depth = 0;
+    int32_t index = student_orders.roots[order];
+    while (index != -1) {
+        int c = cursor == NULL ? (backward ? 1 : -1) : order_compare_cursor(order, cursor, index);
+        if (backward ? c > 0 : c < 0) {
+            if (!order_stack_reserve(depth)) {
+                return -1;
+            }
+            student_orders.stack[depth++] = index; // Listed, after everything on its near side
+            index = order_child(order, index, backward);
+        } else if (c == 0 && inclusive) {
+            if (!order_stack_reserve(depth)) {
+                return -1;
+            }
+            student_orders.stack[depth++] = index; // Its near side all comes before the cursor
+            break;
+        } else {
+            index = order_child(order, index, !backward);
+        }
+    }
+    int listed = 0;
+    while (depth > 0 && listed < max) {
+        index = student_orders.stack[--depth];
+        indexes[listed++] = index;
+        for (index = order_child(order, index, !backward); index != -1; index = order_child(order, index, backward)) {
+            if (!order_stack_reserve(depth)) {
+                return listed;
+            }
+            student_orders.stack[depth++] = index;
+        }
+    }
+    return listed;
+}
+
+// --- Attendance Sessions ---
+// Attendance taken a class session at a time rather than typed in as a percentage.
+// Every session of a subject is a bitmap with one bit per student slot (a bit column of
+// the student store, see SESSION_COLUMN()), so marking a whole lecture present or
+// absent is one 128-byte fill per chunk, and a full term costs SESSION_MAX / 8 = 16
+// bytes per student per subject.
+//
+// A student's attendance cell is then derived from the log: sessions attended out of
+// sessions held, rounded. Counting a whole class transposes 64 students x 64 sessions
+// at a time, so each student's sessions land in one word, and 64 popcounts count the
+// block. Bits of sessions not yet held and of dead slots are never read, so a reused
+// slot needs no clearing: insert_student() writes the new student's bits for every
+// session held so far, counted present, so a student who joins mid-term starts at
+// 100%. A percentage entered by hand stands until that subject's log next changes for
+// the student. The log is changed and read under student_write_lock; the number of
+// sessions held is saved in the students.db header at each checkpoint.
+#define SESSION_WORDS (STORE_CHUNK_RECORDS / 64) // Words per session per chunk
+
+uint16_t attendance_sessions[SUBJECT_MAX]; // Sessions held so far, per subject
+
+// Counting kernels: add the number of set bits in each word to its counter. There is
+// a portable version and, on x86, one using the POPCNT instruction; the one to use is
+// picked once at startup with the column kernels (see select_column_kernel()).
+typedef void (*PopcountKernel)(const uint64_t* words, int n, uint32_t* counts);
+
+static void popcount_scalar(const uint64_t* words, int n, uint32_t* counts) {
+    for (int i = 0; i < n; i++) {
+        uint64_t x = words[i];
+        x -= (x >> 1) & 0x5555555555555555ull;
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        counts[i] += (uint32_t)((x * 0x0101010101010101ull) >> 56);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("popcnt")))
+static void popcount_popcnt(const uint64_t* words, int n, uint32_t* counts) {
+    for (int i = 0; i < n; i++) {
+        counts[i] += (uint32_t)__builtin_popcountll(words[i]);
+    }
+}
+#endif
+
+static PopcountKernel popcount_kernel = popcount_scalar;
+static const char* popcount_kernel_name = "scalar";
+
+// Function to get a chunk's bitmap of one session
+static inline uint64_t *session_words(int chunk, int subject, int session) {
+    return store_bit_column(&student_store, chunk, SESSION_COLUMN(subject, session));
+}
+
+static inline bool session_attended(int index, int subject, int session) {
+    const uint64_t *words = session_words(index >> STORE_CHUNK_SHIFT, subject, session);
+    return words[(index & (STORE_CHUNK_RECORDS - 1)) >> 6] >> (index & 63) & 1;
+}
+
+static inline void session_mark(int index, int subject, int session, bool present) {
+    uint64_t *word = &session_words(index >> STORE_CHUNK_SHIFT, subject, session)[(index & (STORE_CHUNK_RECORDS - 1)) >> 6];
+    uint64_t bit = 1ull << (index & 63);
+    *word = present ? *word | bit : *word & ~bit;
+}
+
+static inline int attendance_percent(int attended, int held) {
+    return (attended * 100 + held / 2) / held;
+}
+
+// Function to pack 64 liveness bytes (each 0 or 1) into a word, slot i at bit i
+static inline uint64_t live_bits(const uint8_t* live) {
+    uint64_t bits = 0;
+    for (int k = 0; k < 8; k++) {
+        uint64_t bytes;
+        memcpy(&bytes, live + 8 * k, sizeof(bytes));
+        bits |= ((bytes * 0x0102040810204080ull) >> 56) << (8 * k); // Byte j's low bit to bit j
+    }
+    return bits;
+}
+
+// One step of transpose64(): swap the off-diagonal j x j blocks of every 2j x 2j block
+static inline void transpose64_step(uint64_t a[64], int j, uint64_t m) {
+    for (int k = 0; k < 64; k += 2 * j) {
+        for (int i = k; i < k + j; i++) {
+            uint64_t t = (a[i] ^ (a[i + j] >> j)) & m;
+            a[i] ^= t;
+            a[i + j] ^= t << j;
+        }
+    }
+}
+
+// Function to transpose a 64 x 64 bit matrix in place (Hacker's Delight 7-3): bit b of
+// word k moves to bit 63 - k of word 63 - b. The steps are spelled out so that each
+// one's loops have constant bounds and vectorise.
+static void transpose64(uint64_t a[64]) {
+    transpose64_step(a, 32, 0x00000000FFFFFFFFull);
+    transpose64_step(a, 16, 0x0000FFFF0000FFFFull);
+    transpose64_step(a, 8, 0x00FF00FF00FF00FFull);
+    transpose64_step(a, 4, 0x0F0F0F0F0F0F0F0Full);
+    transpose64_step(a, 2, 0x3333333333333333ull);
+    transpose64_step(a, 1, 0x5555555555555555ull);
+}
+
+// Function to count the sessions of a subject one student attended: their bit from
+// each session is gathered into words, which are then counted
+int attendance_count(int index, int subject) {
+    int held = attendance_sessions[subject];
+    const uint64_t *words = session_words(index >> STORE_CHUNK_SHIFT, subject, 0) + ((index & (STORE_CHUNK_RECORDS - 1)) >> 6);
+    int bit = index & 63;
+    uint64_t row[SESSION_MAX / 64] = { 0 };
+    for (int session = 0; session < held; session++) {
+        row[session >> 6] |= (words[(size_t)session * SESSION_WORDS] >> bit & 1) << (session & 63);
+    }
+    uint32_t counts[SESSION_MAX / 64] = { 0 };
+    popcount_kernel(row, SESSION_MAX / 64, counts);
+    uint32_t attended = 0;
+    for (int i = 0; i < SESSION_MAX / 64; i++) {
+        attended += counts[i];
+    }
+    return (int)attended;
+}
+
+// Function to count the sessions of a subject attended by every slot of a chunk, into
+// counts[slot within the chunk]. Only the first n slots are counted.
+void attendance_count_chunk(int chunk, int subject, int n, uint32_t counts[STORE_CHUNK_RECORDS]) {
+    int held = attendance_sessions[subject];
+    const uint64_t *words = session_words(chunk, subject, 0);
+    memset(counts, 0, STORE_CHUNK_RECORDS * sizeof(uint32_t));
+    for (int group = 0; group * 64 < n; group++) {
+        uint32_t reversed[64] = { 0 }; // Slot 63 - i of the group, as transpose64() leaves them
+        for (int first = 0; first < held; first += 64) {
+            uint64_t block[64];
+            for (int k = 0; k < 64; k++) {
+                block[k] = first + k < held ? words[(size_t)(first + k) * SESSION_WORDS + group] : 0;
+            }
+            transpose64(block);
+            popcount_kernel(block, 64, reversed);
+        }
+        for (int i = 0; i < 64; i++) {
+            counts[group * 64 + i] = reversed[63 - i];
+        }
+    }
+}
+
+// Function to count the students present at a session
+int attendance_session_present(int subject, int session) {
+    int present = 0;
+    for (int chunk = 0; chunk < student_store.chunk_count; chunk++) {
+        if (student_store.chunk_live[chunk] == 0) {
+            continue;
+        }
+        const uint64_t *words = session_words(chunk, subject, session);
+        const uint8_t *live = store_live_flag(&student_store, chunk << STORE_CHUNK_SHIFT);
+        uint64_t kept[SESSION_WORDS];
+        uint32_t counts[SESSION_WORDS] = { 0 };
+        for (int w = 0; w < SESSION_WORDS; w++) {
+            kept[w] = words[w] & live_bits(live + 64 * w);
+        }
+        popcount_kernel(kept, SESSION_WORDS, counts);
+        for (int w = 0; w < SESSION_WORDS; w++) {
+            present += (int)counts[w];
+        }
+    }
+    return present;
+}
+
+// Function to mark every student present or absent at a session, a whole chunk's
+// bitmap at a time. Chunks without students are skipped: their slots are written when
+// a student enrols in them.
+void attendance_fill(int subject, int session, bool present) {
+    for (int chunk = 0; chunk < student_store.chunk_count; chunk++) {
+        if (student_store.chunk_live[chunk] > 0) {
+            memset(session_words(chunk, subject, session), present ? 0xFF : 0, STORE_CHUNK_RECORDS / 8);
+        }
+    }
+}
+
+// Function to enter a new student in the log of every session of a subject held so
+// far, counted present. Returns their attendance in it (0 before any session).
+uint8_t attendance_enrol(int index, int subject) {
+    int held = attendance_sessions[subject];
+    for (int session = 0; session < held; session++) {
+        session_mark(index, subject, session, true);
+    }
+    return held > 0 ? 100 : 0;
+}
+
+// Compaction: carry a relocated student's log over to their new slot
+void attendance_move(int from, int to) {
+    for (int subject = 0; subject < subject_count; subject++) {
+        for (int session = 0; session < attendance_sessions[subject]; session++) {
+            session_mark(to, subject, session, session_attended(from, subject, session));
+        }
+    }
+}
+
+// What the attendance log costs in memory
+typedef struct {
+    int sessions;            // Held so far, across all subjects
+    uint64_t log_bytes;      // Bitmaps of the sessions held
+    uint64_t resident_bytes; // Pages of the log actually in memory
+    uint64_t term_bytes;     // Bitmaps for a full term of SESSION_MAX sessions per subject
+    uint64_t byte_per_session_bytes; // The same term at one byte per student per session
+} AttendanceMemory;
+
+// Function to measure the log: what it holds, and (with mincore) which of the pages
+// reserved for it in use by every subject are resident
+void attendance_memory(AttendanceMemory* memory) {
+    *memory = (AttendanceMemory){ 0 };
+    size_t chunk_bitmaps = (size_t)STORE_CHUNK_RECORDS / 8;
+    for (int subject = 0; subject < subject_count; subject++) {
+        memory->sessions += attendance_sessions[subject];
+    }
+    memory->log_bytes = (uint64_t)memory->sessions * student_store.chunk_count * chunk_bitmaps;
+    memory->term_bytes = (uint64_t)subject_count * SESSION_MAX * student_store.chunk_count * chunk_bitmaps;
+    memory->byte_per_session_bytes = (uint64_t)subject_count * SESSION_MAX * student_store.count;
+
+    size_t region = (size_t)subject_count * SESSION_MAX * chunk_bitmaps; // Whole pages
+    unsigned char pages[STUDENT_BIT_COLUMNS * (STORE_CHUNK_RECORDS / 8) / FILE_PAGE_BYTES];
+    for (int chunk = 0; chunk < student_store.chunk_count; chunk++) {
+        if (region > 0 && mincore(session_words(chunk, 0, 0), region, pages) == 0) {
+            for (size_t page = 0; page < region / FILE_PAGE_BYTES; page++) {
+                memory->resident_bytes += (pages[page] & 1) * FILE_PAGE_BYTES;
+            }
+        }
+    }
+}
+
+// --- Concurrent Reads ---
+// Students may be read from any number of threads while one writer at a time changes
+// the store: readers never take a lock and never wait for one. Writers serialise on
+// student_write_lock and bracket each change to a record with that record's sequence
+// lock (records share 64K striped sequences, so the table stays small), and each
+// change to the SAP ID index with sap_index_sequence. read_student() copies a record
+// between two reads of both sequences and retries if either moved.
+//
+// Compaction moves records and unmaps chunks, so it still needs exclusive access: it
+// only runs at points where the caller knows no reader is active.
+#define STUDENT_SEQUENCE_STRIPES 65536
+
+uint32_t student_sequences[STUDENT_SEQUENCE_STRIPES];
+pthread_mutex_t student_write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint32_t *student_sequence(int index) {
+    return &student_sequences[index & (STUDENT_SEQUENCE_STRIPES - 1)];
+}
+
+// A consistent copy of one student, made without locks
+typedef struct {
+    uint32_t sap_id;
+    char name[50];
+    int subjects;
+    uint8_t marks[SUBJECT_MAX];
+    uint8_t attendance[SUBJECT_MAX];
+} StudentView;
+
+// Function to find a key in a table snapshot. The probe is bounded, since a table that
+// is being changed underneath may have no empty slot on the way.
+static int sap_index_probe(const SapIndexSlot* table, uint32_t capacity, uint32_t shift, uint32_t key) {
+    if (table == NULL) {
+        return -1;
+    }
+    uint32_t i = (key * 2654435769u) >> shift;
+    for (uint32_t step = 0; step < capacity; step++) {
+        uint32_t slot_key = __atomic_load_n(&table[i].key, __ATOMIC_RELAXED);
+        if (slot_key == key) {
+            return __atomic_load_n(&table[i].value, __ATOMIC_RELAXED);
+        }
+        if (slot_key == SAP_INDEX_EMPTY) {
+            return -1;
+        }
+        i = (i + 1) & (capacity - 1);
+    }
+    return -1;
+}
+
+static bool read_student_copy(uint32_t key, StudentView* view) {
+    while (true) {
+        uint32_t index_start = seq_read_begin(&sap_index_sequence);
+        const SapIndexView *table = __atomic_load_n(&sap_index_view, __ATOMIC_ACQUIRE);
+        int index = table == NULL ? -1 : sap_index_probe(table->table, table->capacity, table->shift, key);
+        if (index == -1) {
+            if (seq_read_retry(&sap_index_sequence, index_start)) {
+                continue;
+            }
+            return false;
+        }
+        if (index < 0 || index >= __atomic_load_n(&student_store.slots, __ATOMIC_ACQUIRE)) {
+            continue; // Torn read of a slot that was being moved
+        }
+
+        uint32_t *sequence = student_sequence(index);
+        uint32_t record_start = seq_read_begin(sequence);
+        Student record;
+        memcpy(&record, student_at(index), sizeof(record));
+        bool live = *store_live_flag(&student_store, index);
+        view->subjects = __atomic_load_n(&subject_count, __ATOMIC_ACQUIRE);
+        for (int subject = 0; subject < view->subjects; subject++) {
+            view->marks[subject] = *student_mark(index, subject);
+            view->attendance[subject] = *student_attendance(index, subject);
+        }
+        // The handle is only trusted once the sequences confirm it, so check it first
+        const char *name = NULL;
+        if (record.name != 0 && record.name < string_pool_bytes(&string_pool)) {
+            name = __atomic_load_n(&string_pool.chunks[record.name >> STRING_POOL_CHUNK_SHIFT], __ATOMIC_RELAXED);
+        }
+        if (name != NULL) {
+            name += record.name & (STRING_POOL_CHUNK_BYTES - 1);
+            size_t length = strnlen(name, sizeof(view->name) - 1);
+            memcpy(view->name, name, length);
+            view->name[length] = '\0';
+        }
+        if (seq_read_retry(sequence, record_start) || seq_read_retry(&sap_index_sequence, index_start)) {
+            continue;
+        }
+        if (!live || record.sap_id != key || name == NULL) {
+            return false;
+        }
+        view->sap_id = key;
+        return true;
+    }
+}
+
+// Function to copy a student's record by SAP ID without taking any lock. Safe to call
+// from any thread while a writer works. Returns false if no student has that ID.
+bool read_student(uint32_t key, StudentView* view) {
+    uint64_t start = metric_clock();
+    bool found = read_student_copy(key, view);
+    metric_record(METRIC_LOOKUP, start);
+    return found;
+}
+
+// Function to change one score cell under the record's sequence lock
+static void write_student_score(int index, int column, uint8_t value) {
+    uint8_t *cell = store_cell(&student_store, index, column);
+    uint8_t old = *cell;
+    seq_write_begin(student_sequence(index));
+    *cell = value;
+    seq_write_end(student_sequence(index));
+    running_totals_change(column, old, value);
+    if (column < SUBJECT_MAX && value != old) {
+        leaderboard_mark_changed(index, column, old, value); // MARK_COLUMN(subject) is the subject
+    }
+}
+
+// Function to store a new student record with zero marks and attendance and index it
+// (attendance is 100% in subjects whose sessions are logged; see attendance_enrol()).
+// Returns the index, or -1 if the SAP ID is malformed or the store or pool is full.
+// Does not journal the change; see add_student().
+int insert_student(const StudentForm* form) {
+    Student s = { 0 };
+    if (!parse_sap_id(form->sap_id, &s.sap_id)) {
+        return -1;
+    }
+    // The strings go in first, so a crash never leaves a live record without them
+    s.name = string_pool_add(&string_pool, form->name, strlen(form->name));
+    s.credential = string_pool_add(&string_pool, form->credential, strlen(form->credential));
+    int index = s.name != 0 && s.credential != 0 ? store_alloc(&student_store) : -1;
+    if (index == -1) {
+        if (s.name != 0) string_pool_release(&string_pool, s.name);
+        if (s.credential != 0) string_pool_release(&string_pool, s.credential);
+        return -1;
+    }
+    seq_write_begin(student_sequence(index));
+    *student_at(index) = s;
+    for (int subject = 0; subject < subject_count; subject++) {
+        *student_mark(index, subject) = 0; // A reused slot still holds its old scores
+        *student_attendance(index, subject) = attendance_enrol(index, subject);
+    }
+    seq_write_end(student_sequence(index));
+    index_student(index);
+    running_totals_student(running_totals, index, 1);
+    leaderboard_rescore(index);
+    name_index_add(index);
+    student_order_add(index);
+    return index;
+}
+
+// Function to remove a student in O(1): unindex it and leave a tombstone for reuse.
+// Does not journal the change; see remove_student().
+void delete_student(int index) {
+    unindex_student(index);
+    running_totals_student(running_totals, index, -1);
+    leaderboard_remove(index);
+    name_index_remove(index);
+    student_order_remove(index);
+    seq_write_begin(student_sequence(index));
+    string_pool_release(&string_pool, student_at(index)->name);
+    string_pool_release(&string_pool, student_at(index)->credential);
+    store_release(&student_store, index);
+    seq_write_end(student_sequence(index));
+}
+
+// Compaction callback: repoint a relocated student's SAP ID, leaderboard places and
+// listing orders to its new slot, and copy its attendance log there
+static void reindex_moved_student(int from, int to) {
+    index_student(to);
+    leaderboard_move(from, to);
+    student_order_move(from, to);
+    attendance_move(from, to);
+}
+
+// Function to compact the student store. Returns the number of records moved.
+// Needs exclusive access, so it also frees any index tables retired since the last call.
+int compact_students() {
+    sap_index_reclaim();
+    int moved = store_compact(&student_store, reindex_moved_student);
+    if (moved > 0) {
+        name_index_discard(); // Cheaper to build again than to find every moved entry
+    }
+    return moved;
+}
+
+// Function to store a new teacher record. Returns the index, or -1 if full.
+// Does not journal the change; see add_teacher().
+int insert_teacher(const TeacherForm* form) {
+    Teacher t;
+    t.username = string_pool_add(&string_pool, form->username, strlen(form->username));
+    t.credential = string_pool_add(&string_pool, form->credential, strlen(form->credential));
+    int index = t.username != 0 && t.credential != 0 ? store_alloc(&teacher_store) : -1;
+    if (index == -1) {
+        if (t.username != 0) string_pool_release(&string_pool, t.username);
+        if (t.credential != 0) string_pool_release(&string_pool, t.credential);
+        return -1;
+    }
+    *teacher_at(index) = t;
+    index_teacher(index);
+    return index;
+}
+
+// --- Write-Ahead Log ---
+// Every change to the stores is appended to DIR/journal.wal as a small checksummed
+// record before the operator is told it succeeded. Records are buffered in memory and
+// written by a flusher thread; one fdatasync makes every record written so far durable,
+// so edits that arrive while a sync is in flight share the next one (group commit).
+//
+// At a checkpoint the store files are synced, the last LSN is stored in the students.db
+// header and the journal is truncated. On startup records newer than that LSN are
+// replayed onto the mapped stores. Replay is idempotent: every record carries the
+// final value, not a delta.
+#define WAL_BUFFER_BYTES (1 << 20)
+#define WAL_CHECKPOINT_BYTES (64 << 20) // Checkpoint once the journal grows past this
+
+enum {
+    WAL_ADD_STUDENT = 1,  // payload: Student
+    WAL_REMOVE_STUDENT,
+    WAL_SET_MARK,         // field: subject, value: marks
+    WAL_SET_ATTENDANCE,   // field: subject, value: attendance
+    WAL_ADD_TEACHER,      // payload: Teacher
+    WAL_GRADE_SHEET_PART, // payload: GradeSheetEntry[], applied only with its commit record
+    WAL_GRADE_SHEET_COMMIT, // payload: LSN of the group's first part
+    WAL_TAKE_SESSION,     // field: subject, value: session << 1 | everyone present
+    WAL_SET_SESSION       // field: subject, value: session << 1 | present
+};
+
+// One score cell of a grade sheet, as journaled (see apply_grade_sheet())
+typedef struct {
+    uint32_t sap;
+    uint8_t column;  // Student store column
+    uint8_t value;
+    uint16_t unused;
+} GradeSheetEntry;
+
+#define WAL_GRADE_SHEET_PART_ENTRIES (UINT16_MAX / sizeof(GradeSheetEntry))
+
+typedef struct {
+    uint32_t crc;     // CRC-32C of everything after this field, payload included
+    uint16_t length;  // Payload bytes following the header
+    uint8_t type;
+    uint8_t field;
+    uint64_t lsn;
+    uint32_t sap;     // Numeric SAP ID the record applies to
+    int32_t value;
+} WalRecordHeader;
+
+typedef struct {
+    int fd;
+    pthread_t flusher;
+    pthread_mutex_t lock;
+    pthread_cond_t work;     // Signalled when records are appended or on shutdown
+    pthread_cond_t durable;  // Broadcast after each sync, and when buffer space frees up
+    char *buffer;            // Records appended but not yet handed to the flusher
+    char *flush_buffer;      // Records the flusher is writing
+    size_t used;
+    uint64_t next_lsn;
+    uint64_t appended_lsn;   // Highest LSN in either buffer
+    uint64_t durable_lsn;    // Highest LSN known to be on disk
+    uint64_t records;        // Statistics for benchmarks
+    uint64_t syncs;
+    off_t file_bytes;
+    bool stop;
+} WriteAheadLog;
+
+WriteAheadLog wal = { .fd = -1 };
+
+// Function to compute a CRC-32C (Castagnoli), bytewise with a lazily built table
+uint32_t crc32c(const void* data, size_t length) {
+    static uint32_t table[256];
+    static bool ready = false;
+    if (!ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+            }
+            table[i] = c;
+        }
+        ready = true;
+    }
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFFu;
+    while (length--) {
+        crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static bool write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// Flusher thread: write out whatever has been appended, sync once, wake the waiters
+static void *wal_flusher(void* arg) {
+    WriteAheadLog *log = arg;
+    pthread_mutex_lock(&log->lock);
+    while (true) {
+        while (log->used == 0 && !log->stop) {
+            pthread_cond_wait(&log->work, &log->lock);
+        }
+        if (log->used == 0) {
+            break; // Stopping with nothing left to write
+        }
+        char *batch = log->buffer;
+        size_t length = log->used;
+        uint64_t batch_lsn = log->appended_lsn;
+        log->buffer = log->flush_buffer;
+        log->flush_buffer = batch;
+        log->used = 0;
+        pthread_cond_broadcast(&log->durable); // Appenders waiting for space can go on
+        pthread_mutex_unlock(&log->lock);
+
+        if (!write_all(log->fd, batch, length) || fdatasync(log->fd) != 0) {
+            error_printf(C_RED "Fatal: cannot write the journal: %s\n" C_RESET, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        pthread_mutex_lock(&log->lock);
+        log->durable_lsn = batch_lsn;
+        log->syncs++;
+        log->file_bytes += (off_t)length;
+        pthread_cond_broadcast(&log->durable);
+    }
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+// Function to open a journal for appending and start its flusher thread
+bool wal_open(WriteAheadLog* log, const char* path, uint64_t next_lsn) {
+    log->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log->fd == -1) {
+        error_printf(C_RED "Error: cannot open journal %s: %s\n" C_RESET, path, strerror(errno));
+        return false;
+    }
+    log->buffer = malloc(WAL_BUFFER_BYTES);
+    log->flush_buffer = malloc(WAL_BUFFER_BYTES);
+    if (log->buffer == NULL || log->flush_buffer == NULL) {
+        error_printf(C_RED "Error: out of memory for the journal buffers.\n" C_RESET);
+        return false;
+    }
+    log->used = 0;
+    log->next_lsn = next_lsn;
+    log->appended_lsn = log->durable_lsn = next_lsn - 1;
+    log->records = log->syncs = 0;
+    log->file_bytes = lseek(log->fd, 0, SEEK_END);
+    log->stop = false;
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->work, NULL);
+    pthread_cond_init(&log->durable, NULL);
+    // The flusher never takes signals, so SIGINT reaches the thread that waits for it
+    sigset_t all_signals, previous;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &previous);
+    pthread_create(&log->flusher, NULL, wal_flusher, log);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return true;
+}
+
+// Function to append one record. It is durable once wal_commit() on the returned LSN
+// returns. Returns 0 (and logs nothing) when no journal is open.
+uint64_t wal_append(WriteAheadLog* log, uint8_t type, uint8_t field, uint32_t sap, int32_t value,
+                    const void* payload, uint16_t length) {
+    if (log->fd == -1) {
+        return 0;
+    }
+    size_t total = sizeof(WalRecordHeader) + length;
+    pthread_mutex_lock(&log->lock);
+    while (log->used + total > WAL_BUFFER_BYTES) {
+        pthread_cond_wait(&log->durable, &log->lock);
+    }
+    WalRecordHeader header = {
+        .length = length, .type = type, .field = field, .lsn = log->next_lsn++, .sap = sap, .value = value
+    };
+    char *record = log->buffer + log->used;
+    memcpy(record, &header, sizeof(header));
+    if (length > 0) {
+        memcpy(record + sizeof(header), payload, length);
+    }
+    header.crc = crc32c(record + sizeof(uint32_t), total - sizeof(uint32_t));
+    memcpy(record, &header.crc, sizeof(header.crc));
+    log->used += total;
+    log->appended_lsn = header.lsn;
+    log->records++;
+    pthread_cond_signal(&log->work);
+    pthread_mutex_unlock(&log->lock);
+    return header.lsn;
+}
+
+// Function to wait until every record up to lsn is on disk
+void wal_commit(WriteAheadLog* log, uint64_t lsn) {
+    if (log->fd == -1) {
+        return;
+    }
+    pthread_mutex_lock(&log->lock);
+    while (log->durable_lsn < lsn) {
+        pthread_cond_wait(&log->durable, &log->lock);
+    }
+    pthread_mutex_unlock(&log->lock);
+}
+
+// Function to stop the flusher after it has written everything, and close the journal
+void wal_close(WriteAheadLog* log) {
+    if (log->fd == -1) {
+        return;
+    }
+    pthread_mutex_lock(&log->lock);
+    log->stop = true;
+    pthread_cond_signal(&log->work);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->flusher, NULL);
+    close(log->fd);
+    log->fd = -1;
+    free(log->buffer);
+    free(log->flush_buffer);
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->work);
+    pthread_cond_destroy(&log->durable);
+}
+
+// Function to make every change so far durable in the store files and empty the journal.
+// Must be called from the thread that mutates the stores.
+void wal_checkpoint(WriteAheadLog* log) {
+    if (log->fd == -1) {
+        return;
+    }
+    pthread_mutex_lock(&log->lock);
+    while (log->durable_lsn < log->appended_lsn) {
+        pthread_cond_wait(&log->durable, &log->lock);
+    }
+    // The flusher is idle and appenders are locked out until the journal is truncated
+    fsync(student_store.fd);
+    fsync(teacher_store.fd);
+    fsync(string_pool.fd);
+    student_store.file_header->checkpoint_lsn = log->durable_lsn;
+    memcpy(student_store.file_header->sessions, attendance_sessions, sizeof(attendance_sessions));
+    msync(student_store.file_header, FILE_PAGE_BYTES, MS_SYNC);
+    if (ftruncate(log->fd, 0) == 0) {
+        log->file_bytes = 0;
+        fdatasync(log->fd);
+    }
+    pthread_mutex_unlock(&log->lock);
+}
+
+// Function to make the global journal durable up to the latest change, checkpointing
+// it first if it has grown large. Menus call this once an operation is complete.
+void wal_sync() {
+    if (wal.fd == -1) {
+        return;
+    }
+    pthread_mutex_lock(&wal.lock);
+    uint64_t lsn = wal.appended_lsn;
+    off_t bytes = wal.file_bytes;
+    pthread_mutex_unlock(&wal.lock);
+    if (bytes >= WAL_CHECKPOINT_BYTES) {
+        wal_checkpoint(&wal);
+    } else {
+        wal_commit(&wal, lsn);
+    }
+}
+
+// --- Journaled Mutations ---
+// The menus change records only through these, so every change reaches the journal.
+
+int add_student(const StudentForm* s) {
+    uint64_t start = metric_clock();
+    pthread_mutex_lock(&student_write_lock);
+    int index = insert_student(s);
+    if (index != -1) {
+        wal_append(&wal, WAL_ADD_STUDENT, 0, student_at(index)->sap_id, 0, s, sizeof(StudentForm));
+    }
+    pthread_mutex_unlock(&student_write_lock);
+    metric_record(METRIC_ADD, start);
+    return index;
+}
+
+void remove_student(int index) {
+    uint64_t start = metric_clock();
+    pthread_mutex_lock(&student_write_lock);
+    wal_append(&wal, WAL_REMOVE_STUDENT, 0, student_at(index)->sap_id, 0, NULL, 0);
+    delete_student(index);
+    pthread_mutex_unlock(&student_write_lock);
+    metric_record(METRIC_REMOVE, start);
+}
+
+void set_student_mark(int index, int subject, int value) {
+    uint64_t start = metric_clock();
+    pthread_mutex_lock(&student_write_lock);
+    write_student_score(index, MARK_COLUMN(subject), (uint8_t)value);
+    wal_append(&wal, WAL_SET_MARK, (uint8_t)subject, student_at(index)->sap_id, value, NULL, 0);
+    pthread_mutex_unlock(&student_write_lock);
+    metric_record(METRIC_EDIT, start);
+}
+
+void set_student_attendance(int index, int subject, int value) {
+    uint64_t start = metric_clock();
+    pthread_mutex_lock(&student_write_lock);
+    write_student_score(index, ATTENDANCE_COLUMN(subject), (uint8_t)value);
+    wal_append(&wal, WAL_SET_ATTENDANCE, (uint8_t)subject, student_at(index)->sap_id, value, NULL, 0);
+    pthread_mutex_unlock(&student_write_lock);
+    metric_record(METRIC_EDIT, start);
+}
+
+// Function to bring one student's attendance cell in line with the log
+static void attendance_refresh_student(int index, int subject) {
+    int held = attendance_sessions[subject];
+    uint8_t value = (uint8_t)attendance_percent(attendance_count(index, subject), held);
+    if (*student_attendance(index, subject) != value) {
+        write_student_score(index, ATTENDANCE_COLUMN(subject), value);
+    }
+}
+
+// Function to bring every student's attendance cell in a subject in line with the log,
+// counting a chunk of students at a time
+static void attendance_refresh_subject(int subject) {
+    int held = attendance_sessions[subject];
+    uint32_t counts[STORE_CHUNK_RECORDS];
+    for (int chunk = 0; chunk < student_store.chunk_count; chunk++) {
+        if (student_store.chunk_live[chunk] == 0) {
+            continue;
+        }
+        int base = chunk << STORE_CHUNK_SHIFT;
+        int n = student_store.slots - base < STORE_CHUNK_RECORDS ? student_store.slots - base : STORE_CHUNK_RECORDS;
+        attendance_count_chunk(chunk, subject, n, counts);
+        const uint8_t *live = store_live_flag(&student_store, base);
+        const uint8_t *cells = store_column(&student_store, chunk, ATTENDANCE_COLUMN(subject));
+        for (int i = 0; i < n; i++) {
+            uint8_t value = (uint8_t)attendance_percent((int)counts[i], held);
+            if (live[i] && cells[i] != value) {
+                write_student_score(base + i, ATTENDANCE_COLUMN(subject), value);
+            }
+        }
+    }
+}
+
+// Function to fill in a session of a subject for the whole class, recording it as a new
+// one if it is the next. Later sessions are ignored. Returns false if it was ignored.
+static bool apply_take_session(int subject, int session, bool present) {
+    if (session > attendance_sessions[subject] || session >= SESSION_MAX) {
+        return false;
+    }
+    attendance_fill(subject, session, present);
+    if (session == attendance_sessions[subject]) {
+        attendance_sessions[subject]++;
+    }
+    attendance_refresh_subject(subject);
+    return true;
+}
+
+// Function to mark one student at a session of a subject. Sessions not yet recorded
+// are ignored. Returns false if it was ignored.
+static bool apply_session_attendance(int index, int subject, int session, bool present) {
+    if (session < 0 || session >= attendance_sessions[subject]) {
+        return false;
+    }
+    session_mark(index, subject, session, present);
+    attendance_refresh_student(index, subject);
+    return true;
+}
+
+// Function to record a new class session of a subject, with every student present or
+// every student absent. Returns its number (from 0), or -1 once a term's worth of
+// sessions (SESSION_MAX) has been recorded.
+int take_session(int subject, bool present) {
+    uint64_t start = metric_clock();
+    pthread_mutex_lock(&student_write_lock);
+    int session = attendance_sessions[subject];
+    if (!apply_take_session(subject, session, present)) {
+        session = -1;
+    } else {
+        wal_append(&wal, WAL_TAKE_SESSION, (uint8_t)subject, 0, session << 1 | present, NULL, 0);
+    }
+    pthread_mutex_unlock(&student_write_lock);
+    metric_record(METRIC_EDIT, start);
+    return session;
+}
+
+// Function to mark one student present or absent at a session already recorded.
+// Returns false, journaling nothing, if the session has not been recorded.
+bool set_session_attendance(int index, int subject, int session, bool present) {
+    uint64_t start = metric_clock();
+    pthread_mutex_lock(&student_write_lock);
+    bool applied = apply_session_attendance(index, subject, session, present);
+    if (applied) {
+        wal_append(&wal, WAL_SET_SESSION, (uint8_t)subject, student_at(index)->sap_id, session << 1 | present, NULL, 0);
+    }
+    pthread_mutex_unlock(&student_write_lock);
+    metric_record(METRIC_EDIT, start);
+    return applied;
+}
+
+int add_teacher(const TeacherForm* t) {
+    int index = insert_teacher(t);
+    if (index != -1) {
+        wal_append(&wal, WAL_ADD_TEACHER, 0, 0, 0, t, sizeof(TeacherForm));
+    }
+    return index;
+}
+
+// Function to apply one journal record to the stores without journaling it again
+static void wal_apply(const WalRecordHeader* header, const char* payload) {
+    int index = header->type == WAL_ADD_TEACHER ? -1 : sap_index_lookup(header->sap);
+    switch (header->type) {
+        case WAL_ADD_STUDENT:
+            if (index == -1 && header->length == sizeof(StudentForm)) {
+                StudentForm s;
+                memcpy(&s, payload, sizeof(s));
+                insert_student(&s);
+            }
+            break;
+        case WAL_REMOVE_STUDENT:
+            if (index != -1) {
+                delete_student(index);
+            }
+            break;
+        case WAL_SET_MARK:
+            if (index != -1 && header->field < subject_count) {
+                write_student_score(index, MARK_COLUMN(header->field), (uint8_t)header->value);
+            }
+            break;
+        case WAL_SET_ATTENDANCE:
+            if (index != -1 && header->field < subject_count) {
+                write_student_score(index, ATTENDANCE_COLUMN(header->field), (uint8_t)header->value);
+            }
+            break;
+        case WAL_TAKE_SESSION:
+            if (header->field < subject_count && header->value >= 0) {
+                apply_take_session(header->field, header->value >> 1, header->value & 1);
+            }
+            break;
+        case WAL_SET_SESSION:
+            if (index != -1 && header->field < subject_count && header->value >= 0) {
+                apply_session_attendance(index, header->field, header->value >> 1, header->value & 1);
+            }
+            break;
+        case WAL_GRADE_SHEET_PART:
+            for (size_t i = 0; i < header->length / sizeof(GradeSheetEntry); i++) {
+                GradeSheetEntry entry;
+                memcpy(&entry, payload + i * sizeof(entry), sizeof(entry));
+                int student = sap_index_lookup(entry.sap);
+                if (student != -1 && student_column_in_use(entry.column)) {
+                    write_student_score(student, entry.column, entry.value);
+                }
+            }
+            break;
+        case WAL_ADD_TEACHER:
+            if (header->length == sizeof(TeacherForm)) {
+                TeacherForm t;
+                memcpy(&t, payload, sizeof(t));
+                if (find_teacher_index(t.username) == -1) {
+                    insert_teacher(&t);
+                }
+            }
+            break;
+    }
+}
+
+// Function to replay the journal onto the stores. Stops at the first torn or corrupt
+// record (the tail of a write interrupted by a crash) and cuts the file there.
+// Grade sheet parts are held back until their commit record, so a sheet whose commit
+// never reached the disk changes nothing. Sets *last_lsn to the highest LSN seen.
+// Returns the number of records applied.
+long wal_replay(const char* path, uint64_t checkpoint_lsn, uint64_t* last_lsn) {
+    *last_lsn = checkpoint_lsn;
+    int fd = open(path, O_RDWR);
+    if (fd == -1) {
+        return 0; // No journal yet
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+
+    long applied = 0;
+    off_t offset = 0;
+    off_t sheet_start = -1; // First grade sheet part not yet matched with a commit
+    while (offset + (off_t)sizeof(WalRecordHeader) <= st.st_size) {
+        WalRecordHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        size_t total = sizeof(header) + header.length;
+        if (offset + (off_t)total > st.st_size
+            || crc32c(data + offset + sizeof(uint32_t), total - sizeof(uint32_t)) != header.crc) {
+            break;
+        }
+        if (header.type == WAL_GRADE_SHEET_PART) {
+            if (sheet_start == -1) {
+                sheet_start = offset;
+            }
+        } else if (header.type == WAL_GRADE_SHEET_COMMIT) {
+            // Apply the group's parts; earlier parts are from a sheet that never committed
+            uint64_t first_lsn = 0;
+            if (header.length == sizeof(first_lsn)) {
+                memcpy(&first_lsn, data + offset + sizeof(header), sizeof(first_lsn));
+            }
+            for (off_t at = sheet_start; at != -1 && at < offset; ) {
+                WalRecordHeader part;
+                memcpy(&part, data + at, sizeof(part));
+                if (part.type == WAL_GRADE_SHEET_PART && part.lsn >= first_lsn && part.lsn > checkpoint_lsn) {
+                    wal_apply(&part, data + at + sizeof(part));
+                    applied++;
+                }
+                at += (off_t)(sizeof(part) + part.length);
+            }
+            sheet_start = -1;
+        } else if (header.lsn > checkpoint_lsn) {
+            wal_apply(&header, data + offset + sizeof(header));
+            applied++;
+        }
+        if (header.lsn > *last_lsn) {
+            *last_lsn = header.lsn;
+        }
+        offset += (off_t)total;
+    }
+    munmap(data, st.st_size);
+    if (offset < st.st_size) {
+        error_printf(C_YELLOW "Discarding %lld bytes of incomplete journal data.\n" C_RESET, (long long)(st.st_size - offset));
+        if (ftruncate(fd, offset) != 0) {
+            error_printf(C_RED "Warning: cannot truncate %s: %s\n" C_RESET, path, strerror(errno));
+        }
+    }
+    close(fd);
+    return applied;
+}
+
+typedef struct {
+    WriteAheadLog *log;
+    int edits;
+    uint32_t seed;
+} WalBenchWorker;
+
+static void *wal_bench_worker(void* arg) {
+    WalBenchWorker *w = arg;
+    for (int i = 0; i < w->edits; i++) {
+        w->seed = w->seed * 1103515245u + 12345u;
+        uint32_t sap = 500000000u + (w->seed >> 8) % 100000u;
+        uint64_t lsn = wal_append(w->log, WAL_SET_MARK, (uint8_t)(i % subject_count), sap, (int32_t)(w->seed % 101), NULL, 0);
+        wal_commit(w->log, lsn);
+    }
+    return NULL;
+}
+
+// Function to benchmark journal throughput: `threads` writers each make committed
+// edits, as concurrent teachers would. Uses a scratch journal in the data directory.
+int run_wal_benchmark(const char* dir, int edits, int threads) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        error_printf(C_RED "Error: cannot create data directory %s: %s\n" C_RESET, dir, strerror(errno));
+        return 1;
+    }
+    char path[PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/wal-benchmark.tmp", dir);
+    unlink(path);
+
+    WriteAheadLog log = { .fd = -1 };
+    if (!wal_open(&log, path, 1)) {
+        return 1;
+    }
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    WalBenchWorker *workers = malloc(threads * sizeof(WalBenchWorker));
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < threads; t++) {
+        workers[t].log = &log;
+        workers[t].edits = edits / threads + (t < edits % threads ? 1 : 0);
+        workers[t].seed = 2463534242u + (uint32_t)t * 7919u;
+        pthread_create(&tids[t], NULL, wal_bench_worker, &workers[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    double ms = elapsed_ms(&start);
+    uint64_t syncs = log.syncs;
+    off_t bytes = log.file_bytes;
+    wal_close(&log);
+    unlink(path);
+    free(tids);
+    free(workers);
+
+    printf("WAL benchmark: %d committed edits from %d thread(s) in %.1f ms\n", edits, threads, ms);
+    printf("  edits/s:         %.0f\n", edits / (ms / 1e3));
+    printf("  fsyncs:          %llu\n", (unsigned long long)syncs);
+    printf("  fsyncs per edit: %.4f\n", edits > 0 ? (double)syncs / edits : 0.0);
+    printf("  journal bytes:   %lld (%.1f per edit)\n", (long long)bytes, edits > 0 ? (double)bytes / edits : 0.0);
+    return 0;
+}
+
+// --- Column Aggregation ---
+
+// Class-wide figures come from kernels that scan one column of one chunk together
+// with the chunk's liveness bytes, so dead slots are masked out without branches.
+// Each kernel has a scalar version plus SSE2 and AVX2 versions on x86; the widest
+// one the CPU supports is picked once at startup.
+
+typedef struct {
+    int64_t count; // Live records scanned
+    int64_t sum;
+    int32_t min;
+    int32_t max;
+    int64_t below; // Live values under the threshold
+} ColumnStats;
+
+typedef void (*ColumnStatsKernel)(const uint8_t* values, const uint8_t* live, int n,
+                                  int32_t threshold, ColumnStats* stats);
+
+static void column_stats_scalar(const uint8_t* values, const uint8_t* live, int n,
+                                int32_t threshold, ColumnStats* stats) {
+    for (int i = 0; i < n; i++) {
+        if (!live[i]) {
+            continue;
+        }
+        int32_t v = values[i];
+        stats->count++;
+        stats->sum += v;
+        if (v < stats->min) stats->min = v;
+        if (v > stats->max) stats->max = v;
+        stats->below += v < threshold;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// The vector kernels work on bytes: a dead slot's value is forced to 0 for the sum and
+// maximum and to 255 for the minimum, and byte sums are gathered with SAD (sum of
+// absolute differences against zero) into 64-bit lanes. "v < threshold" is computed as
+// max(v, threshold - 1) == threshold - 1, since there is no unsigned byte compare.
+static inline uint8_t column_threshold_cap(int32_t threshold, uint8_t* enabled) {
+    *enabled = threshold > 0 ? 0xFF : 0;
+    return threshold <= 0 ? 0 : threshold > 256 ? 255 : (uint8_t)(threshold - 1);
+}
+
+__attribute__((target("sse2")))
+static void column_stats_sse2(const uint8_t* values, const uint8_t* live, int n,
+                              int32_t threshold, ColumnStats* stats) {
+    uint8_t enabled;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i cap = _mm_set1_epi8((char)column_threshold_cap(threshold, &enabled));
+    const __m128i below_on = _mm_set1_epi8((char)enabled);
+    __m128i count = zero, below = zero, sum = zero; // 2 x int64 each
+    __m128i lo = _mm_set1_epi8((char)0xFF), hi = zero;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i dead = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(live + i)), zero);
+        __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+        __m128i kept = _mm_andnot_si128(dead, v);
+        __m128i lt = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, cap), cap), below_on);
+        count = _mm_add_epi64(count, _mm_sad_epu8(_mm_andnot_si128(dead, one), zero));
+        below = _mm_add_epi64(below, _mm_sad_epu8(_mm_andnot_si128(dead, _mm_and_si128(lt, one)), zero));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(kept, zero));
+        lo = _mm_min_epu8(lo, _mm_or_si128(v, dead));
+        hi = _mm_max_epu8(hi, kept);
+    }
+    int64_t lanes[3][2];
+    uint8_t lane_lo[16], lane_hi[16];
+    _mm_storeu_si128((__m128i*)lanes[0], count);
+    _mm_storeu_si128((__m128i*)lanes[1], below);
+    _mm_storeu_si128((__m128i*)lanes[2], sum);
+    _mm_storeu_si128((__m128i*)lane_lo, lo);
+    _mm_storeu_si128((__m128i*)lane_hi, hi);
+    if (lanes[0][0] + lanes[0][1] > 0) {
+        for (int k = 0; k < 16; k++) {
+            if (lane_lo[k] < stats->min) stats->min = lane_lo[k];
+            if (lane_hi[k] > stats->max) stats->max = lane_hi[k];
+        }
+    }
+    stats->count += lanes[0][0] + lanes[0][1];
+    stats->below += lanes[1][0] + lanes[1][1];
+    stats->sum += lanes[2][0] + lanes[2][1];
+    column_stats_scalar(values + i, live + i, n - i, threshold, stats);
+}
+
+__attribute__((target("avx2")))
+static void column_stats_avx2(const uint8_t* values, const uint8_t* live, int n,
+                              int32_t threshold, ColumnStats* stats) {
+    uint8_t enabled;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i cap = _mm256_set1_epi8((char)column_threshold_cap(threshold, &enabled));
+    const __m256i below_on = _mm256_set1_epi8((char)enabled);
+    __m256i count = zero, below = zero, sum = zero; // 4 x int64 each
+    __m256i lo = _mm256_set1_epi8((char)0xFF), hi = zero;
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i dead = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(live + i)), zero);
+        __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+        __m256i kept = _mm256_andnot_si256(dead, v);
+        __m256i lt = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, cap), cap), below_on);
+        count = _mm256_add_epi64(count, _mm256_sad_epu8(_mm256_andnot_si256(dead, one), zero));
+        below = _mm256_add_epi64(below, _mm256_sad_epu8(_mm256_andnot_si256(dead, _mm256_and_si256(lt, one)), zero));
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(kept, zero));
+        lo = _mm256_min_epu8(lo, _mm256_or_si256(v, dead));
+        hi = _mm256_max_epu8(hi, kept);
+    }
+    int64_t lanes[3][4];
+    uint8_t lane_lo[32], lane_hi[32];
+    _mm256_storeu_si256((__m256i*)lanes[0], count);
+    _mm256_storeu_si256((__m256i*)lanes[1], below);
+    _mm256_storeu_si256((__m256i*)lanes[2], sum);
+    _mm256_storeu_si256((__m256i*)lane_lo, lo);
+    _mm256_storeu_si256((__m256i*)lane_hi, hi);
+    int64_t live_count = lanes[0][0] + lanes[0][1] + lanes[0][2] + lanes[0][3];
+    if (live_count > 0) {
+        for (int k = 0; k < 32; k++) {
+            if (lane_lo[k] < stats->min) stats->min = lane_lo[k];
+            if (lane_hi[k] > stats->max) stats->max = lane_hi[k];
+        }
+    }
+    stats->count += live_count;
+    stats->below += lanes[1][0] + lanes[1][1] + lanes[1][2] + lanes[1][3];
+    stats->sum += lanes[2][0] + lanes[2][1] + lanes[2][2] + lanes[2][3];
+    column_stats_scalar(values + i, live + i, n - i, threshold, stats);
+}
+
+#endif
+
+static ColumnStatsKernel column_stats_kernel = column_stats_scalar;
+static const char* column_stats_kernel_name = "scalar";
+
+// Function to pick the widest column kernel, and the popcount kernel, this CPU supports
+// (called once from main)
+void select_column_kernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        column_stats_kernel = column_stats_avx2;
+        column_stats_kernel_name = "AVX2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        column_stats_kernel = column_stats_sse2;
+        column_stats_kernel_name = "SSE2";
+    }
+    if (__builtin_cpu_supports("popcnt")) {
+        popcount_kernel = popcount_popcnt;
+        popcount_kernel_name = "POPCNT";
+    }
+#endif
+}
+
+// Function to aggregate one student column over the whole roster. min/max are only
+// meaningful when stats->count > 0.
+void student_column_stats(int column, int32_t threshold, ColumnStats* stats) {
+    *stats = (ColumnStats){ .min = INT32_MAX, .max = INT32_MIN };
+    for (int chunk = 0; chunk < student_store.chunk_count; chunk++) {
+        if (student_store.chunk_live[chunk] == 0) {
+            continue;
+        }
+        int base = chunk << STORE_CHUNK_SHIFT;
+        int n = student_store.slots - base < STORE_CHUNK_RECORDS ? student_store.slots - base : STORE_CHUNK_RECORDS;
+        column_stats_kernel(store_column(&student_store, chunk, column), store_live_flag(&student_store, base),
+                            n, threshold, stats);
+    }
+}
+
+// Function to check the running totals against a full recompute: a fresh scan for every
+// figure, and the column kernels' own sums, threshold counts and extremes. Reports any
+// column that differs to `out`. Returns true if every column matched.
+bool running_totals_verify(FILE* out) {
+    RunningTotals *fresh = malloc(STUDENT_COLUMNS * sizeof(RunningTotals));
+    if (fresh == NULL) {
+        fprintf(out, "Cannot verify the running totals: out of memory.\n");
+        return false;
+    }
+    running_totals_scan(fresh);
+    bool matched = true;
+    for (int column = 0; column < STUDENT_COLUMNS; column++) {
+        if (!student_column_in_use(column)) {
+            continue;
+        }
+        const RunningTotals *t = &running_totals[column];
+        ColumnStats stats;
+        ColumnSummary summary;
+        student_column_stats(column, running_totals_threshold(column), &stats);
+        running_totals_summary(column, &summary);
+        if (memcmp(t, &fresh[column], sizeof(*t)) != 0 || stats.sum != t->sum || stats.below != t->below
+            || stats.count != summary.count || (stats.count > 0 && (stats.min != summary.min || stats.max != summary.max))) {
+            fprintf(out, "Running totals for %s %s differ from a full recompute: sum %lld (recomputed %lld), "
+                         "squares %lld (%lld), below threshold %lld (%lld)\n",
+                subject_names[column % SUBJECT_MAX], column < SUBJECT_MAX ? "marks" : "attendance",
+                (long long)t->sum, (long long)fresh[column].sum, (long long)t->sum_squares,
+                (long long)fresh[column].sum_squares, (long long)t->below, (long long)fresh[column].below);
+            matched = false;
+        }
+    }
+    free(fresh);
+    return matched;
+}
+
+// --- Class Analytics ---
+// Per-subject distributions of marks and attendance for the whole roster. Scores are
+// bytes, so each column is summarised exactly by a 256-bucket histogram; the mean,
+// median, p10 and p90 are all read off the histograms. Large rosters are split into
+// contiguous chunk ranges, one per thread, and the per-thread histograms are summed.
+#define ANALYTICS_MIN_CHUNKS_PER_THREAD 16 // Below ~16K students per thread, one thread is faster
+#define ANALYTICS_BINS 10                  // Histogram bars shown per subject
+
+int worker_thread_count = 1; // Threads for parallel work (--threads, default one per CPU)
+
+typedef struct {
+    uint64_t counts[STUDENT_COLUMNS][256];
+    uint64_t students;
+} ScoreHistograms;
+
+typedef struct {
+    int first_chunk;
+    int end_chunk;
+    ScoreHistograms histograms;
+    double ms;
+} AnalyticsWorker;
+
+typedef struct {
+    ScoreHistograms histograms;
+    int threads;
+    double scan_ms;  // Wall time of the parallel scan
+    double merge_ms; // Summing the per-thread histograms
+    double slowest_thread_ms;
+} ClassAnalytics;
+
+// Function to add one chunk's live scores to a set of histograms. A dead slot's value
+// is redirected to bucket 255, which no score can reach (it is dropped when the
+// per-thread histograms are merged), so the loop has no branches.
+static void analytics_count_chunk(ScoreHistograms* h, int chunk) {
+    int base = chunk << STORE_CHUNK_SHIFT;
+    int n = student_store.slots - base < STORE_CHUNK_RECORDS ? student_store.slots - base : STORE_CHUNK_RECORDS;
+    const uint8_t *live = store_live_flag(&student_store, base);
+    for (int column = 0; column < STUDENT_COLUMNS; column++) {
+        if (!student_column_in_use(column)) {
+            continue;
+        }
+        const uint8_t *values = store_column(&student_store, chunk, column);
+        uint64_t *counts = h->counts[column];
+        for (int i = 0; i < n; i++) {
+            counts[values[i] | (uint8_t)(live[i] - 1)]++;
+        }
+    }
+    h->students += student_store.chunk_live[chunk];
+}
+
+static void *analytics_worker(void* arg) {
+    AnalyticsWorker *w = arg;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int chunk = w->first_chunk; chunk < w->end_chunk; chunk++) {
+        if (student_store.chunk_live[chunk] > 0) {
+            analytics_count_chunk(&w->histograms, chunk);
+        }
+    }
+    w->ms = elapsed_ms(&start);
+    return NULL;
+}
+
+// Function to build the roster's score histograms on up to `threads` threads.
+// Returns false if memory for the workers could not be allocated.
+bool compute_class_analytics(ClassAnalytics* result, int threads) {
+    int chunks = student_store.chunk_count;
+    if (threads > chunks / ANALYTICS_MIN_CHUNKS_PER_THREAD) {
+        threads = chunks / ANALYTICS_MIN_CHUNKS_PER_THREAD;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    AnalyticsWorker *workers = calloc(threads, sizeof(AnalyticsWorker));
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    if (workers == NULL || tids == NULL) {
+        free(workers);
+        free(tids);
+        return false;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < threads; t++) {
+        workers[t].first_chunk = (int)((long)chunks * t / threads);
+        workers[t].end_chunk = (int)((long)chunks * (t + 1) / threads);
+        // The calling thread takes the first range itself
+        if (t > 0 && pthread_create(&tids[t], NULL, analytics_worker, &workers[t]) != 0) {
+            workers[t].ms = -1; // Could not start: counted below on this thread
+        }
+    }
+    analytics_worker(&workers[0]);
+    for (int t = 1; t < threads; t++) {
+        if (workers[t].ms < 0) {
+            analytics_worker(&workers[t]);
+        } else {
+            pthread_join(tids[t], NULL);
+        }
+    }
+    result->scan_ms = elapsed_ms(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&result->histograms, 0, sizeof(result->histograms));
+    result->slowest_thread_ms = 0;
+    for (int t = 0; t < threads; t++) {
+        for (int column = 0; column < STUDENT_COLUMNS; column++) {
+            for (int v = 0; v < 255 && student_column_in_use(column); v++) {
+                result->histograms.counts[column][v] += workers[t].histograms.counts[column][v];
+            }
+        }
+        result->histograms.students += workers[t].histograms.students;
+        if (workers[t].ms > result->slowest_thread_ms) {
+            result->slowest_thread_ms = workers[t].ms;
+        }
+    }
+    result->merge_ms = elapsed_ms(&start);
+    result->threads = threads;
+    free(workers);
+    free(tids);
+    return true;
+}
+
+// Function to find the smallest score with at least `percent`% of students at or below it
+static int histogram_percentile(const uint64_t counts[256], uint64_t total, int percent) {
+    uint64_t rank = (total * (uint64_t)percent + 99) / 100; // Nearest-rank method
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int v = 0; v < 256; v++) {
+        seen += counts[v];
+        if (seen >= rank) {
+            return v;
+        }
+    }
+    return 255;
+}
+
+static double histogram_mean(const uint64_t counts[256], uint64_t total) {
+    uint64_t sum = 0;
+    for (int v = 0; v < 256; v++) {
+        sum += counts[v] * (uint64_t)v;
+    }
+    return total > 0 ? (double)sum / total : 0.0;
+}
+
+// Function to print the analytics report: a statistics table, a marks histogram per
+// subject and the timings
+void print_class_analytics(const ClassAnalytics* a) {
+    uint64_t total = a->histograms.students;
+    int width = subject_label_width();
+    const char *rule = "--------------------------------+--------------------------------+------------+\n";
+    screen_subject_rule('+', width, rule);
+    screen_printf("| %*s | " C_BOLD "Marks" C_RESET "                          | " C_BOLD "Attendance (%%)" C_RESET "                 |            |\n", width, "");
+    screen_printf("| " C_BOLD "%-*s" C_RESET " |   Mean  Median   P10   P90     |   Mean  Median   P10   P90     | Att < %d%%  |\n", width, "Subject", ATTENDANCE_THRESHOLD);
+    screen_subject_rule('+', width, rule);
+    for (int subject = 0; subject < subject_count; subject++) {
+        const uint64_t *marks = a->histograms.counts[MARK_COLUMN(subject)];
+        const uint64_t *attendance = a->histograms.counts[ATTENDANCE_COLUMN(subject)];
+        uint64_t defaulters = 0;
+        for (int v = 0; v < ATTENDANCE_THRESHOLD; v++) {
+            defaulters += attendance[v];
+        }
+        screen_printf("| " C_CYAN "%-*s" C_RESET " | %6.2f  %6d  %4d  %4d     | %6.2f  %6d  %4d  %4d     | " C_YELLOW "%10llu" C_RESET " |\n",
+            width, subject_names[subject],
+            histogram_mean(marks, total), histogram_percentile(marks, total, 50),
+            histogram_percentile(marks, total, 10), histogram_percentile(marks, total, 90),
+            histogram_mean(attendance, total), histogram_percentile(attendance, total, 50),
+            histogram_percentile(attendance, total, 10), histogram_percentile(attendance, total, 90),
+            (unsigned long long)defaulters);
+    }
+    screen_subject_rule('+', width, rule);
+
+    for (int subject = 0; subject < subject_count; subject++) {
+        const uint64_t *marks = a->histograms.counts[MARK_COLUMN(subject)];
+        uint64_t bins[ANALYTICS_BINS] = { 0 };
+        uint64_t widest = 1;
+        for (int v = 0; v <= 100; v++) {
+            bins[v / 10 < ANALYTICS_BINS ? v / 10 : ANALYTICS_BINS - 1] += marks[v]; // 100 joins 90-99
+        }
+        for (int b = 0; b < ANALYTICS_BINS; b++) {
+            if (bins[b] > widest) widest = bins[b];
+        }
+        screen_printf(C_BOLD "\n%s marks:\n" C_RESET, subject_names[subject]);
+        for (int b = 0; b < ANALYTICS_BINS; b++) {
+            int bar = (int)(bins[b] * 40 / widest);
+            screen_printf("  %3d-%-3d | " C_GREEN, b * 10, b == ANALYTICS_BINS - 1 ? 100 : b * 10 + 9);
+            screen_append("########################################", bar);
+            screen_printf(C_RESET "%*s %llu\n", 40 - bar, "", (unsigned long long)bins[b]);
+        }
+    }
+
+    screen_printf("\n%llu students analysed on %d thread(s): scan %.3f ms (slowest thread %.3f ms), merge %.3f ms.\n",
+        (unsigned long long)total, a->threads, a->scan_ms, a->slowest_thread_ms, a->merge_ms);
+}
+
+// Function to compute and show the analytics report (teacher portal and --analytics)
+void show_class_analytics() {
+    if (student_store.count == 0) {
+        screen_printf(C_YELLOW "No students registered yet.\n" C_RESET);
+        return;
+    }
+    ClassAnalytics analytics;
+    if (!compute_class_analytics(&analytics, worker_thread_count)) {
+        screen_printf(C_RED "Error: out of memory while computing analytics.\n" C_RESET);
+        return;
+    }
+    print_class_analytics(&analytics);
+}
+
+// --- Layout Benchmark ---
+// Compares the compact student layout against the original one, in which every student
+// was a single 104-byte struct holding its strings and six int scores inline.
+typedef struct {
+    char sap_id[SAP_ID_LENGTH + 1];
+    char password[20];
+    char name[50];
+    int marks_maths, marks_physics, marks_coding;
+    int attendance_maths, attendance_physics, attendance_coding;
+} LegacyStudent;
+
+#define LAYOUT_BENCH_ROUNDS 5
+
+// Function to fill a synthetic student (the same data goes into both layouts). Every
+// student shares one credential, since hashing a password per student would swamp the
+// build times; the credential still takes its full space in the pool.
+static void layout_bench_student(int i, const char* credential, StudentForm* form, uint8_t scores[STUDENT_COLUMNS]) {
+    snprintf(form->sap_id, sizeof(form->sap_id), "%09u", 100000000u + (uint32_t)i % 900000000u);
+    strcpy(form->credential, credential);
+    snprintf(form->name, sizeof(form->name), "Student Number %d", i);
+    uint32_t seed = (uint32_t)i * 2654435761u;
+    for (int column = 0; column < STUDENT_COLUMNS; column++) {
+        seed = seed * 1103515245u + 12345u;
+        scores[column] = student_column_in_use(column) ? (uint8_t)((seed >> 16) % 101) : 0;
+    }
+}
+
+// Function to build N students in both layouts (in memory) and time the same queries
+// against each. Returns the process exit status.
+int run_layout_benchmark(int students) {
+    LegacyStudent *legacy = malloc((size_t)students * sizeof(LegacyStudent));
+    if (legacy == NULL) {
+        error_printf(C_RED "Error: not enough memory for %d legacy records.\n" C_RESET, students);
+        return 1;
+    }
+    char credential[CREDENTIAL_BYTES];
+    hash_password("pw", credential);
+    struct timespec start;
+    double legacy_build = 0, compact_build = 0;
+    for (int i = 0; i < students; i++) {
+        StudentForm form;
+        uint8_t scores[STUDENT_COLUMNS];
+        layout_bench_student(i, credential, &form, scores);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        LegacyStudent *l = &legacy[i];
+        memcpy(l->sap_id, form.sap_id, sizeof(l->sap_id));
+        snprintf(l->password, sizeof(l->password), "pw%d", i); // The original kept it in plain text
+        memcpy(l->name, form.name, sizeof(l->name));
+        l->marks_maths = scores[MARK_COLUMN(0)];
+        l->marks_physics = scores[MARK_COLUMN(1)];
+        l->marks_coding = scores[MARK_COLUMN(2)];
+        l->attendance_maths = scores[ATTENDANCE_COLUMN(0)];
+        l->attendance_physics = scores[ATTENDANCE_COLUMN(1)];
+        l->attendance_coding = scores[ATTENDANCE_COLUMN(2)];
+        legacy_build += elapsed_ms(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int index = insert_student(&form);
+        if (index == -1) {
+            error_printf(C_RED "Error: the student store is full.\n" C_RESET);
+            free(legacy);
+            return 1;
+        }
+        begin_score_rewrite(index);
+        for (int subject = 0; subject < subject_count; subject++) {
+            *student_mark(index, subject) = scores[MARK_COLUMN(subject)];
+            *student_attendance(index, subject) = scores[ATTENDANCE_COLUMN(subject)];
+        }
+        end_score_rewrite(index);
+        compact_build += elapsed_ms(&start);
+    }
+
+    // Query 1: Maths average and attendance defaulters (a class summary column pair)
+    double legacy_summary = 1e30, compact_summary = 1e30;
+    long long legacy_sum = 0, legacy_below = 0;
+    ColumnStats marks, attendance;
+    for (int round = 0; round < LAYOUT_BENCH_ROUNDS; round++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        legacy_sum = legacy_below = 0;
+        for (int i = 0; i < students; i++) {
+            legacy_sum += legacy[i].marks_maths;
+            legacy_below += legacy[i].attendance_maths < ATTENDANCE_THRESHOLD;
+        }
+        double ms = elapsed_ms(&start);
+        if (ms < legacy_summary) legacy_summary = ms;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        student_column_stats(MARK_COLUMN(0), 0, &marks);
+        student_column_stats(ATTENDANCE_COLUMN(0), ATTENDANCE_THRESHOLD, &attendance);
+        ms = elapsed_ms(&start);
+        if (ms < compact_summary) compact_summary = ms;
+    }
+
+    // Query 2: count SAP IDs in a range (walks the identity data of every student)
+    const uint32_t low = 100000000u + (uint32_t)students / 4, high = 100000000u + (uint32_t)students / 2;
+    double legacy_range = 1e30, compact_range = 1e30;
+    long legacy_hits = 0, compact_hits = 0;
+    for (int round = 0; round < LAYOUT_BENCH_ROUNDS; round++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        legacy_hits = 0;
+        for (int i = 0; i < students; i++) {
+            uint32_t key;
+            legacy_hits += parse_sap_id(legacy[i].sap_id, &key) && key >= low && key < high;
+        }
+        double ms = elapsed_ms(&start);
+        if (ms < legacy_range) legacy_range = ms;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        compact_hits = 0;
+        for (int i = store_next_live(&student_store, 0); i < student_store.slots; i = store_next_live(&student_store, i + 1)) {
+            uint32_t key = student_at(i)->sap_id;
+            compact_hits += key >= low && key < high;
+        }
+        ms = elapsed_ms(&start);
+        if (ms < compact_range) compact_range = ms;
+    }
+
+    if (legacy_sum != marks.sum || legacy_below != attendance.below || legacy_hits != compact_hits) {
+        error_printf(C_RED "Error: the two layouts disagree.\n" C_RESET);
+        free(legacy);
+        return 1;
+    }
+
+    size_t legacy_bytes = (size_t)students * sizeof(LegacyStudent);
+    size_t compact_fixed = (size_t)students * (sizeof(Student) + 1 + 2 * subject_count);
+    size_t compact_bytes = compact_fixed + string_pool.live_bytes;
+    // The attendance log's bit columns have no counterpart in the original layout, so they are left out
+    size_t compact_reserved = (size_t)student_store.chunk_count * store_bit_columns_offset(&student_store) + string_pool_bytes(&string_pool);
+    printf("Layout benchmark: %d students (best of %d rounds, %s kernels)\n", students, LAYOUT_BENCH_ROUNDS, column_stats_kernel_name);
+    printf("                         %14s %14s\n", "original", "compact");
+    printf("  record bytes           %14zu %14zu\n", sizeof(LegacyStudent), sizeof(Student));
+    printf("  records per cache line %14.2f %14.2f\n", 64.0 / sizeof(LegacyStudent), 64.0 / sizeof(Student));
+    printf("  scores per cache line  %14.2f %14d\n", 64.0 / sizeof(LegacyStudent), 64);
+    printf("  bytes per student      %14.1f %14.1f\n", (double)legacy_bytes / students, (double)compact_bytes / students);
+    printf("  students per MB        %14.0f %14.0f\n", 1048576.0 * students / legacy_bytes, 1048576.0 * students / compact_bytes);
+    printf("  memory reserved (MB)   %14.1f %14.1f\n", legacy_bytes / 1048576.0, compact_reserved / 1048576.0);
+    printf("  build (ms)*            %14.2f %14.2f\n", legacy_build, compact_build);
+    printf("  class summary (ms)     %14.3f %14.3f\n", legacy_summary, compact_summary);
+    printf("  SAP ID range scan (ms) %14.3f %14.3f\n", legacy_range, compact_range);
+    printf("  * the compact build also maintains the SAP ID index\n");
+    free(legacy);
+    return 0;
+}
+
+// --- Concurrency Stress Test ---
+// Runs reader threads against writer threads on an in-memory roster and checks every
+// read for torn records. Writers set all six scores of a student to one value inside a
+// single record update, and now and then remove a student and add it back, so a reader
+// that ever sees mixed scores or another student's name has caught a torn read. A last
+// step adds students while the readers run, so the SAP ID index is resized under them.
+#define STRESS_STUDENTS 100000
+#define STRESS_GROWTH_STUDENTS (3 * STRESS_STUDENTS) // Enough for two index resizes
+#define STRESS_FIRST_SAP 200000000u
+#define STRESS_STEP_MS 1000
+
+typedef struct {
+    volatile bool *stop;
+    uint32_t seed;
+    uint64_t operations;
+    uint64_t misses;
+    uint64_t violations;
+} StressWorker;
+
+static inline uint32_t stress_next(uint32_t* seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+static void stress_form(uint32_t key, StudentForm* form) {
+    snprintf(form->sap_id, sizeof(form->sap_id), "%09u", key);
+    strcpy(form->credential, "$p$1$................$................................"); // Never checked
+    snprintf(form->name, sizeof(form->name), "Student %09u", key);
+}
+
+static void *stress_writer(void* arg) {
+    StressWorker *w = arg;
+    while (!__atomic_load_n(w->stop, __ATOMIC_RELAXED)) {
+        uint32_t r = stress_next(&w->seed);
+        uint32_t key = STRESS_FIRST_SAP + r % STRESS_STUDENTS;
+        pthread_mutex_lock(&student_write_lock);
+        int index = sap_index_lookup(key);
+        if (index != -1 && (r >> 24) != 0) {
+            uint8_t value = (uint8_t)((r >> 8) % 101);
+            begin_score_rewrite(index);
+            seq_write_begin(student_sequence(index));
+            for (int column = 0; column < STUDENT_COLUMNS; column++) {
+                if (student_column_in_use(column)) {
+                    *(uint8_t*)store_cell(&student_store, index, column) = value;
+                }
+            }
+            seq_write_end(student_sequence(index));
+            end_score_rewrite(index);
+        }
+        pthread_mutex_unlock(&student_write_lock);
+        if (index != -1 && (r >> 24) == 0) {
+            // Roughly one write in 256 removes the student and adds it back
+            StudentForm form;
+            stress_form(key, &form);
+            remove_student(index);
+            add_student(&form);
+        }
+        __atomic_fetch_add(&w->operations, 1, __ATOMIC_RELAXED); // Sampled between steps
+    }
+    return NULL;
+}
+
+static void *stress_reader(void* arg) {
+    StressWorker *w = arg;
+    while (!__atomic_load_n(w->stop, __ATOMIC_RELAXED)) {
+        uint32_t key = STRESS_FIRST_SAP + stress_next(&w->seed) % STRESS_STUDENTS;
+        StudentView view;
+        w->operations++;
+        if (!read_student(key, &view)) {
+            w->misses++;
+            continue;
+        }
+        char expected[50];
+        snprintf(expected, sizeof(expected), "Student %09u", key);
+        bool torn = view.sap_id != key || strcmp(view.name, expected) != 0;
+        for (int subject = 0; subject < view.subjects; subject++) {
+            torn |= view.marks[subject] != view.marks[0] || view.attendance[subject] != view.marks[0];
+        }
+        w->violations += torn;
+    }
+    return NULL;
+}
+
+// Function to run WRITERS writer threads throughout, and 1, 2, 4 ... READERS reader
+// threads in turn against them (in memory). Returns the process exit status.
+int run_stress_test(int readers, int writers) {
+    for (uint32_t i = 0; i < STRESS_STUDENTS; i++) {
+        StudentForm form;
+        stress_form(STRESS_FIRST_SAP + i, &form);
+        if (insert_student(&form) == -1) {
+            error_printf(C_RED "Error: the student store is full.\n" C_RESET);
+            return 1;
+        }
+    }
+
+    volatile bool writers_stop = false;
+    StressWorker *writer_state = calloc((size_t)writers, sizeof(StressWorker));
+    StressWorker *reader_state = calloc((size_t)readers, sizeof(StressWorker));
+    pthread_t *writer_threads = calloc((size_t)writers, sizeof(pthread_t));
+    pthread_t *reader_threads = calloc((size_t)readers, sizeof(pthread_t));
+    if (writer_state == NULL || reader_state == NULL || writer_threads == NULL || reader_threads == NULL) {
+        error_printf(C_RED "Error: not enough memory for %d threads.\n" C_RESET, readers + writers);
+        free(writer_state); free(reader_state); free(writer_threads); free(reader_threads);
+        return 1;
+    }
+    for (int i = 0; i < writers; i++) {
+        writer_state[i] = (StressWorker){ &writers_stop, 0x9e3779b9u * (uint32_t)(i + 1), 0, 0, 0 };
+        pthread_create(&writer_threads[i], NULL, stress_writer, &writer_state[i]);
+    }
+
+    printf("Stress test: %d students, %d writer thread(s), %d ms per step\n", STRESS_STUDENTS, writers, STRESS_STEP_MS);
+    printf("  %7s %14s %14s %12s %10s %10s\n", "readers", "reads/s", "per reader/s", "writes/s", "misses", "torn");
+    uint64_t total_violations = 0;
+    for (int count = 1; ; count = count * 2 > readers && count < readers ? readers : count * 2) {
+        volatile bool readers_stop = false;
+        uint64_t writes_before = 0;
+        for (int i = 0; i < writers; i++) {
+            writes_before += __atomic_load_n(&writer_state[i].operations, __ATOMIC_RELAXED);
+        }
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < count; i++) {
+            reader_state[i] = (StressWorker){ &readers_stop, 0x85ebca6bu * (uint32_t)(i + 1) + 1, 0, 0, 0 };
+            pthread_create(&reader_threads[i], NULL, stress_reader, &reader_state[i]);
+        }
+        usleep(STRESS_STEP_MS * 1000);
+        readers_stop = true;
+        uint64_t reads = 0, misses = 0, violations = 0, writes = 0;
+        for (int i = 0; i < count; i++) {
+            pthread_join(reader_threads[i], NULL);
+            reads += reader_state[i].operations;
+            misses += reader_state[i].misses;
+            violations += reader_state[i].violations;
+        }
+        double seconds = elapsed_ms(&start) / 1000.0;
+        for (int i = 0; i < writers; i++) {
+            writes += __atomic_load_n(&writer_state[i].operations, __ATOMIC_RELAXED);
+        }
+        writes -= writes_before;
+        total_violations += violations;
+        printf("  %7d %14.0f %14.0f %12.0f %10llu %10llu\n", count, reads / seconds, reads / seconds / count,
+               writes / seconds, (unsigned long long)misses, (unsigned long long)violations);
+        if (count >= readers) {
+            break;
+        }
+    }
+
+    // Grow the roster under every reader, so the index is replaced while they probe it
+    volatile bool readers_stop = false;
+    for (int i = 0; i < readers; i++) {
+        reader_state[i] = (StressWorker){ &readers_stop, 0xc2b2ae35u * (uint32_t)(i + 1) + 1, 0, 0, 0 };
+        pthread_create(&reader_threads[i], NULL, stress_reader, &reader_state[i]);
+    }
+    pthread_mutex_lock(&student_write_lock);
+    uint32_t capacity_before = sap_index_capacity;
+    pthread_mutex_unlock(&student_write_lock);
+    for (uint32_t i = 0; i < STRESS_GROWTH_STUDENTS; i++) {
+        StudentForm form;
+        stress_form(STRESS_FIRST_SAP + STRESS_STUDENTS + i, &form);
+        if (add_student(&form) == -1) {
+            error_printf(C_RED "Error: the student store is full.\n" C_RESET);
+            break;
+        }
+    }
+    pthread_mutex_lock(&student_write_lock);
+    uint32_t capacity_after = sap_index_capacity;
+    pthread_mutex_unlock(&student_write_lock);
+    int resizes = __builtin_ctz(capacity_after) - __builtin_ctz(capacity_before); // Each one doubles it
+    readers_stop = true;
+    uint64_t growth_reads = 0, growth_violations = 0;
+    for (int i = 0; i < readers; i++) {
+        pthread_join(reader_threads[i], NULL);
+        growth_reads += reader_state[i].operations;
+        growth_violations += reader_state[i].violations;
+    }
+    total_violations += growth_violations;
+    printf("  %d students added under %d reader(s): index resized %d time(s), %u -> %u slots, %llu reads, %llu torn\n",
+        STRESS_GROWTH_STUDENTS, readers, resizes, capacity_before, capacity_after,
+        (unsigned long long)growth_reads, (unsigned long long)growth_violations);
+
+    writers_stop = true;
+    for (int i = 0; i < writers; i++) {
+        pthread_join(writer_threads[i], NULL);
+    }
+    sap_index_reclaim();
+    free(writer_state); free(reader_state); free(writer_threads); free(reader_threads);
+
+    if (total_violations != 0) {
+        error_printf(C_RED "Error: %llu torn reads.\n" C_RESET, (unsigned long long)total_violations);
+        return 1;
+    }
+    printf("  No torn reads. Misses are students caught between removal and re-adding.\n");
+    if (!running_totals_verify(stderr)) {
+        return 1;
+    }
+    printf("  Running totals match a full recompute.\n");
+    return 0;
+}
+
+// --- Persistent Storage ---
+// The data directory holds students.db and teachers.db (one record store each),
+// strings.db (the string pool) and students.idx (the SAP ID hash table). All four are
+// mapped with mmap, so startup maps the files instead of parsing them, and edits write
+// through to the mapped pages. subjects.db holds the subject catalog; it is small and
+// rewritten whole whenever a subject is added.
+//
+// The store header is only brought up to date on an orderly close, which also sets its
+// clean flag. A store opened without that flag is recovered by a scan of its liveness
+// bytes, the SAP ID index is then rebuilt from the students, and the string pool's
+// free lists are rebuilt from the strings the live records refer to.
+
+char data_dir[PATH_MAX] = ""; // Empty in non-persistent mode
+
+static inline bool persistent_mode() {
+    return data_dir[0] != '\0';
+}
+
+// Function to open (creating if needed) a store's backing file and map its chunks.
+// Sets *was_clean to whether the last session closed the file properly.
+bool store_open(RecordStore* store, const char* path, bool* was_clean) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        error_printf(C_RED "Error: cannot open %s: %s\n" C_RESET, path, strerror(errno));
+        return false;
+    }
+    bool fresh = st.st_size == 0;
+    if (fresh && ftruncate(fd, STORE_HEADER_BYTES) != 0) {
+        error_printf(C_RED "Error: cannot initialise %s: %s\n" C_RESET, path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (fresh) {
+        st.st_size = STORE_HEADER_BYTES;
+    }
+    StoreFileHeader *header = mmap(NULL, STORE_HEADER_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        error_printf(C_RED "Error: cannot map %s: %s\n" C_RESET, path, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    if (fresh) {
+        memcpy(header->magic, STORE_FILE_MAGIC, sizeof(header->magic));
+        header->version = DATA_FORMAT_VERSION;
+        header->record_size = (uint32_t)store->record_size;
+        header->column_bytes = (uint32_t)(store->column_count * store->column_width);
+        header->bit_columns = (uint32_t)store->bit_column_count;
+        header->chunk_records = STORE_CHUNK_RECORDS;
+        header->clean = 1;
+        header->free_head = -1;
+    } else {
+        const char *problem = NULL;
+        if (memcmp(header->magic, STORE_FILE_MAGIC, sizeof(header->magic)) != 0) {
+            problem = "not a data file";
+        } else if (header->version != DATA_FORMAT_VERSION) {
+            problem = "written by an incompatible version";
+        } else if (header->record_size != store->record_size || header->chunk_records != STORE_CHUNK_RECORDS
+                   || header->column_bytes != store->column_count * store->column_width
+                   || header->bit_columns != (uint32_t)store->bit_column_count) {
+            problem = "record layout does not match";
+        }
+        if (problem != NULL) {
+            error_printf(C_RED "Error: %s: %s (format version %u, expected %u).\n" C_RESET,
+                path, problem, header->version, DATA_FORMAT_VERSION);
+            munmap(header, STORE_HEADER_BYTES);
+            close(fd);
+            return false;
+        }
+    }
+
+    store->fd = fd;
+    store->file_header = header;
+    *was_clean = header->clean == 1;
+
+    // After a crash the header may lag behind the file, so trust the file size instead
+    size_t stride = store_chunk_stride(store);
+    int chunk_count = header->chunk_count;
+    if (!*was_clean) {
+        chunk_count = (int)((st.st_size - STORE_HEADER_BYTES) / (off_t)stride);
+    }
+    if (chunk_count > STORE_MAX_CHUNKS || store_chunk_offset(store, chunk_count) > st.st_size) {
+        error_printf(C_RED "Error: %s is truncated or corrupt.\n" C_RESET, path);
+        return false;
+    }
+
+    // Map every existing chunk with a single call; new chunks get their own mappings
+    if (chunk_count > 0) {
+        char *body = mmap(NULL, (size_t)chunk_count * stride, PROT_READ | PROT_WRITE, MAP_SHARED, fd, STORE_HEADER_BYTES);
+        if (body == MAP_FAILED) {
+            error_printf(C_RED "Error: cannot map %s: %s\n" C_RESET, path, strerror(errno));
+            return false;
+        }
+        for (int i = 0; i < chunk_count; i++) {
+            store->chunks[i] = body + (size_t)i * stride;
+        }
+    }
+    store->chunk_count = chunk_count;
+    store->slots = header->slots;
+    store->count = header->count;
+    store->free_head = header->free_head;
+    memcpy(store->chunk_live, header->chunk_live, sizeof(store->chunk_live));
+
+    // Mark the file in use until it is closed properly
+    header->clean = 0;
+    msync(header, FILE_PAGE_BYTES, MS_SYNC);
+    return true;
+}
+
+// Function to rebuild a store's bookkeeping from its liveness bytes after a crash
+void store_recover(RecordStore* store) {
+    store->slots = 0;
+    store->count = 0;
+    store->free_head = -1;
+    for (int chunk = 0; chunk < store->chunk_count; chunk++) {
+        store->chunk_live[chunk] = 0;
+        for (int i = chunk << STORE_CHUNK_SHIFT; i < (chunk + 1) << STORE_CHUNK_SHIFT; i++) {
+            if (*store_live_flag(store, i)) {
+                store->chunk_live[chunk]++;
+                store->count++;
+                store->slots = i + 1;
+            }
+        }
+    }
+    // Chain dead slots so the lowest is reused first
+    for (int i = store->slots - 1; i >= 0; i--) {
+        if (!*store_live_flag(store, i)) {
+            *store_free_link(store, i) = store->free_head;
+            store->free_head = i;
+        }
+    }
+}
+
+// Function to flush a store, record its bookkeeping, mark it clean and unmap it
+void store_close(RecordStore* store) {
+    if (store->fd == -1) {
+        return;
+    }
+    StoreFileHeader *header = store->file_header;
+    header->slots = store->slots;
+    header->count = store->count;
+    header->free_head = store->free_head;
+    header->chunk_count = store->chunk_count;
+    memcpy(header->chunk_live, store->chunk_live, sizeof(header->chunk_live));
+    fsync(store->fd);
+    header->clean = 1;
+    msync(header, FILE_PAGE_BYTES, MS_SYNC);
+
+    for (int i = 0; i < store->chunk_count; i++) {
+        munmap(store->chunks[i], store_chunk_stride(store));
+        store->chunks[i] = NULL;
+    }
+    munmap(header, STORE_HEADER_BYTES);
+    close(store->fd);
+    store->fd = -1;
+    store->file_header = NULL;
+}
+
+// Function to open (creating if needed) the string pool's backing file and map it.
+// Sets *was_clean to whether the last session closed the file properly.
+bool string_pool_open(StringPool* pool, const char* path, bool* was_clean) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        error_printf(C_RED "Error: cannot open %s: %s\n" C_RESET, path, strerror(errno));
+        return false;
+    }
+    bool fresh = st.st_size == 0;
+    if (fresh && ftruncate(fd, FILE_PAGE_BYTES) != 0) {
+        error_printf(C_RED "Error: cannot initialise %s: %s\n" C_RESET, path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (fresh) {
+        st.st_size = FILE_PAGE_BYTES;
+    }
+    StringPoolFileHeader *header = mmap(NULL, FILE_PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        error_printf(C_RED "Error: cannot map %s: %s\n" C_RESET, path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (fresh) {
+        memcpy(header->magic, STRING_POOL_FILE_MAGIC, sizeof(header->magic));
+        header->version = DATA_FORMAT_VERSION;
+        header->chunk_bytes = STRING_POOL_CHUNK_BYTES;
+        header->clean = 1;
+    } else if (memcmp(header->magic, STRING_POOL_FILE_MAGIC, sizeof(header->magic)) != 0
+               || header->version != DATA_FORMAT_VERSION || header->chunk_bytes != STRING_POOL_CHUNK_BYTES) {
+        error_printf(C_RED "Error: %s: not a string pool of this version (format version %u, expected %u).\n" C_RESET,
+            path, header->version, DATA_FORMAT_VERSION);
+        munmap(header, FILE_PAGE_BYTES);
+        close(fd);
+        return false;
+    }
+
+    pool->fd = fd;
+    pool->file_header = header;
+    *was_clean = header->clean == 1;
+
+    int chunk_count = *was_clean ? (int)header->chunk_count
+                                 : (int)((st.st_size - FILE_PAGE_BYTES) / STRING_POOL_CHUNK_BYTES);
+    if (chunk_count > STRING_POOL_MAX_CHUNKS
+        || FILE_PAGE_BYTES + (off_t)chunk_count * STRING_POOL_CHUNK_BYTES > st.st_size) {
+        error_printf(C_RED "Error: %s is truncated or corrupt.\n" C_RESET, path);
+        return false;
+    }
+    if (chunk_count > 0) {
+        char *body = mmap(NULL, (size_t)chunk_count * STRING_POOL_CHUNK_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, FILE_PAGE_BYTES);
+        if (body == MAP_FAILED) {
+            error_printf(C_RED "Error: cannot map %s: %s\n" C_RESET, path, strerror(errno));
+            return false;
+        }
+        for (int i = 0; i < chunk_count; i++) {
+            pool->chunks[i] = body + (size_t)i * STRING_POOL_CHUNK_BYTES;
+        }
+    }
+    pool->chunk_count = chunk_count;
+    pool->next = header->next;
+    pool->live_bytes = header->live_bytes;
+    memcpy(pool->free_heads, header->free_heads, sizeof(pool->free_heads));
+
+    header->clean = 0;
+    msync(header, FILE_PAGE_BYTES, MS_SYNC);
+    return true;
+}
+
+// Function to mark a string's granules in use while recovering the pool. Returns the
+// offset just past its block, or 0 if the handle does not point into the pool.
+static uint64_t string_pool_claim(StringPool* pool, uint8_t* used, uint32_t handle) {
+    if (handle == 0 || handle % STRING_GRANULE != 0 || handle >= string_pool_bytes(pool)) {
+        return 0;
+    }
+    uint32_t granules = string_granules(strnlen(string_at(pool, handle), STRING_SIZE_CLASSES * STRING_GRANULE));
+    for (uint32_t g = handle / STRING_GRANULE; g < handle / STRING_GRANULE + granules; g++) {
+        used[g >> 3] |= (uint8_t)(1 << (g & 7));
+    }
+    pool->live_bytes += (uint64_t)granules * STRING_GRANULE;
+    return handle + (uint64_t)granules * STRING_GRANULE;
+}
+
+// Function to rebuild the pool's bookkeeping after a crash from the strings that live
+// students and teachers still refer to. Every other granule below the end of the last
+// such string goes back on the free lists. Call after the record stores are recovered.
+bool string_pool_recover(StringPool* pool) {
+    uint64_t granule_count = string_pool_bytes(pool) / STRING_GRANULE;
+    uint8_t *used = calloc(granule_count / 8 + 1, 1);
+    if (used == NULL) {
+        return false;
+    }
+    used[0] = 1; // Handle 0 is reserved
+    pool->live_bytes = 0;
+    pool->next = STRING_GRANULE;
+    memset(pool->free_heads, 0, sizeof(pool->free_heads));
+    for (int i = store_next_live(&student_store, 0); i < student_store.slots; i = store_next_live(&student_store, i + 1)) {
+        uint64_t end = string_pool_claim(pool, used, student_at(i)->name);
+        if (end > pool->next) pool->next = end;
+        end = string_pool_claim(pool, used, student_at(i)->credential);
+        if (end > pool->next) pool->next = end;
+    }
+    for (int i = store_next_live(&teacher_store, 0); i < teacher_store.slots; i = store_next_live(&teacher_store, i + 1)) {
+        uint64_t end = string_pool_claim(pool, used, teacher_at(i)->username);
+        if (end > pool->next) pool->next = end;
+        end = string_pool_claim(pool, used, teacher_at(i)->credential);
+        if (end > pool->next) pool->next = end;
+    }
+
+    // Free runs never cross a chunk boundary, since chunks need not be adjacent in memory
+    uint64_t limit = pool->next / STRING_GRANULE;
+    const uint64_t chunk_granules = STRING_POOL_CHUNK_BYTES / STRING_GRANULE;
+    uint64_t g = 0;
+    while (g < limit) {
+        if (used[g >> 3] & (1 << (g & 7))) {
+            g++;
+            continue;
+        }
+        uint64_t run_end = g + 1;
+        uint64_t chunk_end = (g / chunk_granules + 1) * chunk_granules;
+        while (run_end < limit && run_end < chunk_end && !(used[run_end >> 3] & (1 << (run_end & 7)))) {
+            run_end++;
+        }
+        string_pool_push_free(pool, (uint32_t)(g * STRING_GRANULE), (uint32_t)(run_end - g));
+        g = run_end;
+    }
+    free(used);
+    return true;
+}
+
+// Function to flush the string pool, record its bookkeeping, mark it clean and unmap it
+void string_pool_close(StringPool* pool) {
+    if (pool->fd == -1) {
+        return;
+    }
+    StringPoolFileHeader *header = pool->file_header;
+    header->chunk_count = (uint32_t)pool->chunk_count;
+    header->next = pool->next;
+    header->live_bytes = pool->live_bytes;
+    memcpy(header->free_heads, pool->free_heads, sizeof(header->free_heads));
+    fsync(pool->fd);
+    header->clean = 1;
+    msync(header, FILE_PAGE_BYTES, MS_SYNC);
+
+    for (int i = 0; i < pool->chunk_count; i++) {
+        munmap(pool->chunks[i], STRING_POOL_CHUNK_BYTES);
+        pool->chunks[i] = NULL;
+    }
+    munmap(header, FILE_PAGE_BYTES);
+    close(pool->fd);
+    pool->fd = -1;
+    pool->file_header = NULL;
+}
+
+// Function to map a saved SAP ID index. Returns false if it is missing or unusable.
+bool sap_index_open(const char* path) {
+    int fd = open(path, O_RDWR);
+    struct stat st;
+    if (fd == -1) {
+        return false;
+    }
+    SapIndexFileHeader header;
+    if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+        || memcmp(header.magic, SAP_INDEX_FILE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != DATA_FORMAT_VERSION
+        || header.capacity < SAP_INDEX_MIN_CAPACITY || (header.capacity & (header.capacity - 1)) != 0
+        || header.shift != 32 - (uint32_t)__builtin_ctz(header.capacity)
+        || (size_t)st.st_size != sap_index_file_bytes(header.capacity)) {
+        close(fd);
+        return false;
+    }
+    char *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    sap_index = (SapIndexSlot*)(map + FILE_PAGE_BYTES);
+    sap_index_capacity = header.capacity;
+    sap_index_shift = header.shift;
+    sap_index_size = header.size;
+    sap_index_fd = fd;
+    free(sap_index_publish()); // Nothing reads the index before the data is open
+    return true;
+}
+
+// Function to rebuild the SAP ID index from every live student. A crash in the middle
+// of compaction can leave a record both at its old and its new slot; the copy in the
+// higher slot is dropped.
+void rebuild_student_index() {
+    sap_index_reset();
+    sap_index_reserve((uint32_t)student_store.count);
+    for (int i = store_next_live(&student_store, 0); i < student_store.slots; i = store_next_live(&student_store, i + 1)) {
+        if (sap_index_lookup(student_at(i)->sap_id) != -1) {
+            store_release(&student_store, i);
+            continue;
+        }
+        index_student(i);
+    }
+}
+
+#define SUBJECT_FILE_MAGIC "CAGSSUB"
+
+typedef struct {
+    char magic[8];   // SUBJECT_FILE_MAGIC
+    uint32_t version; // DATA_FORMAT_VERSION
+    uint32_t count;
+    char names[SUBJECT_MAX][SUBJECT_NAME_BYTES];
+} SubjectFile;
+
+// Function to write the first count subjects to DIR/subjects.db. The new file is synced
+// and renamed over the old one, so a crash leaves either catalog, never half of one.
+static bool save_subject_catalog(const char* dir, int count) {
+    SubjectFile file;
+    memset(&file, 0, sizeof(file));
+    memcpy(file.magic, SUBJECT_FILE_MAGIC, sizeof(file.magic));
+    file.version = DATA_FORMAT_VERSION;
+    file.count = (uint32_t)count;
+    memcpy(file.names, subject_names, sizeof(file.names));
+
+    char path[PATH_MAX + 16], tmp_path[PATH_MAX + 24];
+    snprintf(path, sizeof(path), "%s/subjects.db", dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    bool ok = write(fd, &file, sizeof(file)) == (ssize_t)sizeof(file) && fsync(fd) == 0;
+    ok &= close(fd) == 0;
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+// Function to load DIR/subjects.db, creating it with the default subjects if missing
+static bool load_subject_catalog(const char* dir) {
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/subjects.db", dir);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        if (errno == ENOENT && save_subject_catalog(dir, subject_count)) {
+            return true;
+        }
+        error_printf(C_RED "Error: cannot open %s: %s\n" C_RESET, path, strerror(errno));
+        return false;
+    }
+    SubjectFile file;
+    bool ok = read(fd, &file, sizeof(file)) == (ssize_t)sizeof(file)
+        && memcmp(file.magic, SUBJECT_FILE_MAGIC, sizeof(file.magic)) == 0
+        && file.version == DATA_FORMAT_VERSION && file.count >= 1 && file.count <= SUBJECT_MAX;
+    close(fd);
+    if (!ok) {
+        error_printf(C_RED "Error: %s is corrupt or written by an incompatible version.\n" C_RESET, path);
+        return false;
+    }
+    memcpy(subject_names, file.names, sizeof(subject_names));
+    for (int subject = 0; subject < SUBJECT_MAX; subject++) {
+        subject_names[subject][SUBJECT_NAME_BYTES - 1] = '\0';
+    }
+    subject_count = (int)file.count;
+    return true;
+}
+
+// Function to open the data directory, recovering from an unclean shutdown if needed
+bool open_data_store(const char* dir) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        error_printf(C_RED "Error: cannot create data directory %s: %s\n" C_RESET, dir, strerror(errno));
+        return false;
+    }
+    snprintf(data_dir, sizeof(data_dir), "%s", dir);
+    if (!load_subject_catalog(dir)) {
+        return false;
+    }
+
+    char path[PATH_MAX + 16];
+    bool students_clean, teachers_clean;
+    snprintf(path, sizeof(path), "%s/students.db", dir);
+    if (!store_open(&student_store, path, &students_clean)) {
+        return false;
+    }
+    snprintf(path, sizeof(path), "%s/teachers.db", dir);
+    if (!store_open(&teacher_store, path, &teachers_clean)) {
+        return false;
+    }
+    if (!teachers_clean) {
+        store_recover(&teacher_store);
+    }
+    bool strings_clean;
+    snprintf(path, sizeof(path), "%s/strings.db", dir);
+    if (!string_pool_open(&string_pool, path, &strings_clean)) {
+        return false;
+    }
+
+    snprintf(sap_index_path, sizeof(sap_index_path), "%s/students.idx", dir);
+    if (!students_clean) {
+        error_printf(C_YELLOW "Previous session did not shut down cleanly; recovering student data...\n" C_RESET);
+        store_recover(&student_store);
+        rebuild_student_index();
+    } else if (!sap_index_open(sap_index_path)) {
+        rebuild_student_index();
+    }
+    if ((!strings_clean || !students_clean || !teachers_clean) && !string_pool_recover(&string_pool)) {
+        error_printf(C_RED "Error: out of memory while recovering %s/strings.db\n" C_RESET, dir);
+        return false;
+    }
+    rebuild_teacher_index();
+    running_totals_rebuild(); // Replay adjusts them from here
+    for (int subject = 0; subject < subject_count; subject++) {
+        attendance_sessions[subject] = student_store.file_header->sessions[subject] < SESSION_MAX
+            ? student_store.file_header->sessions[subject] : SESSION_MAX;
+    }
+
+    // Redo anything journaled after the last checkpoint, then keep journaling
+    snprintf(path, sizeof(path), "%s/journal.wal", dir);
+    uint64_t last_lsn;
+    long replayed = wal_replay(path, student_store.file_header->checkpoint_lsn, &last_lsn);
+    if (replayed > 0) {
+        error_printf(C_YELLOW "Replayed %ld journaled changes since the last checkpoint.\n" C_RESET, replayed);
+    }
+    if (!wal_open(&wal, path, last_lsn + 1)) {
+        return false;
+    }
+
+    error_printf("Loaded " C_CYAN "%d" C_RESET " students and " C_CYAN "%d" C_RESET " teachers from %s in %.2f ms.\n",
+        student_store.count, teacher_store.count, dir, elapsed_ms(&start));
+    return true;
+}
+
+// Function to flush everything to disk and mark the data directory clean
+void close_data_store() {
+    if (!persistent_mode()) {
+        return;
+    }
+    wal_checkpoint(&wal);
+    wal_close(&wal);
+    if (sap_index_fd != -1) {
+        sap_index_file_header()->size = sap_index_size;
+        fsync(sap_index_fd);
+    }
+    store_close(&teacher_store);
+    string_pool_close(&string_pool);
+    store_close(&student_store); // Last, so a clean students.db implies a current index
+}
+
+// Function to add a subject at the end of the catalog, with every student starting at 0
+// marks and 0 attendance in it (their cells in its columns have never been written).
+// The catalog is saved before the subject can be used, so journaled scores for it
+// always find it on replay. Returns the new subject, or -1 with *problem set.
+int add_subject(const char* name, const char** problem) {
+    *problem = subject_name_problem(name);
+    if (*problem == NULL && subject_count >= SUBJECT_MAX) {
+        *problem = "the subject catalog is full";
+    }
+    if (*problem != NULL) {
+        return -1;
+    }
+    int subject = subject_count;
+    snprintf(subject_names[subject], SUBJECT_NAME_BYTES, "%s", name);
+    if (persistent_mode() && !save_subject_catalog(data_dir, subject + 1)) {
+        subject_names[subject][0] = '\0';
+        *problem = "could not save the subject catalog";
+        return -1;
+    }
+    running_totals_add_subject(subject);
+    // Lock-free readers size their copy by the count, so it is published last
+    __atomic_store_n(&subject_count, subject + 1, __ATOMIC_RELEASE);
+    return subject;
+}
+
+// --- Bulk Roster Import ---
+// Non-interactive loading of a roster file, one student per line:
+//
+//     sap_id,password,name[,marks_maths,marks_physics,marks_coding,
+//                          attendance_maths,attendance_physics,attendance_coding]
+//
+// with a mark for each of the first N subjects in the catalog, in catalog order, then an
+// attendance figure for each of them (the example has the default three). Subjects
+// after those N start at 0, so a roster written before a subject was added still loads.
+//
+// Fields are separated by tabs if the first line contains one, otherwise by commas
+// (CSV fields may be double-quoted, with "" for a literal quote). A first line whose
+// first field is not a number is taken as a header and skipped. Every line is parsed
+// in place, so the import allocates nothing per row. Rejected rows are counted by
+// reason and the first few are listed in a single report at the end.
+//
+// The password field is hashed as the row is parsed, which dominates the import time
+// (several milliseconds per row at the default cost). A field that is already a
+// credential ("$p$...", e.g. exported from another data directory) is stored as is.
+//
+// A regular file is mapped and cut into one range per thread at line boundaries. The
+// threads parse and validate their ranges into row arrays that point into the mapping,
+// and the main thread then merges the arrays into the store in file order, checking
+// SAP ID uniqueness as it goes. Pipes and stdin are streamed in large blocks instead.
+#define IMPORT_BLOCK_BYTES (1 << 20)
+#define IMPORT_MAX_FIELDS (3 + 2 * SUBJECT_MAX)
+#define IMPORT_MAX_LISTED 20
+#define IMPORT_MIN_BYTES_PER_THREAD 4096 // Per thread; hashing makes even small files worth splitting
+
+typedef struct {
+    long line;
+    char text[104];
+} ImportProblem;
+
+typedef struct {
+    long rows;
+    long imported;
+    long bad_sap;
+    long bad_field;
+    long duplicate_in_file;
+    long already_registered;
+    int listed;
+    ImportProblem listing[IMPORT_MAX_LISTED];
+} ImportReport;
+
+typedef struct {
+    char *start;
+    size_t length;
+} ImportField;
+
+// A validated row, still pointing into the input buffer for its name
+typedef struct {
+    const char *name;
+    long line;
+    uint32_t key;
+    uint8_t name_length;
+    bool has_scores;
+    uint8_t marks[SUBJECT_MAX];
+    uint8_t attendance[SUBJECT_MAX];
+    char credential[CREDENTIAL_BYTES];
+} ImportRow;
+
+// Open-addressing set of the SAP IDs added by the current import, so a duplicate can be
+// told apart from a student who was registered before the import started
+typedef struct {
+    uint32_t *keys;
+    uint32_t capacity;
+    uint32_t size;
+} KeySet;
+
+static bool key_set_add(KeySet* set, uint32_t key) {
+    if ((uint64_t)(set->size + 1) * 10 > (uint64_t)set->capacity * 7) {
+        uint32_t capacity = set->capacity ? set->capacity * 2 : 1024;
+        uint32_t *keys = malloc(capacity * sizeof(uint32_t));
+        if (keys == NULL) {
+            return false;
+        }
+        for (uint32_t i = 0; i < capacity; i++) {
+            keys[i] = SAP_INDEX_EMPTY;
+        }
+        for (uint32_t i = 0; i < set->capacity; i++) {
+            if (set->keys[i] != SAP_INDEX_EMPTY) {
+                uint32_t j = (set->keys[i] * 2654435769u) & (capacity - 1);
+                while (keys[j] != SAP_INDEX_EMPTY) j = (j + 1) & (capacity - 1);
+                keys[j] = set->keys[i];
+            }
+        }
+        free(set->keys);
+        set->keys = keys;
+        set->capacity = capacity;
+    }
+    uint32_t j = (key * 2654435769u) & (set->capacity - 1);
+    while (set->keys[j] != SAP_INDEX_EMPTY) {
+        if (set->keys[j] == key) {
+            return false;
+        }
+        j = (j + 1) & (set->capacity - 1);
+    }
+    set->keys[j] = key;
+    set->size++;
+    return true;
+}
+
+static bool key_set_contains(const KeySet* set, uint32_t key) {
+    if (set->size == 0) {
+        return false;
+    }
+    uint32_t j = (key * 2654435769u) & (set->capacity - 1);
+    while (set->keys[j] != SAP_INDEX_EMPTY) {
+        if (set->keys[j] == key) {
+            return true;
+        }
+        j = (j + 1) & (set->capacity - 1);
+    }
+    return false;
+}
+
+// Function to note a problem in a report's listing, quoting the offending field if given
+static void import_list_problem(ImportProblem* listing, int* listed, long line, const char* reason, const ImportField* field) {
+    if (*listed < IMPORT_MAX_LISTED) {
+        ImportProblem *problem = &listing[(*listed)++];
+        int shown = field != NULL ? (int)(field->length < 40 ? field->length : 40) : 0;
+        problem->line = line;
+        snprintf(problem->text, sizeof(problem->text), "%s%s%.*s%s",
+            reason, field != NULL ? " '" : "", shown, field != NULL ? field->start : "", field != NULL ? "'" : "");
+    }
+}
+
+static void import_reject(ImportReport* report, long line, long* counter, const char* reason, const ImportField* field) {
+    (*counter)++;
+    import_list_problem(report->listing, &report->listed, line, reason, field);
+}
+
+// Function to find the next delimiter in [p, end), or end if there is none. The length
+// is only taken once p < end, so it is never negative.
+static inline char *import_next_delimiter(char* p, char* end, char delimiter) {
+    char *next = p < end ? memchr(p, delimiter, (size_t)(end - p)) : NULL;
+    return next != NULL ? next : end;
+}
+
+// Function to split one line into fields in place. Quoted CSV fields are unquoted in
+// place. Returns the number of fields found.
+static int import_split(char* line, size_t length, char delimiter, ImportField* fields) {
+    int count = 0;
+    char *p = line;
+    char *end = line + length;
+    while (count < IMPORT_MAX_FIELDS) {
+        while (p < end && (*p == ' ' || (*p == '\t' && delimiter != '\t'))) p++;
+        ImportField *f = &fields[count++];
+        if (delimiter == ',' && p < end && *p == '"') {
+            // Quoted field: copy down over the quotes
+            char *out = ++p;
+            f->start = out;
+            while (p < end) {
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"') {
+                        *out++ = '"';
+                        p += 2;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                *out++ = *p++;
+            }
+            f->length = (size_t)(out - f->start);
+            p = import_next_delimiter(p, end, delimiter);
+        } else {
+            f->start = p;
+            char *next = import_next_delimiter(p, end, delimiter);
+            char *field_end = next;
+            while (field_end > p && (field_end[-1] == ' ' || field_end[-1] == '\r')) field_end--;
+            f->length = (size_t)(field_end - p);
+            p = next;
+        }
+        if (p >= end) {
+            break;
+        }
+        p++; // Skip the delimiter
+    }
+    return count;
+}
+
+static bool import_parse_score(const ImportField* f, uint8_t* value) {
+    if (f->length == 0 || f->length > 3) {
+        return false;
+    }
+    int v = 0;
+    for (size_t i = 0; i < f->length; i++) {
+        if (f->start[i] < '0' || f->start[i] > '9') {
+            return false;
+        }
+        v = v * 10 + (f->start[i] - '0');
+    }
+    if (v > 100) {
+        return false;
+    }
+    *value = (uint8_t)v;
+    return true;
+}
+
+static bool import_field_is_token(const ImportField* f, size_t max_length) {
+    if (f->length == 0 || f->length > max_length) {
+        return false;
+    }
+    for (size_t i = 0; i < f->length; i++) {
+        if (f->start[i] == ' ' || f->start[i] == '\t') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to parse and validate one roster line. Returns false for blank lines and
+// rejected rows (which are recorded in the report). Safe to call from any thread.
+static bool import_parse_line(char* line, size_t length, long line_number, char delimiter, ImportRow* row, ImportReport* report) {
+    if (length > 0 && line[length - 1] == '\r') {
+        length--;
+    }
+    if (length == 0) {
+        return false; // Blank lines are ignored
+    }
+    report->rows++;
+
+    ImportField fields[IMPORT_MAX_FIELDS];
+    int count = import_split(line, length, delimiter, fields);
+
+    char sap_id[SAP_ID_LENGTH + 1];
+    if (fields[0].length != SAP_ID_LENGTH) {
+        import_reject(report, line_number, &report->bad_sap, "SAP ID is not 9 digits", &fields[0]);
+        return false;
+    }
+    memcpy(sap_id, fields[0].start, SAP_ID_LENGTH);
+    sap_id[SAP_ID_LENGTH] = '\0';
+    if (!parse_sap_id(sap_id, &row->key)) {
+        import_reject(report, line_number, &report->bad_sap, "SAP ID is not 9 digits", &fields[0]);
+        return false;
+    }
+    int scored = (count - 3) / 2;
+    if (count < 3 || count % 2 == 0 || scored > subject_count) {
+        import_reject(report, line_number, &report->bad_field, "expected 3 fields, then a mark and attendance per subject", NULL);
+        return false;
+    }
+    bool hashed = fields[1].length < CREDENTIAL_BYTES && fields[1].length > 3 && memcmp(fields[1].start, "$p$", 3) == 0;
+    if (hashed) {
+        memcpy(row->credential, fields[1].start, fields[1].length);
+        row->credential[fields[1].length] = '\0';
+        if (!credential_is_valid(row->credential)) {
+            import_reject(report, line_number, &report->bad_field, "malformed password hash", NULL);
+            return false;
+        }
+    } else if (!import_field_is_token(&fields[1], STUDENT_PASSWORD_MAX)) {
+        import_reject(report, line_number, &report->bad_field, "password must be 1-19 chars without spaces", NULL);
+        return false;
+    }
+    if (fields[2].length == 0 || fields[2].length >= sizeof(((StudentForm*)0)->name)) {
+        import_reject(report, line_number, &report->bad_field, "name must be 1-49 chars", &fields[2]);
+        return false;
+    }
+
+    row->name = fields[2].start;
+    row->name_length = (uint8_t)fields[2].length;
+    row->line = line_number;
+    row->has_scores = scored > 0;
+    memset(row->marks, 0, sizeof(row->marks));
+    memset(row->attendance, 0, sizeof(row->attendance));
+    for (int subject = 0; subject < scored; subject++) {
+        if (!import_parse_score(&fields[3 + subject], &row->marks[subject])
+            || !import_parse_score(&fields[3 + scored + subject], &row->attendance[subject])) {
+            import_reject(report, line_number, &report->bad_field, "marks and attendance must be 0-100", NULL);
+            return false;
+        }
+    }
+    // Hashed last, so rejected rows cost nothing
+    if (!hashed) {
+        char password[STUDENT_PASSWORD_MAX + 1];
+        memcpy(password, fields[1].start, fields[1].length);
+        password[fields[1].length] = '\0';
+        hash_password(password, row->credential);
+    }
+    return true;
+}
+
+// Function to add a validated row to the store after checking its SAP ID is unique.
+// Must run on the thread that owns the stores.
+static void import_commit_row(const ImportRow* row, KeySet* added, ImportReport* report) {
+    if (sap_index_lookup(row->key) != -1) {
+        ImportField id = { NULL, SAP_ID_LENGTH };
+        char sap_id[SAP_ID_LENGTH + 1];
+        snprintf(sap_id, sizeof(sap_id), "%09u", row->key);
+        id.start = sap_id;
+        if (key_set_contains(added, row->key)) {
+            import_reject(report, row->line, &report->duplicate_in_file, "duplicate SAP ID in file", &id);
+        } else {
+            import_reject(report, row->line, &report->already_registered, "SAP ID already registered", &id);
+        }
+        return;
+    }
+
+    StudentForm s;
+    memset(&s, 0, sizeof(s));
+    snprintf(s.sap_id, sizeof(s.sap_id), "%09u", row->key);
+    strcpy(s.credential, row->credential);
+    memcpy(s.name, row->name, row->name_length);
+    int index = insert_student(&s);
+    if (index == -1 || !key_set_add(added, row->key)) {
+        import_reject(report, row->line, &report->bad_field, "out of memory or store full", NULL);
+        return;
+    }
+    if (row->has_scores) {
+        begin_score_rewrite(index);
+        for (int subject = 0; subject < subject_count; subject++) {
+            *student_mark(index, subject) = row->marks[subject];
+            *student_attendance(index, subject) = row->attendance[subject];
+        }
+        end_score_rewrite(index);
+    }
+    report->imported++;
+}
+
+// Function to fold a worker's report into the total, renumbering its lines
+static void import_merge_report(ImportReport* total, const ImportReport* part, long line_base) {
+    total->rows += part->rows;
+    total->bad_sap += part->bad_sap;
+    total->bad_field += part->bad_field;
+    for (int i = 0; i < part->listed && total->listed < IMPORT_MAX_LISTED; i++) {
+        total->listing[total->listed] = part->listing[i];
+        total->listing[total->listed].line += line_base;
+        total->listed++;
+    }
+}
+
+// Function to look at the first line: pick the delimiter and say whether it is a header
+static char *import_detect_format(char* data, char* end, char* delimiter) {
+    char *newline = memchr(data, '\n', (size_t)(end - data));
+    char *line_end = newline != NULL ? newline : end;
+    *delimiter = memchr(data, '\t', (size_t)(line_end - data)) != NULL ? '\t' : ',';
+    if (data < line_end && (*data < '0' || *data > '9')) {
+        return newline != NULL ? newline + 1 : end; // Skip the header row
+    }
+    return data;
+}
+
+// --- Streaming import (pipes and stdin) ---
+
+static bool import_stream(int fd, const char* path, KeySet* added, ImportReport* report) {
+    char *buffer = malloc(IMPORT_BLOCK_BYTES);
+    if (buffer == NULL) {
+        error_printf(C_RED "Error: out of memory for the import buffer.\n" C_RESET);
+        return false;
+    }
+    size_t have = 0;
+    long line_number = 0;
+    char delimiter = 0;
+    bool eof = false;
+    bool skipping_long_line = false;
+
+    while (!eof) {
+        ssize_t n = read(fd, buffer + have, IMPORT_BLOCK_BYTES - have);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            error_printf(C_RED "Error: reading %s failed: %s\n" C_RESET, path, strerror(errno));
+            break;
+        }
+        eof = n == 0;
+        have += (size_t)n;
+
+        char *p = buffer;
+        char *end = buffer + have;
+        while (p < end) {
+            char *newline = memchr(p, '\n', (size_t)(end - p));
+            if (newline == NULL && !eof) {
+                break; // Partial line: wait for the next block
+            }
+            char *line_end = newline != NULL ? newline : end;
+            line_number++;
+            if (skipping_long_line) {
+                skipping_long_line = false; // Tail of an over-long line
+            } else if (delimiter == 0 && import_detect_format(p, end, &delimiter) != p) {
+                // Header row skipped
+            } else {
+                ImportRow row;
+                if (import_parse_line(p, (size_t)(line_end - p), line_number, delimiter, &row, report)) {
+                    import_commit_row(&row, added, report);
+                }
+            }
+            p = line_end + 1;
+        }
+
+        // Move the unfinished line to the front for the next read
+        have = p < end ? (size_t)(end - p) : 0;
+        if (have == IMPORT_BLOCK_BYTES) {
+            line_number++;
+            report->rows++;
+            import_reject(report, line_number, &report->bad_field, "line too long", NULL);
+            skipping_long_line = true;
+            have = 0;
+        } else if (have > 0) {
+            memmove(buffer, p, have);
+        }
+    }
+    free(buffer);
+    return true;
+}
+
+// --- Parallel import (regular files) ---
+
+typedef struct {
+    char *start;         // First byte of this worker's range (always at a line start)
+    char *end;           // One past its last byte (just after a newline, or end of file)
+    char delimiter;
+    ImportRow *rows;     // Valid rows in file order
+    long row_count;
+    long row_capacity;
+    long lines;          // Lines in the range, to renumber the next range
+    bool out_of_memory;
+    ImportReport report; // Rows read and rows rejected while parsing
+} ImportWorker;
+
+static void *import_worker(void* arg) {
+    ImportWorker *w = arg;
+    char *p = w->start;
+    while (p < w->end) {
+        char *newline = memchr(p, '\n', (size_t)(w->end - p));
+        char *line_end = newline != NULL ? newline : w->end;
+        w->lines++;
+        if (w->row_count == w->row_capacity) {
+            long capacity = w->row_capacity ? w->row_capacity * 2 : 4096;
+            ImportRow *rows = realloc(w->rows, capacity * sizeof(ImportRow));
+            if (rows == NULL) {
+                w->out_of_memory = true;
+                break;
+            }
+            w->rows = rows;
+            w->row_capacity = capacity;
+        }
+        if (import_parse_line(p, (size_t)(line_end - p), w->lines, w->delimiter, &w->rows[w->row_count], &w->report)) {
+            w->row_count++;
+        }
+        p = line_end + 1;
+    }
+    return NULL;
+}
+
+static bool import_parallel(char* data, size_t size, int threads, KeySet* added, ImportReport* report, double* parse_ms) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    char *end = data + size;
+    char delimiter;
+    char *body = import_detect_format(data, end, &delimiter);
+    long header_lines = body != data ? 1 : 0;
+
+    // Cut the body into equal ranges, moving each cut forward to the next line start
+    ImportWorker *workers = calloc(threads, sizeof(ImportWorker));
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    if (workers == NULL || tids == NULL) {
+        free(workers);
+        free(tids);
+        error_printf(C_RED "Error: out of memory for the import workers.\n" C_RESET);
+        return false;
+    }
+    char *cut = body;
+    for (int t = 0; t < threads; t++) {
+        char *range_end = end;
+        if (t < threads - 1) {
+            range_end = body + (size_t)(end - body) * (size_t)(t + 1) / (size_t)threads;
+            if (range_end < cut) range_end = cut;
+            char *newline = memchr(range_end, '\n', (size_t)(end - range_end));
+            range_end = newline != NULL ? newline + 1 : end;
+        }
+        workers[t].start = cut;
+        workers[t].end = range_end;
+        workers[t].delimiter = delimiter;
+        cut = range_end;
+        pthread_create(&tids[t], NULL, import_worker, &workers[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    *parse_ms = elapsed_ms(&start);
+
+    // Merge in file order, so the first occurrence of a duplicated SAP ID wins
+    bool ok = true;
+    long line_base = header_lines;
+    for (int t = 0; t < threads; t++) {
+        ImportWorker *w = &workers[t];
+        ok = ok && !w->out_of_memory;
+        import_merge_report(report, &w->report, line_base);
+        for (long i = 0; i < w->row_count; i++) {
+            w->rows[i].line += line_base;
+            import_commit_row(&w->rows[i], added, report);
+        }
+        line_base += w->lines;
+        free(w->rows);
+    }
+    free(workers);
+    free(tids);
+    if (!ok) {
+        error_printf(C_RED "Error: out of memory while parsing; the import is incomplete.\n" C_RESET);
+    }
+    return ok;
+}
+
+static int compare_problems(const void* a, const void* b) {
+    long la = ((const ImportProblem*)a)->line;
+    long lb = ((const ImportProblem*)b)->line;
+    return (la > lb) - (la < lb);
+}
+
+// Function to import a roster file ("-" for stdin) using up to `threads` parsers.
+// Returns false if it cannot be read.
+bool import_roster(const char* path, int threads, ImportReport* report, double* parse_ms) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        error_printf(C_RED "Error: cannot open %s: %s\n" C_RESET, path, strerror(errno));
+        return false;
+    }
+    memset(report, 0, sizeof(*report));
+    KeySet added = { NULL, 0, 0 };
+    bool ok;
+    *parse_ms = 0;
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        if (threads > st.st_size / IMPORT_MIN_BYTES_PER_THREAD) {
+            threads = (int)(st.st_size / IMPORT_MIN_BYTES_PER_THREAD);
+        }
+        if (threads < 1) {
+            threads = 1;
+        }
+        // Private mapping: unquoting writes into copy-on-write pages, never the file
+        char *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            error_printf(C_RED "Error: cannot map %s: %s\n" C_RESET, path, strerror(errno));
+            close(fd);
+            return false;
+        }
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        ok = import_parallel(data, (size_t)st.st_size, threads, &added, report, parse_ms);
+        munmap(data, st.st_size);
+    } else {
+        ok = import_stream(fd, path, &added, report);
+    }
+
+    // Problems come from several workers and the merge; list the earliest lines
+    qsort(report->listing, report->listed, sizeof(ImportProblem), compare_problems);
+    free(added.keys);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return ok;
+}
+
+void print_import_report(const char* path, const ImportReport* report, int threads, double parse_ms, double ms) {
+    long rejected = report->rows - report->imported;
+    screen_printf(C_BLUE C_BOLD "\n--- Roster Import: %s ---\n" C_RESET, path);
+    screen_printf("Rows read:  " C_CYAN "%ld" C_RESET "\n", report->rows);
+    screen_printf("Imported:   " C_GREEN "%ld" C_RESET "\n", report->imported);
+    screen_printf("Rejected:   " C_RED "%ld" C_RESET "\n", rejected);
+    if (rejected > 0) {
+        screen_printf("  invalid SAP ID:            %ld\n", report->bad_sap);
+        screen_printf("  invalid or missing fields: %ld\n", report->bad_field);
+        screen_printf("  duplicate within file:     %ld\n", report->duplicate_in_file);
+        screen_printf("  already registered:        %ld\n", report->already_registered);
+        for (int i = 0; i < report->listed; i++) {
+            screen_printf(C_YELLOW "  line %ld: %s\n" C_RESET, report->listing[i].line, report->listing[i].text);
+        }
+        if (rejected > report->listed) {
+            screen_printf(C_YELLOW "  ... and %ld more\n" C_RESET, rejected - report->listed);
+        }
+    }
+    if (parse_ms > 0) {
+        screen_printf("Parse:      %.1f ms on up to %d thread(s) (%.0f rows/s)\n", parse_ms, threads, report->rows / (parse_ms / 1e3));
+    }
+    screen_printf("Total:      %.1f ms (%.0f rows/s)\n", ms, ms > 0 ? report->rows / (ms / 1e3) : 0.0);
+    screen_printf("Students now registered: " C_CYAN "%d" C_RESET "\n", student_store.count);
+}
+
+// Function for --import: load a roster and make it durable with one checkpoint rather
+// than journaling every row
+int run_import(const char* path, int threads) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ImportReport *report = malloc(sizeof(ImportReport));
+    double parse_ms;
+    if (report == NULL || !import_roster(path, threads, report, &parse_ms)) {
+        free(report);
+        return 1;
+    }
+    wal_checkpoint(&wal);
+    sap_index_reclaim(); // The import workers have finished
+    print_import_report(path, report, threads, parse_ms, elapsed_ms(&start));
+    screen_flush();
+    free(report);
+    return 0;
+}
+
+// Function to display student details (for teacher view)
+void display_student_details(int index) {
+    uint64_t start = metric_clock();
+    screen_printf(C_YELLOW "----------------------------------------\n" C_RESET);
+    screen_printf("Name: " C_CYAN "%s" C_RESET "\n", student_name(index));
+    screen_printf("SAP ID: " C_CYAN "%09u" C_RESET "\n", student_at(index)->sap_id);
+    
+    screen_printf(C_BOLD "\nMarks (out of 100):" C_RESET "\n");
+    for (int subject = 0; subject < subject_count; subject++) {
+        screen_printf("  %s: " C_YELLOW "%d" C_RESET "\n", subject_names[subject], *student_mark(index, subject));
+    }
+    
+    screen_printf(C_BOLD "\nAttendance (%%):" C_RESET "\n");
+    for (int subject = 0; subject < subject_count; subject++) {
+        if (attendance_sessions[subject] == 0) {
+            screen_printf("  %s: " C_YELLOW "%d%%" C_RESET "\n", subject_names[subject], *student_attendance(index, subject));
+        } else {
+            screen_printf("  %s: " C_YELLOW "%d%%" C_RESET " (%d of %d sessions)\n", subject_names[subject],
+                *student_attendance(index, subject), attendance_count(index, subject), attendance_sessions[subject]);
+        }
+    }
+    
+    screen_printf(C_YELLOW "----------------------------------------\n" C_RESET);
+    metric_record(METRIC_RENDER, start);
+}
+
+// Function to print one line per registered student, the whole roster at once (the
+// teacher's student list pages through it instead; see student_page()). The rows are
+// put together piece by piece rather than with screen_printf, since a large roster
+// means a hundred thousand of them.
+void list_students() {
+    uint64_t start = metric_clock();
+    uint32_t shown = 0;
+    for (int i = store_next_live(&student_store, 0); i < student_store.slots; i = store_next_live(&student_store, i + 1)) {
+        screen_color(C_CYAN);
+        screen_append_uint(++shown, 0);
+        screen_append(". Name: ", 8);
+        screen_append_padded(student_name(i), 30);
+        screen_color(C_RESET);
+        screen_append(" | SAP ID: ", 11);
+        screen_color(C_YELLOW);
+        screen_append_uint(student_at(i)->sap_id, SAP_ID_LENGTH);
+        screen_color(C_RESET);
+        screen_append("\n", 1);
+    }
+    metric_record(METRIC_LIST, start);
+}
+
+// --- Grade Sheets ---
+// Bulk entry of marks and attendance, e.g. a class's exam results in one file:
+//
+//     sap_id,maths,attendance_maths,marks_physics
+//     500012345,78,91,
+//     500012346,64,88,70
+//
+// The header row names the columns: the SAP ID first, then any of <subject> (marks),
+// marks_<subject> or attendance_<subject>, case-insensitive and in any order. An empty
+// cell leaves that score as it is. Delimiters and quoting are as for a roster import.
+//
+// The sheet is applied all or nothing. Every row is checked first (SAP ID registered
+// and listed once, every score 0-100) and a single rejected row rejects the sheet, so
+// the teacher corrects the file and applies it again instead of working out which rows
+// went in. A valid sheet is journaled as a group of part records closed by a commit
+// record, and the store is only written once the commit is durable; replay skips a
+// group that has no commit.
+//
+// Rows are radix sorted by SAP ID, which puts duplicates next to each other, and then
+// by store index: SAP IDs are hashed, so ID order says nothing about where students
+// live, while index order writes each score column front to back in one pass.
+#define GRADE_SHEET_UNCHANGED 0xFF
+
+typedef struct {
+    uint32_t key;    // Radix sort key: the SAP ID, then the store index
+    uint32_t sap;
+    long line;
+    uint8_t scores[STUDENT_COLUMNS]; // GRADE_SHEET_UNCHANGED where the cell was empty
+} GradeRow;
+
+typedef struct {
+    long rows;
+    long applied;        // Students whose scores were written (0 if the sheet was rejected)
+    long cells;          // Scores written
+    long bad_sap;
+    long bad_field;
+    long duplicate_in_file;
+    long not_registered;
+    int listed;
+    ImportProblem listing[IMPORT_MAX_LISTED];
+    char problem[160];   // Why the sheet could not be read at all, if it could not
+} GradeSheetReport;
+
+static void grade_sheet_reject(GradeSheetReport* report, long line, long* counter, const char* reason, const ImportField* field) {
+    (*counter)++;
+    import_list_problem(report->listing, &report->listed, line, reason, field);
+}
+
+// Function to sort rows by key, least significant byte first. Each pass is stable, so
+// rows with equal keys stay in file order. Passes over a byte every key shares are skipped.
+static void grade_sheet_sort(GradeRow* rows, GradeRow* scratch, long count) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        long offsets[257] = { 0 };
+        for (long i = 0; i < count; i++) {
+            offsets[((rows[i].key >> shift) & 0xFF) + 1]++;
+        }
+        if (count == 0 || offsets[((rows[0].key >> shift) & 0xFF) + 1] == count) {
+            continue;
+        }
+        for (int digit = 0; digit < 256; digit++) {
+            offsets[digit + 1] += offsets[digit];
+        }
+        for (long i = 0; i < count; i++) {
+            scratch[offsets[(rows[i].key >> shift) & 0xFF]++] = rows[i];
+        }
+        memcpy(rows, scratch, count * sizeof(GradeRow));
+    }
+}
+
+// Function to map a header cell to a student store column, or -1
+static int grade_sheet_column(const ImportField* f) {
+    char name[SUBJECT_NAME_BYTES + 16];
+    if (f->length == 0 || f->length >= sizeof(name)) {
+        return -1;
+    }
+    memcpy(name, f->start, f->length);
+    name[f->length] = '\0';
+    if (strncasecmp(name, "marks_", 6) == 0) {
+        int subject = subject_find(name + 6);
+        return subject != -1 ? MARK_COLUMN(subject) : -1;
+    }
+    if (strncasecmp(name, "attendance_", 11) == 0) {
+        int subject = subject_find(name + 11);
+        return subject != -1 ? ATTENDANCE_COLUMN(subject) : -1;
+    }
+    int subject = subject_find(name);
+    return subject != -1 ? MARK_COLUMN(subject) : -1;
+}
+
+// Function to read a whole file ("-" for stdin) into a buffer. Returns NULL on failure.
+static char *grade_sheet_read(const char* path, size_t* size) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    size_t capacity = 1 << 16;
+    char *data = malloc(capacity);
+    *size = 0;
+    while (data != NULL) {
+        if (*size == capacity) {
+            char *grown = realloc(data, capacity * 2);
+            if (grown == NULL) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, data + *size, capacity - *size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n < 0) {
+                free(data);
+                data = NULL;
+            }
+            break;
+        }
+        *size += (size_t)n;
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return data;
+}
+
+// Function to check one sheet line into a row. Returns false for blank and rejected
+// lines (which are recorded in the report).
+static bool grade_sheet_parse_line(char* line, size_t length, long line_number, char delimiter,
+                                   const int* columns, int column_count, GradeRow* row, GradeSheetReport* report) {
+    if (length > 0 && line[length - 1] == '\r') {
+        length--;
+    }
+    if (length == 0) {
+        return false;
+    }
+    report->rows++;
+
+    ImportField fields[IMPORT_MAX_FIELDS];
+    int count = import_split(line, length, delimiter, fields);
+    char sap_id[SAP_ID_LENGTH + 1];
+    if (fields[0].length != SAP_ID_LENGTH) {
+        grade_sheet_reject(report, line_number, &report->bad_sap, "SAP ID is not 9 digits", &fields[0]);
+        return false;
+    }
+    memcpy(sap_id, fields[0].start, SAP_ID_LENGTH);
+    sap_id[SAP_ID_LENGTH] = '\0';
+    if (!parse_sap_id(sap_id, &row->sap)) {
+        grade_sheet_reject(report, line_number, &report->bad_sap, "SAP ID is not 9 digits", &fields[0]);
+        return false;
+    }
+    if (count > column_count) {
+        grade_sheet_reject(report, line_number, &report->bad_field, "more fields than the header names", NULL);
+        return false;
+    }
+    memset(row->scores, GRADE_SHEET_UNCHANGED, sizeof(row->scores));
+    for (int i = 1; i < count; i++) {
+        if (fields[i].length > 0 && !import_parse_score(&fields[i], &row->scores[columns[i]])) {
+            grade_sheet_reject(report, line_number, &report->bad_field, "marks and attendance must be 0-100", &fields[i]);
+            return false;
+        }
+    }
+    row->key = row->sap;
+    row->line = line_number;
+    return true;
+}
+
+// Function to journal one part of a grade sheet group, returning its LSN
+static uint64_t grade_sheet_journal_part(const GradeSheetEntry* part, size_t entries) {
+    return wal_append(&wal, WAL_GRADE_SHEET_PART, 0, 0, 0, part, (uint16_t)(entries * sizeof(GradeSheetEntry)));
+}
+
+// Function to journal the rows' changed cells as one group and wait until its commit
+// record is on disk. Called with student_write_lock held.
+static void grade_sheet_journal(const GradeRow* rows, long count) {
+    GradeSheetEntry *part = wal.fd != -1 ? malloc(WAL_GRADE_SHEET_PART_ENTRIES * sizeof(GradeSheetEntry)) : NULL;
+    if (part == NULL) {
+        return;
+    }
+    uint64_t first_lsn = 0;
+    size_t used = 0;
+    for (long i = 0; i < count; i++) {
+        for (int column = 0; column < STUDENT_COLUMNS; column++) {
+            if (rows[i].scores[column] == GRADE_SHEET_UNCHANGED) {
+                continue;
+            }
+            GradeSheetEntry entry = { rows[i].sap, (uint8_t)column, rows[i].scores[column], 0 };
+            part[used++] = entry;
+            if (used == WAL_GRADE_SHEET_PART_ENTRIES) {
+                uint64_t lsn = grade_sheet_journal_part(part, used);
+                first_lsn = first_lsn != 0 ? first_lsn : lsn;
+                used = 0;
+            }
+        }
+    }
+    if (used > 0) {
+        uint64_t lsn = grade_sheet_journal_part(part, used);
+        first_lsn = first_lsn != 0 ? first_lsn : lsn;
+    }
+    free(part);
+    if (first_lsn != 0) {
+        wal_commit(&wal, wal_append(&wal, WAL_GRADE_SHEET_COMMIT, 0, 0, 0, &first_lsn, sizeof(first_lsn)));
+    }
+}
+
+// Function to check a grade sheet ("-" for stdin) and apply it if every row is valid.
+// Returns false if the sheet cannot be read or its header cannot be used, with the
+// reason in report->problem; a sheet with rejected rows returns true and applies nothing.
+bool apply_grade_sheet(const char* path, GradeSheetReport* report) {
+    memset(report, 0, sizeof(*report));
+    size_t size;
+    char *data = grade_sheet_read(path, &size);
+    if (data == NULL) {
+        snprintf(report->problem, sizeof(report->problem), "cannot read %s: %s", path, strerror(errno));
+        return false;
+    }
+    char *end = data + size;
+    char delimiter;
+    char *body = import_detect_format(data, end, &delimiter);
+    if (body == data) {
+        snprintf(report->problem, sizeof(report->problem),
+            "the first line must name the columns, e.g. sap_id,%s,attendance_%s", subject_names[0], subject_names[0]);
+        free(data);
+        return false;
+    }
+
+    // The header maps each field position to a store column
+    ImportField fields[IMPORT_MAX_FIELDS];
+    int column_count = import_split(data, (size_t)(body - data) - (body[-1] == '\n'), delimiter, fields);
+    int columns[IMPORT_MAX_FIELDS];
+    bool named[STUDENT_COLUMNS] = { false };
+    for (int i = 1; i < column_count; i++) {
+        columns[i] = grade_sheet_column(&fields[i]);
+        if (columns[i] == -1 || named[columns[i]]) {
+            snprintf(report->problem, sizeof(report->problem), "%s column '%.*s' in the header",
+                columns[i] == -1 ? "unknown" : "repeated", (int)(fields[i].length < 40 ? fields[i].length : 40), fields[i].start);
+            free(data);
+            return false;
+        }
+        named[columns[i]] = true;
+    }
+    if (column_count < 2) {
+        snprintf(report->problem, sizeof(report->problem), "the header names no marks or attendance columns");
+        free(data);
+        return false;
+    }
+
+    long lines = 1;
+    for (char *p = body; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; p++) {
+        lines++;
+    }
+    GradeRow *rows = malloc(lines * sizeof(GradeRow));
+    GradeRow *scratch = malloc(lines * sizeof(GradeRow));
+    if (rows == NULL || scratch == NULL) {
+        snprintf(report->problem, sizeof(report->problem), "out of memory for %ld rows", lines);
+        free(rows);
+        free(scratch);
+        free(data);
+        return false;
+    }
+    long count = 0;
+    long line_number = 1;
+    for (char *p = body; p < end; ) {
+        char *newline = memchr(p, '\n', (size_t)(end - p));
+        char *line_end = newline != NULL ? newline : end;
+        line_number++;
+        if (grade_sheet_parse_line(p, (size_t)(line_end - p), line_number, delimiter, columns, column_count, &rows[count], report)) {
+            count++;
+        }
+        p = line_end + 1;
+    }
+    free(data);
+
+    // Sorted by SAP ID, a repeated ID sits right after its first row. The lock is taken
+    // here so no student can be removed between being found and being written.
+    grade_sheet_sort(rows, scratch, count);
+    pthread_mutex_lock(&student_write_lock);
+    for (long i = 0; i < count; i++) {
+        char sap_id[SAP_ID_LENGTH + 1];
+        snprintf(sap_id, sizeof(sap_id), "%09u", rows[i].sap);
+        ImportField id = { sap_id, SAP_ID_LENGTH };
+        int index = sap_index_lookup(rows[i].sap);
+        if (i > 0 && rows[i].sap == rows[i - 1].sap) {
+            grade_sheet_reject(report, rows[i].line, &report->duplicate_in_file, "SAP ID listed twice", &id);
+        } else if (index == -1) {
+            grade_sheet_reject(report, rows[i].line, &report->not_registered, "SAP ID is not registered", &id);
+        }
+        rows[i].key = (uint32_t)index;
+    }
+
+    if (report->bad_sap + report->bad_field + report->duplicate_in_file + report->not_registered == 0) {
+        grade_sheet_sort(rows, scratch, count); // Now into store order
+        grade_sheet_journal(rows, count);
+        for (long i = 0; i < count; i++) {
+            int index = (int)rows[i].key;
+            begin_score_rewrite(index);
+            seq_write_begin(student_sequence(index));
+            for (int column = 0; column < STUDENT_COLUMNS; column++) {
+                if (rows[i].scores[column] != GRADE_SHEET_UNCHANGED) {
+                    *(uint8_t*)store_cell(&student_store, index, column) = rows[i].scores[column];
+                    report->cells++;
+                }
+            }
+            seq_write_end(student_sequence(index));
+            end_score_rewrite(index);
+        }
+        report->applied = count;
+    }
+    pthread_mutex_unlock(&student_write_lock);
+
+    qsort(report->listing, report->listed, sizeof(ImportProblem), compare_problems);
+    free(rows);
+    free(scratch);
+    return true;
+}
+
+void print_grade_sheet_report(const char* path, const GradeSheetReport* report, double ms) {
+    long rejected = report->bad_sap + report->bad_field + report->duplicate_in_file + report->not_registered;
+    screen_printf(C_BLUE C_BOLD "\n--- Grade Sheet: %s ---\n" C_RESET, path);
+    screen_printf("Rows read:  " C_CYAN "%ld" C_RESET "\n", report->rows);
+    if (rejected == 0) {
+        screen_printf("Applied:    " C_GREEN "%ld" C_RESET " student(s), %ld score(s)\n", report->applied, report->cells);
+    } else {
+        screen_printf("Rejected:   " C_RED "%ld" C_RESET " row(s); " C_RED "nothing was applied" C_RESET "\n", rejected);
+        screen_printf("  invalid SAP ID:              %ld\n", report->bad_sap);
+        screen_printf("  invalid scores or fields:    %ld\n", report->bad_field);
+        screen_printf("  SAP ID listed twice:         %ld\n", report->duplicate_in_file);
+        screen_printf("  SAP ID not registered:       %ld\n", report->not_registered);
+        for (int i = 0; i < report->listed; i++) {
+            screen_printf(C_YELLOW "  line %ld: %s\n" C_RESET, report->listing[i].line, report->listing[i].text);
+        }
+        if (rejected > report->listed) {
+            screen_printf(C_YELLOW "  ... and %ld more\n" C_RESET, rejected - report->listed);
+        }
+    }
+    screen_printf("Total:      %.1f ms\n", ms);
+}
+
+// Function for --apply-grades: apply a grade sheet and report on it. Exits non-zero
+// unless the sheet was applied.
+int run_apply_grades(const char* path) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    GradeSheetReport *report = malloc(sizeof(GradeSheetReport));
+    if (report == NULL) {
+        return 1;
+    }
+    int status = 1;
+    if (!apply_grade_sheet(path, report)) {
+        error_printf(C_RED "Error: %s.\n" C_RESET, report->problem);
+    } else {
+        print_grade_sheet_report(path, report, elapsed_ms(&start));
+        screen_flush();
+        status = report->applied == report->rows ? 0 : 1;
+    }
+    free(report);
+    return status;
+}
+
+// --- Login Workers ---
+// Checking a password costs several milliseconds of hashing by design, so the server
+// does not check logins on its event loop thread: a burst of logins would stall every
+// other client. A login instead becomes a LoginJob that carries copies of everything
+// the check needs (so workers never touch the stores) and goes to a small pool of
+// threads. Finished jobs are handed back through an eventfd, which the event loop
+// watches like any socket. Batch mode and the menus serve one user at a time and just
+// call verify_password() directly.
+#define LOGIN_BENCH_USERS 64
+
+typedef struct LoginJob {
+    void *owner;       // Who is waiting for the result (a server client)
+    long line;
+    bool teacher;
+    uint32_t student_key;
+    char username[50];                 // Echoed back when a teacher logs in
+    char credential[CREDENTIAL_BYTES]; // Empty if there is no such user
+    char password[TEACHER_PASSWORD_MAX + 1];
+    bool accepted;
+    struct timespec submitted;
+    double latency_ms; // Submission to result
+    struct LoginJob *next;
+} LoginJob;
+
+typedef struct {
+    pthread_t *threads;
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    LoginJob *queue_head;
+    LoginJob *queue_tail;
+    LoginJob *done;
+    int event_fd;      // Readable while finished jobs are waiting in done
+    bool stop;
+} LoginPool;
+
+// Function to check one login. An empty credential is checked against a decoy, so an
+// unknown user costs the same as a wrong password.
+static void login_job_verify(LoginJob* job) {
+    job->accepted = verify_password(job->password, job->credential[0] != '\0' ? job->credential : NULL);
+    memset(job->password, 0, sizeof(job->password));
+}
+
+static void *login_worker(void* arg) {
+    LoginPool *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->queue_head == NULL && !pool->stop) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->queue_head == NULL) {
+            break; // Stopping, and nothing left to do
+        }
+        LoginJob *job = pool->queue_head;
+        pool->queue_head = job->next;
+        if (pool->queue_head == NULL) {
+            pool->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        login_job_verify(job);
+        job->latency_ms = elapsed_ms(&job->submitted);
+
+        pthread_mutex_lock(&pool->lock);
+        job->next = pool->done;
+        pool->done = job;
+        uint64_t one = 1;
+        if (write(pool->event_fd, &one, sizeof(one)) != sizeof(one)) {
+            // The counter only fails to take a write when it is already non-zero
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Function to start the pool's threads. Returns false if it could not be set up.
+bool login_pool_start(LoginPool* pool, int threads) {
+    memset(pool, 0, sizeof(*pool));
+    pool->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pool->threads = calloc((size_t)threads, sizeof(pthread_t));
+    if (pool->event_fd == -1 || pool->threads == NULL) {
+        if (pool->event_fd != -1) close(pool->event_fd);
+        free(pool->threads);
+        return false;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    // Workers never take signals, so SIGINT reaches the thread that waits for it
+    sigset_t all_signals, previous;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &previous);
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, login_worker, pool) == 0) {
+            pool->thread_count++;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return pool->thread_count > 0;
+}
+
+void login_pool_submit(LoginPool* pool, LoginJob* job) {
+    clock_gettime(CLOCK_MONOTONIC, &job->submitted);
+    job->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->queue_tail != NULL) {
+        pool->queue_tail->next = job;
+    } else {
+        pool->queue_head = job;
+    }
+    pool->queue_tail = job;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Function to take every finished job (linked through next), or NULL if there are none
+LoginJob *login_pool_collect(LoginPool* pool) {
+    uint64_t count;
+    if (read(pool->event_fd, &count, sizeof(count)) != sizeof(count)) {
+        // Already cleared by an earlier call; the list below is what counts
+    }
+    pthread_mutex_lock(&pool->lock);
+    LoginJob *done = pool->done;
+    pool->done = NULL;
+    pthread_mutex_unlock(&pool->lock);
+    return done;
+}
+
+// Function to stop the workers once the queue is empty and free unclaimed results
+void login_pool_stop(LoginPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (LoginJob *job = pool->done, *next; job != NULL; job = next) {
+        next = job->next;
+        free(job);
+    }
+    close(pool->event_fd);
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to print the throughput and latency percentiles of a login burst
+static void print_login_timings(const char* label, double* latencies, int logins, double wall_ms, double stall_ms) {
+    qsort(latencies, (size_t)logins, sizeof(double), compare_doubles);
+    printf("  %-8s %12.0f %10.1f %10.1f %10.1f %14.1f\n", label, logins / (wall_ms / 1e3),
+        latencies[logins / 2], latencies[(int)((logins - 1) * 0.99)], latencies[logins - 1], stall_ms);
+}
+
+// Function to time a burst of LOGINS logins checked inline on one thread, then on a
+// pool of THREADS workers (in memory). Some logins use a wrong password or an unknown
+// SAP ID. Returns the process exit status.
+int run_login_benchmark(int logins, int threads) {
+    char passwords[LOGIN_BENCH_USERS][STUDENT_PASSWORD_MAX + 1];
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < LOGIN_BENCH_USERS; i++) {
+        StudentForm form;
+        snprintf(form.sap_id, sizeof(form.sap_id), "%09u", 100000000u + (uint32_t)i);
+        snprintf(passwords[i], sizeof(passwords[i]), "secret%d", i);
+        snprintf(form.name, sizeof(form.name), "Student Number %d", i);
+        hash_password(passwords[i], form.credential);
+        if (insert_student(&form) == -1) {
+            error_printf(C_RED "Error: the student store is full.\n" C_RESET);
+            return 1;
+        }
+    }
+    double hash_ms = elapsed_ms(&start) / LOGIN_BENCH_USERS;
+
+    LoginJob *jobs = calloc((size_t)logins, sizeof(LoginJob));
+    double *latencies = malloc((size_t)logins * sizeof(double));
+    LoginPool pool;
+    if (jobs == NULL || latencies == NULL || !login_pool_start(&pool, threads)) {
+        error_printf(C_RED "Error: cannot set up %d logins on %d threads.\n" C_RESET, logins, threads);
+        free(jobs);
+        free(latencies);
+        return 1;
+    }
+    // Every 8th login has a wrong password and every 16th (offset) an unknown SAP ID
+    long expected = 0;
+    for (int i = 0; i < logins; i++) {
+        LoginJob *job = &jobs[i];
+        uint32_t key = 100000000u + (uint32_t)(i % LOGIN_BENCH_USERS) + (i % 16 == 5 ? 500000000u : 0);
+        int index = sap_index_lookup(key);
+        job->student_key = key;
+        if (index != -1) {
+            strcpy(job->credential, student_credential(index));
+        }
+        strcpy(job->password, i % 8 == 3 ? "wrong" : passwords[i % LOGIN_BENCH_USERS]);
+        expected += index != -1 && i % 8 != 3;
+    }
+
+    printf("Login benchmark: %d logins, one hash = %.2f ms (%d PBKDF2-SHA256 iterations)\n",
+        logins, hash_ms, PASSWORD_HASH_ITERATIONS);
+    printf("  %-8s %12s %10s %10s %10s %14s\n", "", "logins/s", "p50 ms", "p99 ms", "max ms", "loop stall ms");
+
+    // Inline: the whole burst arrives at once and the event loop checks it in turn
+    LoginJob *copies = malloc((size_t)logins * sizeof(LoginJob));
+    if (copies == NULL) {
+        login_pool_stop(&pool);
+        free(jobs);
+        free(latencies);
+        return 1;
+    }
+    memcpy(copies, jobs, (size_t)logins * sizeof(LoginJob));
+    long accepted = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < logins; i++) {
+        login_job_verify(&copies[i]);
+        latencies[i] = elapsed_ms(&start);
+        accepted += copies[i].accepted;
+    }
+    double wall = elapsed_ms(&start);
+    free(copies);
+    bool correct = accepted == expected;
+    print_login_timings("inline", latencies, logins, wall, wall);
+
+    // Pooled: the loop only queues the burst, then collects results as they finish
+    accepted = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < logins; i++) {
+        login_pool_submit(&pool, &jobs[i]);
+    }
+    double stall = elapsed_ms(&start);
+    int finished = 0;
+    while (finished < logins) {
+        struct pollfd ready = { .fd = pool.event_fd, .events = POLLIN };
+        poll(&ready, 1, -1);
+        for (LoginJob *job = login_pool_collect(&pool); job != NULL; job = job->next) {
+            latencies[finished++] = job->latency_ms;
+            accepted += job->accepted;
+        }
+    }
+    wall = elapsed_ms(&start);
+    correct &= accepted == expected;
+    print_login_timings("pooled", latencies, logins, wall, stall);
+    printf("  %d worker thread(s); %ld of %d logins accepted, as expected: %s\n",
+        pool.thread_count, accepted, logins, correct ? "yes" : "NO");
+
+    login_pool_stop(&pool);
+    free(jobs);
+    free(latencies);
+    return correct ? 0 : 1;
+}
+
+// --- Benchmark Suite ---
+// --bench SIZES builds a synthetic roster in memory and times the core operations at
+// each size (e.g. "1000,10000,100000"; sizes run in increasing order and the roster
+// grows between them). Every operation is timed one call at a time, so percentiles
+// come from real per-call latencies; the cost of reading the clock is measured and
+// reported separately instead of being subtracted. Results go to stdout as a table
+// and to a JSON file, so runs from before and after a change can be compared.
+//
+// --generate-roster N FILE writes the same synthetic students as an import roster.
+#define BENCH_MAX_STUDENTS 10000000
+#define BENCH_SAMPLES 100000     // Calls timed per operation (fewer on small rosters)
+#define BENCH_RENDER_SAMPLES 10000
+#define BENCH_LOGIN_SAMPLES 16   // Each one is a full password hash
+#define BENCH_LIST_ROUNDS 5
+#define BENCH_MAX_SIZES 16
+
+static const char *synthetic_first_names[] = {
+    "Aarav", "Vivaan", "Aditya", "Vihaan", "Arjun", "Sai", "Reyansh", "Ayaan",
+    "Krishna", "Ishaan", "Ananya", "Diya", "Aadhya", "Saanvi", "Myra", "Aarohi",
+    "Pari", "Anika", "Navya", "Ira", "Rohan", "Kabir", "Priya", "Neha",
+    "Riya", "Kavya", "Meera", "Tanvi", "Rahul", "Karan", "Sneha", "Pooja",
+};
+static const char *synthetic_last_names[] = {
+    "Sharma", "Verma", "Gupta", "Singh", "Kumar", "Patel", "Mehta", "Joshi",
+    "Reddy", "Nair", "Iyer", "Rao", "Das", "Bose", "Chatterjee", "Mukherjee",
+    "Agarwal", "Bansal", "Kapoor", "Malhotra", "Chauhan", "Yadav", "Mishra", "Pandey",
+    "Tiwari", "Saxena", "Bhat", "Menon", "Pillai", "Kulkarni", "Deshpande", "Jain",
+};
+#define SYNTHETIC_NAMES (sizeof(synthetic_first_names) / sizeof(synthetic_first_names[0]))
+
+// Function to give the i-th synthetic student a SAP ID in 500000000-599999999. The
+// multiplier is coprime to 10^8, so the first 10^8 students all get distinct IDs, and
+// consecutive students get scattered ones, as real enrolment years do.
+static inline uint32_t synthetic_sap_id(uint64_t i) {
+    return 500000000u + (uint32_t)((i * 54435761u + 12345u) % 100000000u);
+}
+
+// Function to fill the i-th synthetic student's SAP ID, password, name and scores
+static void synthetic_student(uint64_t i, StudentForm* form, char password[STUDENT_PASSWORD_MAX + 1],
+                              uint8_t scores[STUDENT_COLUMNS]) {
+    uint32_t seed = (uint32_t)(i * 2654435761u) ^ 0x9e3779b9u;
+    seed ^= seed >> 15;
+    seed *= 2246822519u;
+    seed ^= seed >> 13;
+    snprintf(form->sap_id, sizeof(form->sap_id), "%09u", synthetic_sap_id(i));
+    snprintf(password, STUDENT_PASSWORD_MAX + 1, "pw%08x", seed);
+    const char *first = synthetic_first_names[seed % SYNTHETIC_NAMES];
+    const char *last = synthetic_last_names[(seed >> 5) % SYNTHETIC_NAMES];
+    if ((seed >> 10) % 4 == 0) { // Some students have a middle initial
+        snprintf(form->name, sizeof(form->name), "%s %c. %s", first, 'A' + (int)((seed >> 12) % 26), last);
+    } else {
+        snprintf(form->name, sizeof(form->name), "%s %s", first, last);
+    }
+    for (int column = 0; column < STUDENT_COLUMNS; column++) {
+        seed = seed * 1103515245u + 12345u;
+        uint8_t low = column < SUBJECT_MAX ? 35 : 50; // Marks 35-100, attendance 50-100
+        scores[column] = student_column_in_use(column) ? (uint8_t)(low + (seed >> 16) % (101 - low)) : 0;
+    }
+}
+
+// Function to write N synthetic students as a CSV roster ("-" for stdout). Passwords
+// are written in plain text; --import hashes them. Returns the process exit status.
+int run_generate_roster(long students, const char* path) {
+    FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (out == NULL) {
+        error_printf(C_RED "Error: cannot create %s: %s\n" C_RESET, path, strerror(errno));
+        return 1;
+    }
+    fprintf(out, "sap_id,password,name");
+    for (int column = 0; column < STUDENT_COLUMNS; column++) {
+        if (student_column_in_use(column)) {
+            fprintf(out, ",%s_", column < SUBJECT_MAX ? "marks" : "attendance");
+            for (const char* c = subject_names[column % SUBJECT_MAX]; *c != '\0'; c++) {
+                fputc(*c >= 'A' && *c <= 'Z' ? *c - 'A' + 'a' : *c, out);
+            }
+        }
+    }
+    fputc('\n', out);
+    for (long i = 0; i < students; i++) {
+        StudentForm form;
+        char password[STUDENT_PASSWORD_MAX + 1];
+        uint8_t scores[STUDENT_COLUMNS];
+        synthetic_student((uint64_t)i, &form, password, scores);
+        fprintf(out, "%s,%s,%s", form.sap_id, password, form.name);
+        for (int column = 0; column < STUDENT_COLUMNS; column++) {
+            if (student_column_in_use(column)) {
+                fprintf(out, ",%d", scores[column]);
+            }
+        }
+        fputc('\n', out);
+    }
+    bool ok = fflush(out) == 0 && !ferror(out);
+    if (out != stdout) {
+        ok &= fclose(out) == 0;
+    }
+    if (!ok) {
+        error_printf(C_RED "Error: writing %s failed: %s\n" C_RESET, path, strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "Wrote %ld synthetic students to %s.\n", students, path);
+    return 0;
+}
+
+typedef struct {
+    const char *name;
+    long ops;
+    double total_ns;
+    uint64_t p50, p90, p99, max;
+} BenchResult;
+
+typedef struct {
+    uint64_t *samples; // Per-call nanoseconds
+    long count;
+    struct timespec start;
+} BenchTimer;
+
+static inline uint64_t timespec_ns(const struct timespec* t) {
+    return (uint64_t)t->tv_sec * 1000000000u + (uint64_t)t->tv_nsec;
+}
+
+static inline void bench_begin(BenchTimer* timer) {
+    clock_gettime(CLOCK_MONOTONIC, &timer->start);
+}
+
+static inline void bench_end(BenchTimer* timer) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timer->samples[timer->count++] = timespec_ns(&now) - timespec_ns(&timer->start);
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to turn a timer's samples into a result (sorts the samples)
+static BenchResult bench_result(const char* name, BenchTimer* timer) {
+    BenchResult r = { name, timer->count, 0, 0, 0, 0, 0 };
+    if (timer->count == 0) {
+        return r;
+    }
+    qsort(timer->samples, (size_t)timer->count, sizeof(uint64_t), compare_u64);
+    for (long i = 0; i < timer->count; i++) {
+        r.total_ns += (double)timer->samples[i];
+    }
+    r.p50 = timer->samples[(timer->count - 1) / 2];
+    r.p90 = timer->samples[(long)((timer->count - 1) * 0.90)];
+    r.p99 = timer->samples[(long)((timer->count - 1) * 0.99)];
+    r.max = timer->samples[timer->count - 1];
+    timer->count = 0;
+    return r;
+}
+
+// Function to measure what one bench_begin()/bench_end() pair costs on its own
+static uint64_t bench_timer_overhead(BenchTimer* timer) {
+    for (int i = 0; i < 1000; i++) {
+        bench_begin(timer);
+        bench_end(timer);
+    }
+    BenchResult r = bench_result("timer", timer);
+    return r.p50;
+}
+
+// Stdout is pointed at /dev/null while rendering is timed, so the numbers measure
+// formatting and writing rather than a terminal
+static int bench_mute_stdout() {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (saved != -1 && null_fd != -1) {
+        dup2(null_fd, STDOUT_FILENO);
+    }
+    if (null_fd != -1) {
+        close(null_fd);
+    }
+    return saved;
+}
+
+static void bench_restore_stdout(int saved) {
+    fflush(stdout);
+    if (saved != -1) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+}
+
+// Function to time every operation on a roster of the current size
+static int bench_roster(long students, const char* credential, BenchTimer* timer, BenchResult results[]) {
+    int count = 0;
+    long samples = students < BENCH_SAMPLES ? students : BENCH_SAMPLES;
+    uint32_t seed = 0x2545f491u ^ (uint32_t)students;
+
+    // Lookups by SAP ID, of students who exist and of IDs nobody has
+    char (*ids)[SAP_ID_LENGTH + 1] = malloc((size_t)samples * sizeof(*ids));
+    int *indices = malloc((size_t)samples * sizeof(int));
+    if (ids == NULL || indices == NULL) {
+        free(ids);
+        free(indices);
+        return -1;
+    }
+    for (long i = 0; i < samples; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        snprintf(ids[i], sizeof(ids[i]), "%09u", synthetic_sap_id(seed % (uint32_t)students));
+    }
+    for (long i = 0; i < samples; i++) {
+        bench_begin(timer);
+        indices[i] = find_student_index(ids[i]);
+        bench_end(timer);
+    }
+    results[count++] = bench_result("find", timer);
+    for (long i = 0; i < samples; i++) {
+        snprintf(ids[i], sizeof(ids[i]), "%09u", 100000000u + (uint32_t)i); // Outside the synthetic range
+    }
+    for (long i = 0; i < samples; i++) {
+        bench_begin(timer);
+        int index = find_student_index(ids[i]);
+        bench_end(timer);
+        if (index != -1) {
+            free(ids);
+            free(indices);
+            return -1;
+        }
+    }
+    results[count++] = bench_result("find_miss", timer);
+
+    // Edits (a mark each) on the students found above
+    for (long i = 0; i < samples; i++) {
+        bench_begin(timer);
+        set_student_mark(indices[i], (int)(i % subject_count), (int)(i % 101));
+        bench_end(timer);
+    }
+    results[count++] = bench_result("edit", timer);
+
+    // Leaderboard queries: a student's overall rank, and the overall top ten
+    for (long i = 0; i < samples; i++) {
+        int32_t out_of;
+        bench_begin(timer);
+        int32_t rank = leaderboard_rank(LEADERBOARD_TOTAL, indices[i], &out_of);
+        bench_end(timer);
+        if (rank < 1 || rank > out_of) {
+            free(ids);
+            free(indices);
+            return -1;
+        }
+    }
+    results[count++] = bench_result("rank", timer);
+    for (long i = 0; i < samples; i++) {
+        int top[10];
+        int32_t ranks[10];
+        bench_begin(timer);
+        leaderboard_top(LEADERBOARD_TOTAL, 10, top, ranks);
+        bench_end(timer);
+    }
+    results[count++] = bench_result("top10", timer);
+
+    // Name searches, each for part of a found student's last and first names ("sha pr")
+    long searches = samples < BENCH_RENDER_SAMPLES ? samples : BENCH_RENDER_SAMPLES;
+    for (long i = 0; i < searches; i++) {
+        const char *name = student_name(indices[i]);
+        const char *last = strrchr(name, ' ');
+        char query[16];
+        snprintf(query, sizeof(query), "%.3s %.2s", last != NULL ? last + 1 : name, name);
+        int found[NAME_SEARCH_LISTED];
+        int total;
+        bench_begin(timer);
+        int listed = search_students_by_name(query, found, NAME_SEARCH_LISTED, &total);
+        bench_end(timer);
+        if (listed < 1) {
+            free(ids);
+            free(indices);
+            return -1;
+        }
+    }
+    results[count++] = bench_result("name_find", timer);
+
+    // A page of the list in name order, from a found student onwards
+    for (long i = 0; i < samples; i++) {
+        StudentCursor cursor;
+        student_cursor_at(&cursor, indices[i]);
+        int page[ORDER_PAGE_DEFAULT];
+        bench_begin(timer);
+        int listed = student_page(ORDER_NAME, &cursor, true, false, page, ORDER_PAGE_DEFAULT);
+        bench_end(timer);
+        if (listed < 1 || page[0] != indices[i]) {
+            free(ids);
+            free(indices);
+            return -1;
+        }
+    }
+    results[count++] = bench_result("page", timer);
+
+    // Adds of new students, then removes of the same students
+    for (long i = 0; i < samples; i++) {
+        StudentForm form;
+        char password[STUDENT_PASSWORD_MAX + 1];
+        uint8_t scores[STUDENT_COLUMNS];
+        synthetic_student((uint64_t)(BENCH_MAX_STUDENTS + i), &form, password, scores);
+        strcpy(form.credential, credential);
+        bench_begin(timer);
+        indices[i] = add_student(&form);
+        bench_end(timer);
+        if (indices[i] == -1) {
+            free(ids);
+            free(indices);
+            return -1;
+        }
+    }
+    results[count++] = bench_result("add", timer);
+    for (long i = 0; i < samples; i++) {
+        bench_begin(timer);
+        remove_student(indices[i]);
+        bench_end(timer);
+    }
+    results[count++] = bench_result("remove", timer);
+    compact_students();
+    name_index_ready(); // Compaction dropped it; the next size's adds keep it current
+
+    // Logins: a full password check each, against a random student's stored hash
+    for (long i = 0; i < BENCH_LOGIN_SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        snprintf(ids[0], sizeof(ids[0]), "%09u", synthetic_sap_id(seed % (uint32_t)students));
+        bench_begin(timer);
+        int index = find_student_index(ids[0]);
+        bool accepted = index != -1 && verify_password("pw", student_credential(index));
+        bench_end(timer);
+        if (!accepted) {
+            free(ids);
+            free(indices);
+            return -1;
+        }
+    }
+    results[count++] = bench_result("login", timer);
+
+    // Rendering one student's details, and listing the whole roster
+    int saved = bench_mute_stdout();
+    long renders = samples < BENCH_RENDER_SAMPLES ? samples : BENCH_RENDER_SAMPLES;
+    for (long i = 0; i < renders; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        int index = store_next_live(&student_store, (int)(seed % (uint32_t)student_store.slots));
+        if (index == student_store.slots) {
+            index = store_next_live(&student_store, 0);
+        }
+        bench_begin(timer);
+        display_student_details(index);
+        screen_flush();
+        bench_end(timer);
+    }
+    results[count++] = bench_result("render", timer);
+    for (int round = 0; round < BENCH_LIST_ROUNDS; round++) {
+        bench_begin(timer);
+        list_students();
+        screen_flush();
+        bench_end(timer);
+    }
+    results[count++] = bench_result("list", timer);
+    bench_restore_stdout(saved);
+
+    free(ids);
+    free(indices);
+    return count;
+}
+
+static void bench_print_json(FILE* out, const BenchResult* r) {
+    double mean = r->ops > 0 ? r->total_ns / r->ops : 0;
+    fprintf(out, "{\"name\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.1f, \"ops_per_s\": %.1f, "
+                 "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}",
+        r->name, r->ops, mean, mean > 0 ? 1e9 / mean : 0, (unsigned long long)r->p50,
+        (unsigned long long)r->p90, (unsigned long long)r->p99, (unsigned long long)r->max);
+}
+
+// Function to run the suite at every size in a comma-separated list and write the
+// results to json_path. Returns the process exit status.
+int run_benchmark_suite(const char* size_list, const char* json_path) {
+    long sizes[BENCH_MAX_SIZES];
+    int size_count = 0;
+    for (const char *p = size_list; *p != '\0' && size_count < BENCH_MAX_SIZES; ) {
+        char *end;
+        long size = strtol(p, &end, 10);
+        if (end == p || size < 1 || size > BENCH_MAX_STUDENTS || (*end != ',' && *end != '\0')
+            || (size_count > 0 && size <= sizes[size_count - 1])) {
+            error_printf(C_RED "Error: sizes must be increasing numbers from 1 to %d, separated by commas.\n" C_RESET,
+                BENCH_MAX_STUDENTS);
+            return 1;
+        }
+        sizes[size_count++] = size;
+        p = *end == ',' ? end + 1 : end;
+    }
+    FILE *json = fopen(json_path, "w");
+    BenchTimer timer = { malloc(BENCH_SAMPLES * sizeof(uint64_t)), 0, { 0, 0 } };
+    if (json == NULL || timer.samples == NULL) {
+        error_printf(C_RED "Error: cannot write %s: %s\n" C_RESET, json_path, strerror(errno));
+        if (json != NULL) fclose(json);
+        free(timer.samples);
+        return 1;
+    }
+
+    // One real hash shared by every synthetic student: hashing each password would
+    // take hours at the larger sizes, and lookups never look inside it
+    char credential[CREDENTIAL_BYTES];
+    hash_password("pw", credential);
+    uint64_t overhead = bench_timer_overhead(&timer);
+    time_t now = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    fprintf(json, "{\n  \"timestamp\": \"%s\",\n  \"column_kernels\": \"%s\",\n  \"hash_iterations\": %d,\n"
+                  "  \"timer_overhead_ns\": %llu,\n  \"runs\": [",
+        stamp, column_stats_kernel_name, PASSWORD_HASH_ITERATIONS, (unsigned long long)overhead);
+    printf("Benchmark suite (timer overhead %llu ns per call, included below)\n", (unsigned long long)overhead);
+
+    int status = 0;
+    long built = 0;
+    leaderboards_ready(); // Kept up to date from the first add, as in a live session
+    name_index_ready();
+    student_orders_ready();
+    for (int s = 0; s < size_count && status == 0; s++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (; built < sizes[s]; built++) {
+            StudentForm form;
+            char password[STUDENT_PASSWORD_MAX + 1];
+            uint8_t scores[STUDENT_COLUMNS];
+            synthetic_student((uint64_t)built, &form, password, scores);
+            strcpy(form.credential, credential);
+            int index = insert_student(&form);
+            if (index == -1) {
+                error_printf(C_RED "Error: out of memory at %ld students.\n" C_RESET, built);
+                status = 1;
+                break;
+            }
+            begin_score_rewrite(index);
+            for (int subject = 0; subject < subject_count; subject++) {
+                *student_mark(index, subject) = scores[MARK_COLUMN(subject)];
+                *student_attendance(index, subject) = scores[ATTENDANCE_COLUMN(subject)];
+            }
+            end_score_rewrite(index);
+        }
+        if (status != 0) {
+            break;
+        }
+        double build_ms = elapsed_ms(&start);
+
+        BenchResult results[16];
+        int count = bench_roster(sizes[s], credential, &timer, results);
+        if (count >= 0 && !running_totals_verify(stderr)) {
+            count = -1;
+        }
+        if (count < 0) {
+            error_printf(C_RED "Error: the benchmark run at %ld students failed.\n" C_RESET, sizes[s]);
+            status = 1;
+            break;
+        }
+        printf("\n%ld students (built in %.1f ms)\n", sizes[s], build_ms);
+        printf("  %-10s %9s %14s %14s %12s %12s %12s %12s\n", "operation", "calls", "ns/op", "ops/s", "p50 ns", "p90 ns", "p99 ns", "max ns");
+        fprintf(json, "%s\n    {\"students\": %ld, \"build_ms\": %.1f, \"operations\": [", s > 0 ? "," : "", sizes[s], build_ms);
+        for (int i = 0; i < count; i++) {
+            const BenchResult *r = &results[i];
+            double mean = r->total_ns / r->ops;
+            printf("  %-10s %9ld %14.1f %14.1f %12llu %12llu %12llu %12llu\n", r->name, r->ops, mean, 1e9 / mean,
+                (unsigned long long)r->p50, (unsigned long long)r->p90, (unsigned long long)r->p99, (unsigned long long)r->max);
+            fprintf(json, "%s\n      ", i > 0 ? "," : "");
+            bench_print_json(json, r);
+        }
+        fprintf(json, "\n    ]}");
+    }
+    fprintf(json, "\n  ]\n}\n");
+    if (fclose(json) != 0) {
+        error_printf(C_RED "Error: writing %s failed: %s\n" C_RESET, json_path, strerror(errno));
+        status = 1;
+    } else if (status == 0) {
+        printf("\nResults written to %s\n", json_path);
+    }
+    free(timer.samples);
+    return status;
+}
+
+// Function to print one timed operation of the attendance benchmark
+static void print_attendance_timing(const char* what, BenchTimer* timer) {
+    BenchResult r = bench_result(what, timer);
+    printf("  %-28s %9ld %14.1f %12llu %12llu\n", what, r.ops, r.ops > 0 ? r.total_ns / r.ops : 0.0,
+        (unsigned long long)r.p50, (unsigned long long)r.p99);
+}
+
+// Function to check every live student's attendance against a bit-by-bit count of the
+// log. Returns the number of students whose count or cell is wrong.
+static long attendance_mismatches() {
+    long wrong = 0;
+    for (int subject = 0; subject < subject_count; subject++) {
+        int held = attendance_sessions[subject];
+        for (int i = store_next_live(&student_store, 0); i < student_store.slots; i = store_next_live(&student_store, i + 1)) {
+            int attended = 0;
+            for (int session = 0; session < held; session++) {
+                attended += session_attended(i, subject, session);
+            }
+            int expected = held > 0 ? attendance_percent(attended, held) : 0;
+            wrong += attendance_count(i, subject) != attended || *student_attendance(i, subject) != expected;
+        }
+    }
+    return wrong;
+}
+
+// --bench-attendance STUDENTS SESSIONS takes SESSIONS class sessions (up to a term's
+// SESSION_MAX) of every subject for a synthetic roster in memory: each as one
+// whole-class fill plus a few absentees, as a teacher would. It times the fills (with
+// the class recount that follows each), single corrections and one student's count,
+// checks every count against the bits one at a time, across a compaction too, and
+// reports the memory the log takes. Returns the process exit status.
+int run_attendance_benchmark(int students, int sessions) {
+    BenchTimer timer = { malloc(BENCH_SAMPLES * sizeof(uint64_t)), 0, { 0, 0 } };
+    if (timer.samples == NULL) {
+        return 1;
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < students; i++) {
+        StudentForm form;
+        char password[STUDENT_PASSWORD_MAX + 1];
+        uint8_t scores[STUDENT_COLUMNS];
+        synthetic_student((uint64_t)i, &form, password, scores);
+        strcpy(form.credential, "unused"); // Never checked here
+        if (insert_student(&form) == -1) {
+            error_printf(C_RED "Error: out of memory at %ld students.\n" C_RESET, i);
+            free(timer.samples);
+            return 1;
+        }
+    }
+    printf("Attendance log benchmark: %d students, %d session%s of each of %d subjects (popcount: %s)\n",
+        students, sessions, sessions == 1 ? "" : "s", subject_count, popcount_kernel_name);
+    printf("  roster built in %.1f ms\n", elapsed_ms(&start));
+    printf("  %-28s %9s %14s %12s %12s\n", "operation", "calls", "ns/op", "p50 ns", "p99 ns");
+
+    // Whole sessions, mostly everyone present; one in eight everyone absent
+    uint32_t seed = 0x9e3779b9u ^ (uint32_t)students;
+    int absentees = students / 50 > 0 ? students / 50 : 1;
+    long corrections = 0;
+    for (int session = 0; session < sessions; session++) {
+        for (int subject = 0; subject < subject_count; subject++) {
+            bench_begin(&timer);
+            take_session(subject, session % 8 != 7);
+            bench_end(&timer);
+        }
+    }
+    print_attendance_timing("take session (whole class)", &timer);
+
+    // Then some absentees at sessions already held
+    for (long i = 0; i < BENCH_SAMPLES && i < (long)absentees * sessions; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        int index = store_next_live(&student_store, (int)(seed % (uint32_t)student_store.slots));
+        if (index >= student_store.slots) {
+            continue;
+        }
+        int subject = (int)(i % subject_count);
+        bench_begin(&timer);
+        set_session_attendance(index, subject, (int)((seed >> 8) % (uint32_t)sessions), (seed >> 4) % 8 == 7);
+        bench_end(&timer);
+        corrections++;
+    }
+    print_attendance_timing("mark one student", &timer);
+
+    long samples = students < BENCH_SAMPLES ? students : BENCH_SAMPLES;
+    volatile int sink = 0;
+    for (long i = 0; i < samples; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        int index = store_next_live(&student_store, (int)(seed % (uint32_t)student_store.slots));
+        if (index >= student_store.slots) {
+            continue;
+        }
+        bench_begin(&timer);
+        sink += attendance_count(index, (int)(i % subject_count));
+        bench_end(&timer);
+    }
+    print_attendance_timing("count one student", &timer);
+    for (int subject = 0; subject < subject_count; subject++) {
+        bench_begin(&timer);
+        attendance_refresh_subject(subject);
+        bench_end(&timer);
+    }
+    print_attendance_timing("recount a subject", &timer);
+    (void)sink;
+
+    // Every count against the bits, then again once a tenth of the roster has gone and
+    // compaction has moved the rest
+    long wrong = attendance_mismatches();
+    for (int i = 0; i < student_store.slots; i += 10) {
+        if (store_is_live(&student_store, i)) {
+            delete_student(i);
+        }
+    }
+    compact_students();
+    wrong += attendance_mismatches();
+    printf("  %ld corrections; counts match the log bit by bit, before and after compaction: %s\n",
+        corrections, wrong == 0 ? "yes" : "NO");
+
+    AttendanceMemory memory;
+    attendance_memory(&memory);
+    printf("\n  memory for %d students, %d sessions held\n", student_store.count, memory.sessions);
+    printf("    bitmaps of the sessions held    %12.1f KB\n", memory.log_bytes / 1024.0);
+    printf("    pages resident                  %12.1f KB\n", memory.resident_bytes / 1024.0);
+    printf("    full term (%d x %d sessions)   %12.1f KB (%.1f bytes per student)\n", subject_count, SESSION_MAX,
+        memory.term_bytes / 1024.0, student_store.count > 0 ? (double)memory.term_bytes / student_store.count : 0.0);
+    printf("    the term at 1 byte per session  %12.1f KB\n", memory.byte_per_session_bytes / 1024.0);
+    free(timer.samples);
+    return wrong == 0 ? 0 : 1;
+}
+
+// --- Batch Command Mode ---
+// Non-interactive access for scripts (--batch FILE, "-" for stdin). Each input line is
+// one command; blank lines and lines starting with '#' are skipped:
+//
+//     login teacher USERNAME PASSWORD      login student SAP_ID PASSWORD      logout
+//     add SAP_ID PASSWORD FULL NAME        remove SAP_ID
+//     set-mark SAP_ID SUBJECT VALUE        set-attendance SAP_ID SUBJECT VALUE
+//     show [SAP_ID]                        subjects                           add-subject NAME
+//     top SUBJECT|total [N]                rank SUBJECT|total [SAP_ID]        find TEXT...
+//     session SUBJECT present|absent       present SAP_ID SUBJECT SESSION     absent SAP_ID SUBJECT SESSION
+//
+// SUBJECT is a subject name (any case) or its menu number. A teacher may run every
+// command; a student may only show their own record and rank, list the subjects and
+// see the toppers. Every command produces one tab-separated result line, without colour:
+//
+//     LINE <tab> ok <tab> COMMAND [<tab> FIELDS...]
+//     LINE <tab> error <tab> COMMAND <tab> MESSAGE
+//
+// where show's fields are the SAP ID, name, then marks and attendance per subject, in
+// the order subjects lists them. top gives the board and how many follow, then a rank,
+// SAP ID and score for each (N defaults to 10); rank gives the board, SAP ID, rank,
+// number ranked and score. find (teachers only) gives the number of students whose
+// names match and how many follow, then a SAP ID and name for each, first 20 by name.
+// session records a new class session with everyone present or absent and gives its
+// number; present and absent correct one student at a session already recorded and
+// give their attendance in the subject after it.
+// Changes are journaled as usual, but the journal is synced once per group of
+// commands instead of once per command. Results are held back until the group is
+// durable, so a result line that says "ok" is never lost in a crash.
+#define BATCH_GROUP_COMMANDS 4096
+#define BATCH_GROUP_BYTES (1 << 20)
+#define BATCH_MAX_TOKENS 4
+
+typedef enum { BATCH_NOBODY, BATCH_TEACHER, BATCH_STUDENT } BatchRole;
+
+typedef struct {
+    BatchRole role;
+    uint32_t student_key; // For BATCH_STUDENT
+    bool defer_logins;    // Leave password checks to the caller (the server's workers)
+    LoginJob *login;      // A deferred login waiting for its check; no commands run meanwhile
+    char *output;
+    size_t output_length;
+    size_t output_capacity;
+    long commands;
+    long errors;
+} BatchSession;
+
+// Function to append formatted text to the pending results (dropped if out of memory)
+static void batch_printf(BatchSession* session, const char* format, ...) {
+    va_list args;
+    while (true) {
+        size_t room = session->output_capacity - session->output_length;
+        va_start(args, format);
+        int needed = vsnprintf(session->output + session->output_length, room, format, args);
+        va_end(args);
+        if (needed < 0) {
+            return;
+        }
+        if ((size_t)needed < room) {
+            session->output_length += (size_t)needed;
+            return;
+        }
+        size_t capacity = session->output_capacity * 2 + (size_t)needed + 1;
+        char *output = realloc(session->output, capacity);
+        if (output == NULL) {
+            return;
+        }
+        session->output = output;
+        session->output_capacity = capacity;
+    }
+}
+
+static void batch_error(BatchSession* session, long line, const char* command, const char* message) {
+    batch_printf(session, "%ld\terror\t%s\t%s\n", line, command, message);
+    session->errors++;
+}
+
+// Function to make the pending changes durable, then release their results
+static void batch_flush(BatchSession* session, FILE* out) {
+    wal_sync();
+    sap_index_reclaim(); // Nothing reads the index between commands
+    fwrite(session->output, 1, session->output_length, out);
+    fflush(out);
+    session->output_length = 0;
+}
+
+// Function to find a subject by name or menu number, or -1
+static int batch_subject(const char* text) {
+    int subject = subject_find(text);
+    if (subject != -1) {
+        return subject;
+    }
+    char *end;
+    long number = strtol(text, &end, 10);
+    return *end == '\0' && number >= 1 && number <= subject_count ? (int)number - 1 : -1;
+}
+
+// Function to find a leaderboard by subject name or number, or "total", or -1
+static int batch_leaderboard(const char* text) {
+    return strcasecmp(text, "total") == 0 ? LEADERBOARD_TOTAL : batch_subject(text);
+}
+
+// Function to parse a 0-100 score, or return -1
+static int batch_score(const char* text) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    return *text != '\0' && *end == '\0' && value >= 0 && value <= 100 ? (int)value : -1;
+}
+
+// Function to look up the student a command names, reporting an error if there is none
+static int batch_student(BatchSession* session, long line, const char* command, const char* sap_id) {
+    uint32_t key;
+    if (!parse_sap_id(sap_id, &key)) {
+        batch_error(session, line, command, "SAP ID must be exactly 9 digits");
+        return -1;
+    }
+    uint64_t start = metric_clock();
+    int index = sap_index_lookup(key);
+    metric_record(METRIC_LOOKUP, start);
+    if (index == -1) {
+        batch_error(session, line, command, "no such student");
+    }
+    return index;
+}
+
+// Function to report a checked login and switch the session to the new role
+static void batch_finish_login(BatchSession* session, LoginJob* job) {
+    session->login = NULL;
+    // A student removed while the password was being checked cannot log in
+    bool accepted = job->accepted && (job->teacher || sap_index_lookup(job->student_key) != -1);
+    if (!accepted) {
+        batch_error(session, job->line, "login", job->teacher ? "invalid username or password" : "invalid SAP ID or password");
+    } else if (job->teacher) {
+        session->role = BATCH_TEACHER;
+        batch_printf(session, "%ld\tok\tlogin\tteacher\t%s\n", job->line, job->username);
+    } else {
+        session->role = BATCH_STUDENT;
+        session->student_key = job->student_key;
+        batch_printf(session, "%ld\tok\tlogin\tstudent\t%09u\n", job->line, job->student_key);
+    }
+    free(job);
+}
+
+// Function to start a login. The session is logged out at once; the password is then
+// checked here, or left in session->login for the caller when logins are deferred.
+static void batch_begin_login(BatchSession* session, long line, bool teacher, const char* id, const char* password) {
+    session->role = BATCH_NOBODY;
+    LoginJob *job = calloc(1, sizeof(LoginJob));
+    if (job == NULL) {
+        batch_error(session, line, "login", "out of memory");
+        return;
+    }
+    job->line = line;
+    job->teacher = teacher;
+    int index = -1;
+    if (teacher) {
+        index = strlen(id) < sizeof(job->username) ? find_teacher_index(id) : -1;
+        if (index != -1) {
+            strcpy(job->username, id);
+            strcpy(job->credential, teacher_credential(index));
+        }
+    } else if (parse_sap_id(id, &job->student_key) && (index = sap_index_lookup(job->student_key)) != -1) {
+        strcpy(job->credential, student_credential(index));
+    }
+    if (strlen(password) >= sizeof(job->password)) {
+        job->credential[0] = '\0'; // Too long to be anyone's password
+    }
+    snprintf(job->password, sizeof(job->password), "%s", password);
+    if (session->defer_logins) {
+        session->login = job;
+        return;
+    }
+    login_job_verify(job);
+    batch_finish_login(session, job);
+}
+
+// Function to run one command line (modified in place)
+static void batch_execute(BatchSession* session, long line, char* text) {
+    char *tokens[BATCH_MAX_TOKENS] = { NULL };
+    char *rest = text;
+    int count = 0;
+    while (count < BATCH_MAX_TOKENS) {
+        rest += strspn(rest, " \t");
+        if (*rest == '\0') {
+            break;
+        }
+        tokens[count++] = rest;
+        rest += strcspn(rest, " \t");
+        if (*rest != '\0') {
+            *rest++ = '\0';
+        }
+    }
+    rest += strspn(rest, " \t"); // Whatever follows the fourth token (add's full name)
+    if (count == 0 || tokens[0][0] == '#') {
+        return;
+    }
+    const char *command = tokens[0];
+    session->commands++;
+
+    if (strcmp(command, "login") == 0) {
+        if (count != 4 || *rest != '\0') {
+            batch_error(session, line, command, "usage: login teacher|student ID PASSWORD");
+        } else if (strcmp(tokens[1], "teacher") == 0 || strcmp(tokens[1], "student") == 0) {
+            batch_begin_login(session, line, strcmp(tokens[1], "teacher") == 0, tokens[2], tokens[3]);
+        } else {
+            batch_error(session, line, command, "role must be teacher or student");
+        }
+        return;
+    }
+    if (strcmp(command, "logout") == 0) {
+        session->role = BATCH_NOBODY;
+        batch_printf(session, "%ld\tok\tlogout\n", line);
+        return;
+    }
+    if (session->role == BATCH_NOBODY) {
+        batch_error(session, line, command, "not logged in");
+        return;
+    }
+    if (strcmp(command, "subjects") == 0) {
+        batch_printf(session, "%ld\tok\tsubjects", line);
+        for (int subject = 0; subject < subject_count; subject++) {
+            batch_printf(session, "\t%s", subject_names[subject]);
+        }
+        batch_printf(session, "\n");
+        return;
+    }
+
+    if (strcmp(command, "show") == 0) {
+        uint32_t key = session->student_key;
+        if (count > 2) {
+            batch_error(session, line, command, "usage: show [SAP_ID]");
+            return;
+        }
+        if (count == 1 && session->role != BATCH_STUDENT) {
+            batch_error(session, line, command, "usage: show SAP_ID");
+            return;
+        }
+        if (count == 2 && !parse_sap_id(tokens[1], &key)) {
+            batch_error(session, line, command, "SAP ID must be exactly 9 digits");
+            return;
+        }
+        if (session->role == BATCH_STUDENT && key != session->student_key) {
+            batch_error(session, line, command, "students may only view their own record");
+            return;
+        }
+        // Reads go through the lock-free path, so they never wait for an edit
+        StudentView view;
+        if (!read_student(key, &view)) {
+            batch_error(session, line, command, "no such student");
+            return;
+        }
+        batch_printf(session, "%ld\tok\tshow\t%09u\t%s", line, view.sap_id, view.name);
+        for (int subject = 0; subject < view.subjects; subject++) {
+            batch_printf(session, "\t%d", view.marks[subject]);
+        }
+        for (int subject = 0; subject < view.subjects; subject++) {
+            batch_printf(session, "\t%d", view.attendance[subject]);
+        }
+        batch_printf(session, "\n");
+        return;
+    }
+    if (strcmp(command, "top") == 0) {
+        int board = count >= 2 ? batch_leaderboard(tokens[1]) : -1;
+        char *end = NULL;
+        long n = count == 3 ? strtol(tokens[2], &end, 10) : 10;
+        if (count < 2 || count > 3 || (end != NULL && *end != '\0') || n < 1 || n > LEADERBOARD_MAX_LISTED) {
+            batch_error(session, line, command, "usage: top SUBJECT|total [N], N up to 100");
+            return;
+        }
+        if (board == -1) {
+            batch_error(session, line, command, "no such subject");
+            return;
+        }
+        int indexes[LEADERBOARD_MAX_LISTED];
+        int32_t ranks[LEADERBOARD_MAX_LISTED];
+        pthread_mutex_lock(&student_write_lock);
+        int listed = leaderboard_top(board, (int)n, indexes, ranks);
+        batch_printf(session, "%ld\tok\ttop\t%s\t%d", line, leaderboard_name(board), listed);
+        for (int i = 0; i < listed; i++) {
+            batch_printf(session, "\t%d\t%09u\t%d", ranks[i], student_at(indexes[i])->sap_id,
+                leaderboard_score_of(board, indexes[i]));
+        }
+        pthread_mutex_unlock(&student_write_lock);
+        batch_printf(session, "\n");
+        return;
+    }
+    if (strcmp(command, "rank") == 0) {
+        uint32_t key = session->student_key;
+        int board = count >= 2 ? batch_leaderboard(tokens[1]) : -1;
+        if (count < 2 || count > 3 || (count == 2 && session->role != BATCH_STUDENT)) {
+            batch_error(session, line, command, session->role == BATCH_STUDENT ? "usage: rank SUBJECT|total"
+                                                                               : "usage: rank SUBJECT|total SAP_ID");
+            return;
+        }
+        if (board == -1) {
+            batch_error(session, line, command, "no such subject");
+            return;
+        }
+        if (count == 3 && !parse_sap_id(tokens[2], &key)) {
+            batch_error(session, line, command, "SAP ID must be exactly 9 digits");
+            return;
+        }
+        if (session->role == BATCH_STUDENT && key != session->student_key) {
+            batch_error(session, line, command, "students may only view their own rank");
+            return;
+        }
+        pthread_mutex_lock(&student_write_lock);
+        int index = sap_index_lookup(key);
+        int32_t out_of = 0;
+        int32_t rank = index != -1 ? leaderboard_rank(board, index, &out_of) : 0;
+        if (rank > 0) {
+            batch_printf(session, "%ld\tok\trank\t%s\t%09u\t%d\t%d\t%d\n", line, leaderboard_name(board), key,
+                rank, out_of, leaderboard_score_of(board, index));
+        }
+        pthread_mutex_unlock(&student_write_lock);
+        if (rank == 0) {
+            batch_error(session, line, command, index == -1 ? "no such student" : "out of memory");
+        }
+        return;
+    }
+    if (session->role != BATCH_TEACHER) {
+        batch_error(session, line, command, "teacher login required");
+        return;
+    }
+
+    if (strcmp(command, "find") == 0) {
+        if (count < 2) {
+            batch_error(session, line, command, "usage: find TEXT...");
+            return;
+        }
+        for (int i = 1; i < count; i++) { // Put the words split off above back together
+            char *end = tokens[i] + strlen(tokens[i]);
+            if (end < rest) {
+                *end = ' ';
+            }
+        }
+        int results[NAME_SEARCH_LISTED];
+        int total = 0;
+        pthread_mutex_lock(&student_write_lock);
+        int listed = search_students_by_name(tokens[1], results, NAME_SEARCH_LISTED, &total);
+        if (listed >= 0) {
+            batch_printf(session, "%ld\tok\tfind\t%d\t%d", line, total, listed);
+            for (int i = 0; i < listed; i++) {
+                batch_printf(session, "\t%09u\t%s", student_at(results[i])->sap_id, student_name(results[i]));
+            }
+            batch_printf(session, "\n");
+        }
+        pthread_mutex_unlock(&student_write_lock);
+        if (listed < 0) {
+            batch_error(session, line, command, "out of memory");
+        }
+        return;
+    }
+
+    if (strcmp(command, "add-subject") == 0) {
+        if (count != 2) {
+            batch_error(session, line, command, "usage: add-subject NAME");
+            return;
+        }
+        const char *problem;
+        int subject = add_subject(tokens[1], &problem);
+        if (subject == -1) {
+            batch_error(session, line, command, problem);
+        } else {
+            batch_printf(session, "%ld\tok\tadd-subject\t%s\t%d\n", line, subject_names[subject], subject + 1);
+        }
+        return;
+    }
+    if (strcmp(command, "add") == 0) {
+        if (count < 4) {
+            batch_error(session, line, command, "usage: add SAP_ID PASSWORD FULL NAME");
+            return;
+        }
+        // The name is everything after the password, including spaces
+        char *name = tokens[3];
+        if (*rest != '\0') {
+            name[strlen(name)] = ' ';
+        }
+        size_t name_length = strlen(name);
+        while (name_length > 0 && (name[name_length - 1] == ' ' || name[name_length - 1] == '\t')) {
+            name[--name_length] = '\0';
+        }
+        StudentForm form;
+        uint32_t key;
+        if (!parse_sap_id(tokens[1], &key)) {
+            batch_error(session, line, command, "SAP ID must be exactly 9 digits");
+        } else if (sap_index_lookup(key) != -1) {
+            batch_error(session, line, command, "SAP ID already exists");
+        } else if (strlen(tokens[2]) > STUDENT_PASSWORD_MAX) {
+            batch_error(session, line, command, "password must be 1-19 chars without spaces");
+        } else if (name_length >= sizeof(form.name)) {
+            batch_error(session, line, command, "name must be 1-49 chars");
+        } else {
+            memcpy(form.sap_id, tokens[1], sizeof(form.sap_id));
+            hash_password(tokens[2], form.credential);
+            strcpy(form.name, name);
+            if (add_student(&form) == -1) {
+                batch_error(session, line, command, "out of memory or store full");
+            } else {
+                batch_printf(session, "%ld\tok\tadd\t%s\n", line, tokens[1]);
+            }
+        }
+        return;
+    }
+    if (strcmp(command, "remove") == 0) {
+        if (count != 2) {
+            batch_error(session, line, command, "usage: remove SAP_ID");
+            return;
+        }
+        int index = batch_student(session, line, command, tokens[1]);
+        if (index != -1) {
+            remove_student(index);
+            batch_printf(session, "%ld\tok\tremove\t%s\n", line, tokens[1]);
+        }
+        return;
+    }
+    if (strcmp(command, "session") == 0) {
+        bool present = count == 3 && strcmp(tokens[2], "present") == 0;
+        if (count != 3 || *rest != '\0' || (!present && strcmp(tokens[2], "absent") != 0)) {
+            batch_error(session, line, command, "usage: session SUBJECT present|absent");
+            return;
+        }
+        int subject = batch_subject(tokens[1]);
+        if (subject == -1) {
+            batch_error(session, line, command, "unknown subject");
+            return;
+        }
+        int number = take_session(subject, present);
+        if (number == -1) {
+            batch_error(session, line, command, "every session of the term has been recorded");
+        } else {
+            batch_printf(session, "%ld\tok\tsession\t%s\t%d\n", line, subject_names[subject], number + 1);
+        }
+        return;
+    }
+    bool is_present = strcmp(command, "present") == 0;
+    if (is_present || strcmp(command, "absent") == 0) {
+        if (count != 4 || *rest != '\0') {
+            batch_error(session, line, command, is_present ? "usage: present SAP_ID SUBJECT SESSION"
+                                                           : "usage: absent SAP_ID SUBJECT SESSION");
+            return;
+        }
+        int subject = batch_subject(tokens[2]);
+        if (subject == -1) {
+            batch_error(session, line, command, "unknown subject");
+            return;
+        }
+        char *end;
+        long number = strtol(tokens[3], &end, 10);
+        if (*end != '\0' || number < 1 || number > attendance_sessions[subject]) {
+            batch_error(session, line, command, "no such session");
+            return;
+        }
+        int index = batch_student(session, line, command, tokens[1]);
+        if (index == -1) {
+            return;
+        }
+        if (!set_session_attendance(index, subject, (int)number - 1, is_present)) {
+            batch_error(session, line, command, "no such session");
+            return;
+        }
+        batch_printf(session, "%ld\tok\t%s\t%s\t%s\t%ld\t%d\n", line, command, tokens[1], subject_names[subject],
+            number, *student_attendance(index, subject));
+        return;
+    }
+    bool is_mark = strcmp(command, "set-mark") == 0;
+    if (is_mark || strcmp(command, "set-attendance") == 0) {
+        if (count != 4 || *rest != '\0') {
+            batch_error(session, line, command, is_mark ? "usage: set-mark SAP_ID SUBJECT VALUE"
+                                                        : "usage: set-attendance SAP_ID SUBJECT VALUE");
+            return;
+        }
+        int subject = batch_subject(tokens[2]);
+        int value = batch_score(tokens[3]);
+        if (subject == -1) {
+            batch_error(session, line, command, "unknown subject");
+            return;
+        }
+        if (value == -1) {
+            batch_error(session, line, command, "value must be 0-100");
+            return;
+        }
+        int index = batch_student(session, line, command, tokens[1]);
+        if (index == -1) {
+            return;
+        }
+        if (is_mark) {
+            set_student_mark(index, subject, value);
+        } else {
+            set_student_attendance(index, subject, value);
+        }
+        batch_printf(session, "%ld\tok\t%s\t%s\t%s\t%d\n", line, command, tokens[1], subject_names[subject], value);
+        return;
+    }
+    batch_error(session, line, command, "unknown command");
+}
+
+// Function to run every command in a script file (or stdin for "-"), writing results to
+// stdout and a summary to stderr. Returns the process exit status: 0 if every command
+// succeeded, 2 if some failed, 1 if the script could not be read.
+int run_batch(const char* path) {
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "Error: cannot open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    BatchSession session = { .role = BATCH_NOBODY };
+    session.output_capacity = BATCH_GROUP_BYTES;
+    session.output = malloc(session.output_capacity);
+    if (session.output == NULL) {
+        if (in != stdin) fclose(in);
+        return 1;
+    }
+    char *text = NULL;
+    size_t text_capacity = 0;
+    ssize_t length;
+    long line = 0;
+    long group = 0;
+    while ((length = getline(&text, &text_capacity, in)) != -1) {
+        line++;
+        while (length > 0 && (text[length - 1] == '\n' || text[length - 1] == '\r')) {
+            text[--length] = '\0';
+        }
+        batch_execute(&session, line, text);
+        if (++group >= BATCH_GROUP_COMMANDS || session.output_length >= BATCH_GROUP_BYTES) {
+            batch_flush(&session, stdout);
+            group = 0;
+        }
+    }
+    bool read_error = ferror(in);
+    free(text);
+    if (in != stdin) {
+        fclose(in);
+    }
+    // Indices are only held within a command, so compaction is safe here
+    if (store_needs_compaction(&student_store)) {
+        compact_students();
+    }
+    batch_flush(&session, stdout);
+    free(session.output);
+
+    double ms = elapsed_ms(&start);
+    fprintf(stderr, "Batch: %ld commands, %ld failed, in %.1f ms (%.0f commands/s)\n",
+        session.commands, session.errors, ms, ms > 0 ? session.commands / (ms / 1e3) : 0.0);
+    if (read_error) {
+        fprintf(stderr, "Error: reading %s failed: %s\n", path, strerror(errno));
+        return 1;
+    }
+    return session.errors > 0 ? 2 : 0;
+}
+
+// --- Network Server ---
+// --serve PORT accepts any number of clients on 127.0.0.1 and speaks the batch command
+// protocol (see "Batch Command Mode") over each connection: the client sends command
+// lines and gets one result line back per command, with its own login per connection.
+//
+// A single thread runs a non-blocking epoll loop, so a class full of students checking
+// their marks costs one socket each, not one thread each. Every loop iteration runs the
+// commands that arrived, syncs the journal once for all of them, and only then sends
+// the results, so concurrent edits share one fdatasync like the batch groups do.
+// A client that stops reading has its input paused until its results drain, and a
+// client that sent a login has its input paused until a login worker has checked it.
+#define SERVER_MAX_EVENTS 256
+#define SERVER_READ_BYTES 65536
+#define SERVER_MAX_LINE 4096            // A longer line closes the connection
+#define SERVER_MAX_BACKLOG (4 << 20)    // Pending result bytes before input is paused
+
+typedef struct ServerClient {
+    int fd;
+    BatchSession session;
+    char *input;
+    size_t input_length;
+    size_t input_capacity;
+    long line;
+    size_t sent;                // Bytes of session.output already written
+    bool paused;                // EPOLLIN off while the backlog drains
+    bool closing;               // Close once the results are sent
+    bool pending;               // On the list of clients with unsent results
+    struct ServerClient *next_pending;
+} ServerClient;
+
+typedef struct {
+    int epoll_fd;
+    int listen_fd;
+    int signal_fd;
+    int clients;
+    long commands;
+    ServerClient *pending; // Clients with results waiting for the next journal sync
+    LoginPool logins;
+} Server;
+
+static void server_watch(Server* server, ServerClient* client) {
+    struct epoll_event event = { .data.ptr = client };
+    bool reading = !client->paused && !client->closing && client->session.login == NULL;
+    event.events = (reading ? EPOLLIN | EPOLLRDHUP : 0)
+                 | (client->sent < client->session.output_length ? EPOLLOUT : 0);
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+}
+
+// Function to free a dropped client once nothing refers to it any more: neither the
+// list of pending results nor a login worker
+static void server_release_client(ServerClient* client) {
+    if (client->fd == -1 && !client->pending && client->session.login == NULL) {
+        free(client->session.output);
+        free(client->input);
+        free(client);
+    }
+}
+
+static void server_drop(Server* server, ServerClient* client) {
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    client->fd = -1;
+    server->clients--;
+    server_release_client(client);
+}
+
+static void server_accept(Server* server) {
+    while (true) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                fprintf(stderr, "Warning: accept failed: %s\n", strerror(errno));
+            }
+            return;
+        }
+        ServerClient *client = calloc(1, sizeof(ServerClient));
+        if (client != NULL) {
+            client->session.output_capacity = 4096;
+            client->session.output = malloc(client->session.output_capacity);
+        }
+        struct epoll_event event = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = client };
+        if (client == NULL || client->session.output == NULL || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            if (client != NULL) free(client->session.output);
+            free(client);
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->session.role = BATCH_NOBODY;
+        client->session.defer_logins = true;
+        server->clients++;
+    }
+}
+
+// Function to queue a client's new results for sending after the next journal sync
+static void server_mark_pending(Server* server, ServerClient* client) {
+    if (!client->pending) {
+        client->pending = true;
+        client->next_pending = server->pending;
+        server->pending = client;
+    }
+}
+
+// Function to run every complete command line a client has sent so far
+static void server_run_lines(Server* server, ServerClient* client) {
+    size_t start = 0;
+    char *newline;
+    while (client->session.login == NULL
+           && (newline = memchr(client->input + start, '\n', client->input_length - start)) != NULL) {
+        *newline = '\0';
+        if (newline > client->input + start && newline[-1] == '\r') {
+            newline[-1] = '\0';
+        }
+        long before = client->session.commands;
+        batch_execute(&client->session, ++client->line, client->input + start);
+        server->commands += client->session.commands - before;
+        start = (size_t)(newline - client->input) + 1;
+        if (client->session.login != NULL) {
+            // The lines after a login wait until it has been checked
+            client->session.login->owner = client;
+            login_pool_submit(&server->logins, client->session.login);
+        }
+    }
+    memmove(client->input, client->input + start, client->input_length - start);
+    client->input_length -= start;
+    if (client->session.login == NULL && client->input_length > SERVER_MAX_LINE) {
+        batch_error(&client->session, client->line + 1, "-", "line too long");
+        client->closing = true;
+    }
+    if (client->session.output_length > client->sent) {
+        server_mark_pending(server, client);
+    }
+}
+
+static void server_read(Server* server, ServerClient* client) {
+    while (!client->closing && client->session.login == NULL) {
+        if (client->input_capacity - client->input_length < SERVER_READ_BYTES) {
+            size_t capacity = client->input_length + SERVER_READ_BYTES;
+            char *input = realloc(client->input, capacity);
+            if (input == NULL) {
+                client->closing = true;
+                break;
+            }
+            client->input = input;
+            client->input_capacity = capacity;
+        }
+        ssize_t got = read(client->fd, client->input + client->input_length, client->input_capacity - client->input_length);
+        if (got > 0) {
+            client->input_length += (size_t)got;
+            server_run_lines(server, client);
+            if (client->session.output_length - client->sent > SERVER_MAX_BACKLOG) {
+                client->paused = true;
+                break;
+            }
+        } else if (got == 0) {
+            client->closing = true; // Peer finished sending; answer what it sent, then close
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                client->closing = true;
+            }
+            break;
+        }
+    }
+    if (client->closing) {
+        server_mark_pending(server, client);
+    }
+}
+
+// Function to send as much of a client's results as the socket takes. Returns false
+// if the client was dropped.
+static bool server_write(Server* server, ServerClient* client) {
+    BatchSession *session = &client->session;
+    while (client->sent < session->output_length) {
+        ssize_t put = send(client->fd, session->output + client->sent, session->output_length - client->sent, MSG_NOSIGNAL);
+        if (put > 0) {
+            client->sent += (size_t)put;
+        } else if (put == -1 && errno == EINTR) {
+            continue;
+        } else if (put == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            server_drop(server, client);
+            return false;
+        }
+    }
+    if (client->sent == session->output_length) {
+        session->output_length = client->sent = 0;
+        if (client->closing && session->login == NULL) {
+            server_drop(server, client);
+            return false;
+        }
+        client->paused = false; // Level-triggered, so input that waited is reported again
+    }
+    server_watch(server, client);
+    return true;
+}
 
-Teacher teachers[MAX_TEACHERS];
-int teacher_count = 0;
+// Function to make this iteration's edits durable, then send every queued result
+static void server_release_pending(Server* server) {
+    if (server->pending == NULL) {
+        return;
+    }
+    wal_sync();
+    while (server->pending != NULL) {
+        ServerClient *client = server->pending;
+        server->pending = client->next_pending;
+        client->pending = false;
+        if (client->fd == -1) { // Dropped while queued
+            server_release_client(client);
+            continue;
+        }
+        server_write(server, client);
+    }
+}
 
-// --- Utility Functions ---
+// Function to report the logins the workers have checked and run the lines that were
+// waiting behind them
+static void server_finish_logins(Server* server) {
+    for (LoginJob *job = login_pool_collect(&server->logins), *next; job != NULL; job = next) {
+        next = job->next;
+        ServerClient *client = job->owner;
+        batch_finish_login(&client->session, job);
+        if (client->fd == -1) {
+            server_release_client(client);
+            continue;
+        }
+        server_run_lines(server, client);
+        server_mark_pending(server, client);
+        server_watch(server, client);
+    }
+}
 
-// Function to clear the input buffer
-void clear_input_buffer() {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF);
+static int server_listen(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
-// Function to find a student's index by SAP ID
-int find_student_index(const char* sap_id) {
-    for (int i = 0; i < student_count; i++) {
-        if (strcmp(students[i].sap_id, sap_id) == 0) {
-            return i;
+// Function to serve clients until SIGINT or SIGTERM. Returns the process exit status.
+int run_server(int port) {
+    Server server = { .epoll_fd = -1, .listen_fd = -1, .signal_fd = -1 };
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    server.listen_fd = server_listen(port);
+    if (server.listen_fd == -1) {
+        error_printf(C_RED "Error: cannot listen on 127.0.0.1:%d: %s\n" C_RESET, port, strerror(errno));
+        return 1;
+    }
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server.signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    struct epoll_event listen_event = { .events = EPOLLIN, .data.ptr = &server.listen_fd };
+    struct epoll_event signal_event = { .events = EPOLLIN, .data.ptr = &server.signal_fd };
+    if (server.epoll_fd == -1 || server.signal_fd == -1
+        || epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &listen_event) != 0
+        || epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.signal_fd, &signal_event) != 0
+        || !login_pool_start(&server.logins, worker_thread_count)) {
+        error_printf(C_RED "Error: cannot set up the event loop: %s\n" C_RESET, strerror(errno));
+        return 1;
+    }
+    struct epoll_event login_event = { .events = EPOLLIN, .data.ptr = &server.logins };
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.logins.event_fd, &login_event);
+    fprintf(stderr, "Serving %d students on 127.0.0.1:%d (Ctrl+C to stop).\n", student_store.count, port);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    bool running = true;
+    while (running) {
+        int ready = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (ready == -1 && errno != EINTR) {
+            error_printf(C_RED "Error: epoll_wait failed: %s\n" C_RESET, strerror(errno));
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.ptr == &server.listen_fd) {
+                server_accept(&server);
+            } else if (events[i].data.ptr == &server.signal_fd) {
+                running = false;
+            } else if (events[i].data.ptr == &server.logins) {
+                server_finish_logins(&server);
+            } else {
+                ServerClient *client = events[i].data.ptr;
+                if (client->fd == -1) {
+                    continue; // Dropped earlier in this batch of events
+                }
+                if ((events[i].events & (EPOLLHUP | EPOLLERR)) && client->session.login != NULL) {
+                    server_drop(&server, client); // Gone, and not reading: stop reporting it
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    if (!server_write(&server, client)) {
+                        continue;
+                    }
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    server_read(&server, client);
+                }
+            }
+        }
+        server_release_pending(&server);
+        sap_index_reclaim();
+        // Indices are only held within a command, so the loop is a safe point to compact
+        if (store_needs_compaction(&student_store)) {
+            compact_students();
         }
     }
-    return -1; // Not found
-}
 
-// Function to display student details (for teacher view)
-void display_student_details(int index) {
-    Student s = students[index];
-    printf(C_YELLOW "----------------------------------------\n" C_RESET);
-    printf("Name: " C_CYAN "%s" C_RESET "\n", s.name);
-    printf("SAP ID: " C_CYAN "%s" C_RESET "\n", s.sap_id);
-    
-    printf(C_BOLD "\nMarks (out of 100):" C_RESET "\n");
-    printf("  Maths: " C_YELLOW "%d" C_RESET "\n", s.marks_maths);
-    printf("  Physics: " C_YELLOW "%d" C_RESET "\n", s.marks_physics);
-    printf("  Coding: " C_YELLOW "%d" C_RESET "\n", s.marks_coding);
-    
-    printf(C_BOLD "\nAttendance (%%):" C_RESET "\n");
-    printf("  Maths: " C_YELLOW "%d%%" C_RESET "\n", s.attendance_maths);
-    printf("  Physics: " C_YELLOW "%d%%" C_RESET "\n", s.attendance_physics);
-    printf("  Coding: " C_YELLOW "%d%%" C_RESET "\n", s.attendance_coding);
-    
-    printf(C_YELLOW "----------------------------------------\n" C_RESET);
+    fprintf(stderr, "Stopping: %ld commands served, %d clients still connected.\n", server.commands, server.clients);
+    login_pool_stop(&server.logins);
+    close(server.listen_fd);
+    close(server.signal_fd);
+    close(server.epoll_fd);
+    return 0;
 }
 
 // --- Initial Data Setup ---
 
 void create_initial_data() {
-    printf(C_BLUE C_BOLD "\n--- INITIAL SYSTEM SETUP ---\n" C_RESET);
-    printf(C_YELLOW "This data is NOT saved permanently and will reset on exit.\n" C_RESET);
+    screen_printf(C_BLUE C_BOLD "\n--- INITIAL SYSTEM SETUP ---\n" C_RESET);
+    if (persistent_mode()) {
+        screen_printf(C_YELLOW "Accounts created here are saved in '%s' and loaded automatically next time.\n" C_RESET, data_dir);
+    } else {
+        screen_printf(C_YELLOW "This data is NOT saved permanently and will reset on exit.\n" C_RESET);
+    }
 
     int num_teachers;
     int num_students;
 
     // 1. Get number of teachers from user
     while (true) {
-        printf("\nHow many initial Teacher Accounts do you want to create (Max " C_CYAN "%d" C_RESET ")? ", MAX_TEACHERS);
-        if (scanf("%d", &num_teachers) != 1 || num_teachers < 1 || num_teachers > MAX_TEACHERS) {
-            printf(C_RED "Error: Invalid number. Please enter a value between 1 and %d.\n" C_RESET, MAX_TEACHERS);
-            clear_input_buffer();
+        screen_prompt("\nHow many initial Teacher Accounts do you want to create? ");
+        if (!input_int(&num_teachers) || num_teachers < 1 || num_teachers > STORE_CAPACITY) {
+            screen_printf(C_RED "Error: Invalid number. Please enter a value between 1 and %d.\n" C_RESET, STORE_CAPACITY);
+            input_skip_line();
         } else {
-            clear_input_buffer();
+            input_skip_line();
             break;
         }
     }
 
     // 1. Initial Teacher Data
-    printf(C_BLUE C_BOLD "\n--- Initial Teacher Accounts (%d) ---\n" C_RESET, num_teachers);
+    screen_printf(C_BLUE C_BOLD "\n--- Initial Teacher Accounts (%d) ---\n" C_RESET, num_teachers);
     for (int i = 0; i < num_teachers; i++) {
-        if (teacher_count >= MAX_TEACHERS) break;
-        printf("Entering Teacher " C_YELLOW "%d/%d" C_RESET " details...\n", i + 1, num_teachers);
-        printf("Enter Username (no spaces): ");
-        scanf("%49s", teachers[teacher_count].username);
-        printf("Enter Password (no spaces): ");
-        scanf("%49s", teachers[teacher_count].password);
-        clear_input_buffer();
-        teacher_count++;
+        TeacherForm t;
+        screen_printf("Entering Teacher " C_YELLOW "%d/%d" C_RESET " details...\n", i + 1, num_teachers);
+        screen_prompt("Enter Username (no spaces): ");
+        input_word(t.username, sizeof t.username);
+        char password[TEACHER_PASSWORD_MAX + 1];
+        screen_prompt("Enter Password (no spaces): ");
+        input_word(password, sizeof password);
+        input_skip_line();
+        hash_password(password, t.credential);
+        if (add_teacher(&t) == -1) break;
     }
 
-    // 2. Get number of students from user
+    // 2. Get number of students from user (none needed if a roster was already imported)
+    int min_students = student_store.count > 0 ? 0 : 1;
     while (true) {
-        printf("\nHow many initial Student Accounts do you want to create (Max " C_CYAN "%d" C_RESET ")? ", MAX_STUDENTS);
-        if (scanf("%d", &num_students) != 1 || num_students < 1 || num_students > MAX_STUDENTS) {
-            printf(C_RED "Error: Invalid number. Please enter a value between 1 and %d.\n" C_RESET, MAX_STUDENTS);
-            clear_input_buffer();
+        screen_prompt("\nHow many initial Student Accounts do you want to create? ");
+        if (!input_int(&num_students) || num_students < min_students || num_students > STORE_CAPACITY) {
+            screen_printf(C_RED "Error: Invalid number. Please enter a value between %d and %d.\n" C_RESET, min_students, STORE_CAPACITY);
+            input_skip_line();
         } else {
-            clear_input_buffer();
+            input_skip_line();
             break;
         }
     }
 
     // 2. Initial Student Data
-    printf(C_BLUE C_BOLD "\n--- Initial Student Accounts (%d) ---\n" C_RESET, num_students);
+    screen_printf(C_BLUE C_BOLD "\n--- Initial Student Accounts (%d) ---\n" C_RESET, num_students);
     for (int i = 0; i < num_students; i++) {
-        if (student_count >= MAX_STUDENTS) break;
-        Student *s = &students[student_count];
+        StudentForm new_student;
+        StudentForm *s = &new_student;
         
-        printf("Entering Student " C_YELLOW "%d/%d" C_RESET " details...\n", i + 1, num_students);
+        screen_printf("Entering Student " C_YELLOW "%d/%d" C_RESET " details...\n", i + 1, num_students);
         
         // Input SAP ID
         while (true) {
-            printf("Enter 9-digit SAP ID: ");
-            scanf("%10s", s->sap_id);
-            clear_input_buffer();
-            if (strlen(s->sap_id) == SAP_ID_LENGTH) {
-                if (find_student_index(s->sap_id) == -1) {
-                    break;
-                } else {
-                    printf(C_RED "Error: SAP ID already exists. Try again.\n" C_RESET);
-                }
-            } else {
-                printf(C_RED "Error: SAP ID must be exactly %d digits.\n" C_RESET, SAP_ID_LENGTH);
+            screen_prompt("Enter 9-digit SAP ID: ");
+            input_sap_id(s->sap_id);
+            input_skip_line();
+            if (check_new_sap_id(s->sap_id)) {
+                break;
             }
         }
         
         // Input Password
-        printf("Enter Password (max 19 chars, no spaces): ");
-        scanf("%19s", s->password);
-        clear_input_buffer();
+        char password[STUDENT_PASSWORD_MAX + 1];
+        screen_prompt("Enter Password (max 19 chars, no spaces): ");
+        input_word(password, sizeof password);
+        input_skip_line();
+        hash_password(password, s->credential);
 
-        // Input Name (using fgets for name with spaces)
-        printf("Enter Student Name: ");
-        if (fgets(s->name, 50, stdin)) {
+        // Input Name (the whole line, so it can have spaces)
+        screen_prompt("Enter Student Name: ");
+        if (input_line(s->name, sizeof s->name)) {
             s->name[strcspn(s->name, "\n")] = 0; // Remove newline
         } else {
             strcpy(s->name, "Unknown Student");
         }
 
-        // Initialize Data (Teacher must update these later)
-        s->attendance_maths = s->attendance_physics = s->attendance_coding = 0;
-        s->marks_maths = s->marks_physics = s->marks_coding = 0;
         
-        student_count++;
+        if (add_student(s) == -1) break;
     }
+    wal_sync();
 
-    printf(C_GREEN C_BOLD "\nInitial data setup complete! The system is now ready with %d students and %d teachers.\n"
-         C_RESET, student_count, teacher_count);
+    screen_printf(C_GREEN C_BOLD "\nInitial data setup complete! The system is now ready with %d students and %d teachers.\n"
+         C_RESET, student_store.count, teacher_store.count);
 }
 
 // --- Student Portal Functions ---
 
 int student_login() {
     char sap_id[SAP_ID_LENGTH + 1];
-    char password[20];
+    char password[STUDENT_PASSWORD_MAX + 1];
     
-    printf(C_BLUE "\n--- Student Login ---\n" C_RESET);
-    printf("Enter 9-digit SAP ID: ");
-    scanf("%10s", sap_id);
-    printf("Enter Password: ");
-    scanf("%19s", password);
-    clear_input_buffer();
+    screen_printf(C_BLUE "\n--- Student Login ---\n" C_RESET);
+    screen_prompt("Enter 9-digit SAP ID: ");
+    input_sap_id(sap_id);
+    screen_prompt("Enter Password: ");
+    input_word(password, sizeof password);
+    input_skip_line();
     
     int index = find_student_index(sap_id);
     
-    if (index != -1 && strcmp(students[index].password, password) == 0) {
-        printf(C_GREEN "\nLogin Successful! Welcome, %s.\n" C_RESET, students[index].name);
+    // An unknown SAP ID is checked against a decoy, so it takes as long as a bad password
+    if (verify_password(password, index != -1 ? student_credential(index) : NULL)) {
+        screen_printf(C_GREEN "\nLogin Successful! Welcome, %s.\n" C_RESET, student_name(index));
         return index;
     } else {
-        printf(C_RED "\nLogin Failed: Invalid SAP ID or Password.\n" C_RESET);
+        screen_printf(C_RED "\nLogin Failed: Invalid SAP ID or Password.\n" C_RESET);
         return -1;
     }
 }
 
 void student_portal(int index) {
-    Student s = students[index];
-    printf(C_BLUE C_BOLD "\n========================================\n" C_RESET);
-    printf(C_CYAN C_BOLD "       STUDENT PORTAL - Dashboard       \n" C_RESET);
-    printf(C_BLUE C_BOLD "========================================\n" C_RESET);
-    printf("Welcome, " C_CYAN "%s" C_RESET " (SAP ID: " C_YELLOW "%s" C_RESET ")\n", s.name, s.sap_id);
-    printf(C_BLUE "\n--- Academic Record ---\n" C_RESET);
-
-    printf("\n" C_BOLD "| Subject | Marks (Out of 100) | Attendance (%%) |\n" C_RESET);
-    printf(C_BLUE "|---------|--------------------|-------------------|\n" C_RESET);
-    printf("| " C_CYAN "Maths" C_RESET "   | %-18d | %-17d |\n", s.marks_maths, s.attendance_maths);
-    printf("| " C_CYAN "Physics" C_RESET " | %-18d | %-17d |\n", s.marks_physics, s.attendance_physics);
-    printf("| " C_CYAN "Coding" C_RESET "  | %-18d | %-17d |\n", s.marks_coding, s.attendance_coding);
-    printf(C_YELLOW "\nNote: Attendance is out of 100 classes.\n" C_RESET);
+    uint64_t start = metric_clock();
+    screen_printf(C_BLUE C_BOLD "\n========================================\n" C_RESET);
+    screen_printf(C_CYAN C_BOLD "       STUDENT PORTAL - Dashboard       \n" C_RESET);
+    screen_printf(C_BLUE C_BOLD "========================================\n" C_RESET);
+    screen_printf("Welcome, " C_CYAN "%s" C_RESET " (SAP ID: " C_YELLOW "%09u" C_RESET ")\n", student_name(index), student_at(index)->sap_id);
+    screen_printf(C_BLUE "\n--- Academic Record ---\n" C_RESET);
+
+    int width = subject_label_width();
+    screen_printf("\n" C_BOLD "| %-*s | Marks (Out of 100) | Attendance (%%) |\n" C_RESET, width, "Subject");
+    screen_color(C_BLUE);
+    screen_subject_rule('|', width, "--------------------|-------------------|\n");
+    screen_color(C_RESET);
+    for (int subject = 0; subject < subject_count; subject++) {
+        screen_printf("| " C_CYAN "%-*s" C_RESET " | %-18d | %-17d |\n", width, subject_names[subject],
+            *student_mark(index, subject), *student_attendance(index, subject));
+    }
+    int32_t out_of = 0;
+    pthread_mutex_lock(&student_write_lock);
+    int32_t rank = leaderboard_rank(LEADERBOARD_TOTAL, index, &out_of);
+    pthread_mutex_unlock(&student_write_lock);
+    if (rank > 0) {
+        screen_printf("\nClass rank by total marks: " C_GREEN "%d" C_RESET " of %d\n", rank, out_of);
+    }
+    // Attendance taken by class session is the share of sessions held, so say how many
+    bool sessions_heading = false;
+    for (int subject = 0; subject < subject_count; subject++) {
+        if (attendance_sessions[subject] == 0) {
+            continue;
+        }
+        if (!sessions_heading) {
+            screen_printf(C_YELLOW "\nAttendance by class session:\n" C_RESET);
+            sessions_heading = true;
+        }
+        screen_printf("  %s: " C_YELLOW "%d%%" C_RESET " (%d of %d sessions)\n", subject_names[subject],
+            *student_attendance(index, subject), attendance_count(index, subject), attendance_sessions[subject]);
+    }
+    metric_record(METRIC_RENDER, start);
     
-    printf("\nPress Enter to return to Home Menu...");
-    clear_input_buffer();
-    getchar();
+    screen_prompt("\nPress Enter to return to Home Menu...");
+    input_skip_line();
 }
 
 // --- Teacher Portal Functions ---
 
 bool teacher_login() {
     char username[50];
-    char password[50];
+    char password[TEACHER_PASSWORD_MAX + 1];
     
-    printf(C_BLUE "\n--- Teacher Login ---\n" C_RESET);
-    printf("Enter Username: ");
-    scanf("%49s", username);
-    printf("Enter Password: ");
-    scanf("%49s", password);
-    clear_input_buffer();
+    screen_printf(C_BLUE "\n--- Teacher Login ---\n" C_RESET);
+    screen_prompt("Enter Username: ");
+    input_word(username, sizeof username);
+    screen_prompt("Enter Password: ");
+    input_word(password, sizeof password);
+    input_skip_line();
     
-    for (int i = 0; i < teacher_count; i++) {
-        if (strcmp(teachers[i].username, username) == 0 && strcmp(teachers[i].password, password) == 0) {
-            printf(C_GREEN "\nLogin Successful! Welcome, Teacher %s.\n" C_RESET, teachers[i].username);
-            return true;
-        }
+    int index = find_teacher_index(username);
+    if (verify_password(password, index != -1 ? teacher_credential(index) : NULL)) {
+        screen_printf(C_GREEN "\nLogin Successful! Welcome, Teacher %s.\n" C_RESET, teacher_username(index));
+        return true;
     }
     
-    printf(C_RED "\nLogin Failed: Invalid Username or Password.\n" C_RESET);
+    screen_printf(C_RED "\nLogin Failed: Invalid Username or Password.\n" C_RESET);
     return false;
 }
 
+// Function to pick a subject and set one student's mark or attendance in it
+static void teacher_update_score(int index, bool attendance) {
+    const char *what = attendance ? "attendance" : "marks";
+    const char *unit = attendance ? "%" : "";
+    screen_printf(C_BLUE "Select Subject to update %s (0-100%s):\n" C_RESET, what, unit);
+    for (int subject = 0; subject < subject_count; subject++) {
+        int current = attendance ? *student_attendance(index, subject) : *student_mark(index, subject);
+        screen_printf("  %d. %s (Current: %d%s)\n", subject + 1, subject_names[subject], current, unit);
+    }
+    screen_prompt("Enter subject choice (1-%d): ", subject_count);
+    int choice;
+    if (!input_int(&choice)) {
+        input_skip_line();
+        return;
+    }
+
+    int subject = choice - 1;
+    if (subject < 0 || subject >= subject_count) {
+        screen_printf(C_RED "Invalid subject choice.\n" C_RESET);
+        return;
+    }
+    const char* subject_name = subject_names[subject];
+
+    int value;
+    screen_prompt("Enter new %s for %s (0-100%s): ", what, subject_name, unit);
+    if (input_int(&value) && value >= 0 && value <= 100) {
+        if (attendance) {
+            set_student_attendance(index, subject, value);
+        } else {
+            set_student_mark(index, subject, value);
+        }
+        wal_sync();
+        screen_printf(C_GREEN "%s %s updated.\n" C_RESET, subject_name, what);
+    } else {
+        screen_printf(C_RED "Invalid input or %s outside 0-100%s range.\n" C_RESET, what, unit);
+    }
+    input_skip_line();
+}
+
 void teacher_edit_student_data() {
     char sap_id[SAP_ID_LENGTH + 1];
-    printf(C_BLUE "\n--- Edit Student Record ---\n" C_RESET);
-    printf("Enter SAP ID of student to modify: ");
-    scanf("%10s", sap_id);
-    clear_input_buffer();
+    screen_printf(C_BLUE "\n--- Edit Student Record ---\n" C_RESET);
+    screen_prompt("Enter SAP ID of student to modify: ");
+    input_sap_id(sap_id);
+    input_skip_line();
 
     int index = find_student_index(sap_id);
     if (index == -1) {
-        printf(C_RED "Error: Student with SAP ID %s not found.\n" C_RESET, sap_id);
+        screen_printf(C_RED "Error: Student with SAP ID %s not found.\n" C_RESET, sap_id);
         return;
     }
 
-    Student *s = &students[index];
     int choice;
 
     do {
-        printf(C_CYAN "\nEditing Record for: %s (SAP ID: %s)\n" C_RESET, s->name, s->sap_id);
-        printf("1. " C_YELLOW "Update Marks\n" C_RESET);
-        printf("2. " C_YELLOW "Update Attendance\n" C_RESET);
-        printf("3. View Current Data\n");
-        printf("0. Finish Editing\n");
-        printf("Enter choice: ");
-        if (scanf("%d", &choice) != 1) {
+        screen_printf(C_CYAN "\nEditing Record for: %s (SAP ID: %09u)\n" C_RESET, student_name(index), student_at(index)->sap_id);
+        screen_printf("1. " C_YELLOW "Update Marks\n" C_RESET);
+        screen_printf("2. " C_YELLOW "Update Attendance\n" C_RESET);
+        screen_printf("3. View Current Data\n");
+        screen_printf("0. Finish Editing\n");
+        screen_prompt("Enter choice: ");
+        if (!input_int(&choice)) {
             choice = -1; // Force retry
         }
-        clear_input_buffer();
+        input_skip_line();
 
-        int temp_val;
         switch (choice) {
-            case 1: { // Update Marks
-                printf(C_BLUE "Select Subject to update marks (0-100):\n" C_RESET);
-                printf("  1. Maths (Current: %d)\n", s->marks_maths);
-                printf("  2. Physics (Current: %d)\n", s->marks_physics);
-                printf("  3. Coding (Current: %d)\n", s->marks_coding);
-                printf("Enter subject choice (1-3): ");
-                if (scanf("%d", &temp_val) != 1) { clear_input_buffer(); break; }
-                
-                int* mark_ptr = NULL;
-                char subject_name[10];
-
-                if (temp_val == 1) { mark_ptr = &s->marks_maths; strcpy(subject_name, "Maths"); }
-                else if (temp_val == 2) { mark_ptr = &s->marks_physics; strcpy(subject_name, "Physics"); }
-                else if (temp_val == 3) { mark_ptr = &s->marks_coding; strcpy(subject_name, "Coding"); }
-                else { printf(C_RED "Invalid subject choice.\n" C_RESET); break; }
-
-                printf("Enter new marks for %s (0-100): ", subject_name);
-                if (scanf("%d", &temp_val) == 1 && temp_val >= 0 && temp_val <= 100) {
-                    *mark_ptr = temp_val;
-                    printf(C_GREEN "%s marks updated.\n" C_RESET, subject_name);
-                } else {
-                    printf(C_RED "Invalid input or marks outside 0-100 range.\n" C_RESET);
-                }
-                clear_input_buffer();
+            case 1: // Update Marks
+                teacher_update_score(index, false);
                 break;
-            }
-            case 2: { // Update Attendance
-                printf(C_BLUE "Select Subject to update attendance (0-100%%):\n" C_RESET);
-                printf("  1. Maths (Current: %d%%)\n", s->attendance_maths);
-                printf("  2. Physics (Current: %d%%)\n", s->attendance_physics);
-                printf("  3. Coding (Current: %d%%)\n", s->attendance_coding);
-                printf("Enter subject choice (1-3): ");
-                if (scanf("%d", &temp_val) != 1) { clear_input_buffer(); break; }
-                
-                int* att_ptr = NULL;
-                char subject_name[10];
-
-                if (temp_val == 1) { att_ptr = &s->attendance_maths; strcpy(subject_name, "Maths"); }
-                else if (temp_val == 2) { att_ptr = &s->attendance_physics; strcpy(subject_name, "Physics"); }
-                else if (temp_val == 3) { att_ptr = &s->attendance_coding; strcpy(subject_name, "Coding"); }
-                else { printf(C_RED "Invalid subject choice.\n" C_RESET); break; }
-
-                printf("Enter new attendance for %s (0-100%%): ", subject_name);
-                if (scanf("%d", &temp_val) == 1 && temp_val >= 0 && temp_val <= 100) {
-                    *att_ptr = temp_val;
-                    printf(C_GREEN "%s attendance updated.\n" C_RESET, subject_name);
-                } else {
-                    printf(C_RED "Invalid input or attendance outside 0-100%% range.\n" C_RESET);
-                }
-                clear_input_buffer();
+            case 2: // Update Attendance
+                teacher_update_score(index, true);
                 break;
-            }
             case 3: // View Current Data
                 display_student_details(index);
                 break;
             case 0:
-                printf(C_YELLOW "Finishing editing and returning to Teacher Portal.\n" C_RESET);
+                screen_printf(C_YELLOW "Finishing editing and returning to Teacher Portal.\n" C_RESET);
                 break;
             default:
-                printf(C_RED "Invalid choice.\n" C_RESET);
+                screen_printf(C_RED "Invalid choice.\n" C_RESET);
         }
     } while (choice != 0);
 }
 
+// Function to print one page of the student list
+static void print_student_page(const int* page, int listed) {
+    screen_printf(C_BOLD "| SAP ID    | Name                                             |\n" C_RESET);
+    screen_printf(C_BLUE "|-----------|--------------------------------------------------|\n" C_RESET);
+    for (int i = 0; i < listed; i++) {
+        screen_printf("| " C_YELLOW "%09u" C_RESET " | " C_CYAN "%-48.48s" C_RESET " |\n",
+            student_at(page[i])->sap_id, student_name(page[i]));
+    }
+}
+
+// Function to page through the roster in SAP ID or name order. Only the cursors are
+// kept between pages, so the roster can change while the list is open.
+void teacher_list_students() {
+    screen_printf(C_BLUE "\n--- Student List (%d Students) ---\n" C_RESET, student_store.count);
+    if (student_store.count == 0) {
+        screen_printf(C_YELLOW "No students registered in the system.\n" C_RESET);
+        return;
+    }
+    screen_printf("1. By SAP ID\n2. By name\n");
+    int choice;
+    screen_prompt("Sort by (1-2): ");
+    if (!input_int(&choice) || choice < 1 || choice > 2) {
+        input_skip_line();
+        screen_printf(C_RED "Invalid choice.\n" C_RESET);
+        return;
+    }
+    input_skip_line();
+    int order = choice == 1 ? ORDER_SAP_ID : ORDER_NAME;
+    char text[sizeof(((StudentForm*)0)->name)];
+    screen_prompt("Students per page (1-%d, Enter for %d): ", ORDER_PAGE_MAX, ORDER_PAGE_DEFAULT);
+    if (!input_line(text, sizeof text)) {
+        return;
+    }
+    char *end;
+    long size = text[0] == '\0' ? ORDER_PAGE_DEFAULT : strtol(text, &end, 10);
+    if (text[0] != '\0' && (*end != '\0' || size < 1 || size > ORDER_PAGE_MAX)) {
+        screen_printf(C_RED "Invalid page size.\n" C_RESET);
+        return;
+    }
+
+    int page[ORDER_PAGE_MAX];
+    int found[ORDER_PAGE_MAX];
+    StudentCursor first; // Keys of the rows on screen: where the pages either side start
+    StudentCursor last;
+    StudentCursor jump;
+    memset(&first, 0, sizeof first);
+    memset(&last, 0, sizeof last);
+    const StudentCursor *from = NULL; // The first page
+    bool inclusive = false;
+    bool backward = false;
+    while (true) {
+        uint64_t start = metric_clock();
+        pthread_mutex_lock(&student_write_lock);
+        int listed = student_page(order, from, inclusive, backward, found, (int)size);
+        if (backward && listed >= 0 && listed < size) {
+            listed = student_page(order, NULL, false, false, found, (int)size); // Back to a full first page
+            backward = false;
+        }
+        if (listed > 0) {
+            for (int i = 0; i < listed; i++) {
+                page[i] = found[backward ? listed - 1 - i : i]; // Going back lists nearest first
+            }
+            student_cursor_at(&first, page[0]);
+            student_cursor_at(&last, page[listed - 1]);
+            print_student_page(page, listed);
+        }
+        pthread_mutex_unlock(&student_write_lock);
+        metric_record(METRIC_LIST, start);
+        if (listed < 0) {
+            screen_printf(C_RED "Error: out of memory.\n" C_RESET);
+            return;
+        }
+        if (listed == 0 && from == &jump) {
+            screen_printf(C_YELLOW "No students from there on.\n" C_RESET);
+            first = jump; // So the previous page is the end of the list
+        } else if (listed == 0) {
+            screen_printf(C_YELLOW "End of the list.\n" C_RESET);
+        }
+
+        screen_prompt("\nEnter: next page, p: previous, f: first, j: jump to %s, q: back: ",
+            order == ORDER_SAP_ID ? "a SAP ID" : "a name");
+        if (!input_line(text, sizeof text) || strcmp(text, "q") == 0) {
+            return;
+        }
+        inclusive = false;
+        backward = false;
+        if (text[0] == '\0' || strcmp(text, "n") == 0) {
+            from = &last; // From where the list ended (the same place again past its end)
+        } else if (strcmp(text, "p") == 0) {
+            from = &first;
+            backward = true;
+        } else if (strcmp(text, "f") == 0) {
+            from = NULL;
+        } else if (strcmp(text, "j") == 0) {
+            screen_prompt(order == ORDER_SAP_ID ? "SAP ID, or its first digits: " : "Name, or its start: ");
+            if (!input_line(text, sizeof text)) {
+                return;
+            }
+            memset(&jump, 0, sizeof jump);
+            size_t digits = strspn(text, "0123456789");
+            if (order == ORDER_SAP_ID && (digits == 0 || digits > SAP_ID_LENGTH || text[digits] != '\0')) {
+                screen_printf(C_RED "Error: enter up to %d digits.\n" C_RESET, SAP_ID_LENGTH);
+                from = &first;
+                inclusive = true; // Show the same page again
+                continue;
+            }
+            for (size_t i = 0; order == ORDER_SAP_ID && i < SAP_ID_LENGTH; i++) {
+                jump.sap_id = jump.sap_id * 10 + (uint32_t)(i < digits ? text[i] - '0' : 0);
+            }
+            if (order == ORDER_NAME) {
+                student_cursor_set(&jump, 0, text); // With SAP ID 0, ahead of everyone with this name
+            }
+            from = &jump;
+            inclusive = true;
+        } else {
+            screen_printf(C_RED "Invalid choice.\n" C_RESET);
+            from = &first;
+            inclusive = true;
+        }
+    }
+}
+
 void teacher_manage_students() {
     int choice;
 
     do {
-        printf(C_BLUE "\n--- Manage Students ---\n" C_RESET);
-        printf("Total students registered: " C_CYAN "%d/%d" C_RESET "\n", student_count, MAX_STUDENTS);
-        printf("1. " C_YELLOW "Add a new Student\n" C_RESET);
-        printf("2. " C_YELLOW "Remove a Student\n" C_RESET);
-        printf("3. View all Students\n");
-        printf("0. Back to Teacher Portal\n");
-        printf("Enter choice: ");
-        if (scanf("%d", &choice) != 1) {
+        screen_printf(C_BLUE "\n--- Manage Students ---\n" C_RESET);
+        screen_printf("Total students registered: " C_CYAN "%d" C_RESET "\n", student_store.count);
+        screen_printf("1. " C_YELLOW "Add a new Student\n" C_RESET);
+        screen_printf("2. " C_YELLOW "Remove a Student\n" C_RESET);
+        screen_printf("3. View all Students (a page at a time, by SAP ID or name)\n");
+        screen_printf("4. Compact Student Storage (" C_CYAN "%d" C_RESET " removed slots)\n", store_dead_slots(&student_store));
+        screen_printf("0. Back to Teacher Portal\n");
+        screen_prompt("Enter choice: ");
+        if (!input_int(&choice)) {
              choice = -1; // Force retry
         }
-        clear_input_buffer();
+        input_skip_line();
 
         switch (choice) {
             case 1: { // Add a new Student
-                if (student_count >= MAX_STUDENTS) {
-                    printf(C_RED "Error: Maximum student capacity reached (%d). Cannot add more students.\n" C_RESET, MAX_STUDENTS);
+                if (student_store.count >= STORE_CAPACITY) {
+                    screen_printf(C_RED "Error: Maximum student capacity reached (%d). Cannot add more students.\n" C_RESET, STORE_CAPACITY);
                     break;
                 }
                 
-                Student *s = &students[student_count];
+                StudentForm new_student;
+                StudentForm *s = &new_student;
                 
-                printf(C_BLUE "\n--- Adding New Student ---\n" C_RESET);
+                screen_printf(C_BLUE "\n--- Adding New Student ---\n" C_RESET);
 
                 // Input SAP ID
                 while (true) {
-                    printf("Enter new 9-digit SAP ID: ");
-                    scanf("%10s", s->sap_id);
-                    clear_input_buffer();
-                    if (strlen(s->sap_id) == SAP_ID_LENGTH) {
-                        if (find_student_index(s->sap_id) == -1) {
-                            break;
-                        } else {
-                            printf(C_RED "Error: SAP ID already exists. Try again.\n" C_RESET);
-                        }
-                    } else {
-                        printf(C_RED "Error: SAP ID must be exactly %d digits.\n" C_RESET, SAP_ID_LENGTH);
+                    screen_prompt("Enter new 9-digit SAP ID: ");
+                    input_sap_id(s->sap_id);
+                    input_skip_line();
+                    if (check_new_sap_id(s->sap_id)) {
+                        break;
                     }
                 }
                 
                 // Input Password
-                printf("Enter Password (max 19 chars, no spaces): ");
-                scanf("%19s", s->password);
-                clear_input_buffer();
+                char password[STUDENT_PASSWORD_MAX + 1];
+                screen_prompt("Enter Password (max 19 chars, no spaces): ");
+                input_word(password, sizeof password);
+                input_skip_line();
+                hash_password(password, s->credential);
 
                 // Input Name
-                printf("Enter Student Name: ");
-                if (fgets(s->name, 50, stdin)) {
+                screen_prompt("Enter Student Name: ");
+                if (input_line(s->name, sizeof s->name)) {
                     s->name[strcspn(s->name, "\n")] = 0; // Remove newline
                 } else {
                     strcpy(s->name, "Unknown Student");
                 }
 
-                // Initialize Data
-                s->attendance_maths = s->attendance_physics = s->attendance_coding = 0;
-                s->marks_maths = s->marks_physics = s->marks_coding = 0;
                 
-                student_count++;
-                printf(C_GREEN "\nStudent %s (ID: %s) successfully added.\n" C_RESET, s->name, s->sap_id);
+                if (add_student(s) == -1) {
+                    screen_printf(C_RED "Error: Out of memory. Student could not be added.\n" C_RESET);
+                    break;
+                }
+                wal_sync();
+                screen_printf(C_GREEN "\nStudent %s (ID: %s) successfully added.\n" C_RESET, s->name, s->sap_id);
                 break;
             }
             case 2: { // Remove a Student
                 char sap_id_to_remove[SAP_ID_LENGTH + 1];
-                printf(C_BLUE "\n--- Remove Student ---\n" C_RESET);
-                printf("Enter SAP ID of student to remove: ");
-                scanf("%10s", sap_id_to_remove);
-                clear_input_buffer();
+                screen_printf(C_BLUE "\n--- Remove Student ---\n" C_RESET);
+                screen_prompt("Enter SAP ID of student to remove: ");
+                input_sap_id(sap_id_to_remove);
+                input_skip_line();
 
                 int index = find_student_index(sap_id_to_remove);
                 if (index == -1) {
-                    printf(C_RED "Error: Student with SAP ID %s not found.\n" C_RESET, sap_id_to_remove);
+                    screen_printf(C_RED "Error: Student with SAP ID %s not found.\n" C_RESET, sap_id_to_remove);
                     break;
                 }
 
-                // Shift array elements to overwrite the deleted student
-                printf(C_YELLOW "Removing student: %s (SAP ID: %s)\n" C_RESET, students[index].name, students[index].sap_id);
-                for (int i = index; i < student_count - 1; i++) {
-                    students[i] = students[i+1];
-                }
-                student_count--;
-                printf(C_GREEN "Student successfully removed. Total students: %d\n" C_RESET, student_count);
+                // Leave a tombstone; the slot is reused by the next add
+                screen_printf(C_YELLOW "Removing student: %s (SAP ID: %09u)\n" C_RESET, student_name(index), student_at(index)->sap_id);
+                remove_student(index);
+                wal_sync();
+                screen_printf(C_GREEN "Student successfully removed. Total students: %d\n" C_RESET, student_store.count);
                 break;
             }
             case 3: // View all Students
-                printf(C_BLUE "\n--- Student List (%d Students) ---\n" C_RESET, student_count);
-                if (student_count == 0) {
-                    printf(C_YELLOW "No students registered in the system.\n" C_RESET);
-                    break;
-                }
-                for (int i = 0; i < student_count; i++) {
-                    printf(C_CYAN "%d. Name: %-30s" C_RESET " | SAP ID: " C_YELLOW "%s" C_RESET "\n"
-                        , i + 1, students[i].name, students[i].sap_id);
-                }
-                printf("\nPress Enter to continue...");
-                clear_input_buffer();
-                getchar();
+                teacher_list_students();
                 break;
+            case 4: { // Compact Student Storage
+                int dead = store_dead_slots(&student_store);
+                int moved = compact_students();
+                screen_printf(C_GREEN "Compaction complete: %d removed slots reclaimed, %d records moved.\n" C_RESET, dead, moved);
+                break;
+            }
             case 0:
+                // No student indices are held outside this menu, so this is a safe point
+                // to squeeze out tombstones once they outnumber live records.
+                if (store_needs_compaction(&student_store)) {
+                    compact_students();
+                }
                 break;
             default:
-                printf(C_RED "Invalid choice.\n" C_RESET);
+                screen_printf(C_RED "Invalid choice.\n" C_RESET);
         }
     } while (choice != 0);
 }
 
+// Function to show class-wide marks and attendance figures for every subject
+void teacher_class_summary() {
+    screen_printf(C_BLUE "\n--- Class Summary ---\n" C_RESET);
+    if (student_store.count == 0) {
+        screen_printf(C_YELLOW "No students registered yet.\n" C_RESET);
+        return;
+    }
+
+    // Read off the running totals: no pass over the roster however large it is
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ColumnSummary marks[SUBJECT_MAX], attendance[SUBJECT_MAX];
+    pthread_mutex_lock(&student_write_lock);
+    for (int subject = 0; subject < subject_count; subject++) {
+        running_totals_summary(MARK_COLUMN(subject), &marks[subject]);
+        running_totals_summary(ATTENDANCE_COLUMN(subject), &attendance[subject]);
+    }
+    pthread_mutex_unlock(&student_write_lock);
+    double ms = elapsed_ms(&start);
+
+    int width = subject_label_width();
+    const char *rule = "-----------+----------+-----------+------------+-----------+-----------+------------+\n";
+    screen_subject_rule('+', width, rule);
+    screen_printf("| " C_BOLD "%-*s" C_RESET " | Avg Marks | Variance | Min - Max | Marks < %d | Avg Att.  | Min - Max | Att < %d%%  |\n",
+        width, "Subject", PASS_MARK, ATTENDANCE_THRESHOLD);
+    screen_subject_rule('+', width, rule);
+    for (int subject = 0; subject < subject_count; subject++) {
+        const ColumnSummary* m = &marks[subject];
+        const ColumnSummary* a = &attendance[subject];
+        screen_printf("| " C_CYAN "%-*s" C_RESET " | %9.2f | %8.2f | %3d - %-3d | " C_YELLOW "%10lld" C_RESET " | %8.2f%% | %3d - %-3d | " C_YELLOW "%10lld" C_RESET " |\n",
+            width, subject_names[subject], m->mean, m->variance, m->min, m->max, (long long)m->below,
+            a->mean, a->min, a->max, (long long)a->below);
+    }
+    screen_subject_rule('+', width, rule);
+    screen_printf("%d students, read from running totals in %.3f ms.\n", student_store.count, ms);
+}
+
+// Function to add a subject to the catalog for every student
+void teacher_add_subject() {
+    screen_printf(C_BLUE "\n--- Add a Subject ---\n" C_RESET);
+    screen_printf("Current subjects:");
+    for (int subject = 0; subject < subject_count; subject++) {
+        screen_printf(" " C_CYAN "%s" C_RESET "%s", subject_names[subject], subject + 1 < subject_count ? "," : "\n");
+    }
+    char name[SUBJECT_NAME_BYTES + 1];
+    screen_prompt("Enter new subject name (no spaces): ");
+    input_word(name, sizeof name);
+    input_skip_line();
+
+    const char *problem;
+    int subject = add_subject(name, &problem);
+    if (subject == -1) {
+        screen_printf(C_RED "Error: %s.\n" C_RESET, problem);
+        return;
+    }
+    screen_printf(C_GREEN "Subject %s added as choice %d; every student starts at 0 marks and 0%% attendance.\n" C_RESET,
+        subject_names[subject], subject + 1);
+}
+
+// Function to apply a grade sheet file of marks and attendance for many students
+void teacher_apply_grade_sheet() {
+    screen_printf(C_BLUE "\n--- Apply a Grade Sheet ---\n" C_RESET);
+    screen_printf("A CSV or TSV file with a header row such as " C_CYAN "sap_id,%s,attendance_%s" C_RESET ".\n",
+        subject_names[0], subject_names[0]);
+    screen_printf("Empty cells are left unchanged. Nothing is applied unless every row is valid.\n");
+    char path[PATH_MAX];
+    screen_prompt("Enter the path of the grade sheet: ");
+    if (!input_line(path, sizeof path) || path[0] == '\0') {
+        screen_printf(C_RED "No file given.\n" C_RESET);
+        return;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    GradeSheetReport *report = malloc(sizeof(GradeSheetReport));
+    if (report == NULL) {
+        screen_printf(C_RED "Error: out of memory.\n" C_RESET);
+    } else if (!apply_grade_sheet(path, report)) {
+        screen_printf(C_RED "Error: %s.\n" C_RESET, report->problem);
+    } else {
+        print_grade_sheet_report(path, report, elapsed_ms(&start));
+    }
+    free(report);
+}
+
+// Function to show the toppers of a subject or of the total, and look up ranks
+void teacher_view_leaderboards() {
+    screen_printf(C_BLUE "\n--- Leaderboards ---\n" C_RESET);
+    for (int subject = 0; subject < subject_count; subject++) {
+        screen_printf("%d. %s\n", subject + 1, subject_names[subject]);
+    }
+    screen_printf("%d. Total marks\n", subject_count + 1);
+    int choice;
+    screen_prompt("Enter board (1-%d): ", subject_count + 1);
+    if (!input_int(&choice) || choice < 1 || choice > subject_count + 1) {
+        input_skip_line();
+        screen_printf(C_RED "Invalid board choice.\n" C_RESET);
+        return;
+    }
+    input_skip_line();
+    int board = choice <= subject_count ? choice - 1 : LEADERBOARD_TOTAL;
+
+    int indexes[10];
+    int32_t ranks[10];
+    pthread_mutex_lock(&student_write_lock);
+    int listed = leaderboard_top(board, 10, indexes, ranks);
+    screen_printf(C_BOLD "\nTop %d in %s\n" C_RESET, listed, leaderboard_name(board));
+    screen_printf(C_BOLD "| Rank | SAP ID    | Name                           | Marks |\n" C_RESET);
+    screen_printf(C_BLUE "|------|-----------|--------------------------------|-------|\n" C_RESET);
+    for (int i = 0; i < listed; i++) {
+        screen_printf("| %4d | " C_YELLOW "%09u" C_RESET " | " C_CYAN "%-30.30s" C_RESET " | %5d |\n", ranks[i],
+            student_at(indexes[i])->sap_id, student_name(indexes[i]), leaderboard_score_of(board, indexes[i]));
+    }
+    pthread_mutex_unlock(&student_write_lock);
+    if (listed == 0) {
+        screen_printf(C_YELLOW "No students are registered yet.\n" C_RESET);
+        return;
+    }
+
+    while (true) {
+        char sap_id[32];
+        screen_prompt("\nEnter a SAP ID to see their rank (or press Enter to go back): ");
+        if (!input_line(sap_id, sizeof sap_id) || sap_id[0] == '\0') {
+            return;
+        }
+        int index = find_student_index(sap_id);
+        if (index == -1) {
+            screen_printf(C_RED "Error: Student with SAP ID %s not found.\n" C_RESET, sap_id);
+            continue;
+        }
+        int32_t out_of = 0;
+        pthread_mutex_lock(&student_write_lock);
+        int32_t rank = leaderboard_rank(board, index, &out_of);
+        int score = leaderboard_score_of(board, index);
+        pthread_mutex_unlock(&student_write_lock);
+        if (rank == 0) {
+            screen_printf(C_RED "Error: out of memory while ranking %s.\n" C_RESET, student_name(index));
+            continue;
+        }
+        screen_printf("%s is ranked " C_GREEN "%d" C_RESET " of %d in %s with %d marks.\n",
+            student_name(index), rank, out_of, leaderboard_name(board), score);
+    }
+}
+
+// Function to find students by any part of their name
+void teacher_search_students() {
+    screen_printf(C_BLUE "\n--- Search Students by Name ---\n" C_RESET);
+    while (true) {
+        char query[sizeof(((StudentForm*)0)->name)];
+        screen_prompt("\nEnter part of a name, e.g. \"sha pri\" (or press Enter to go back): ");
+        if (!input_line(query, sizeof query) || query[0] == '\0') {
+            return;
+        }
+        int results[NAME_SEARCH_LISTED];
+        int total = 0;
+        pthread_mutex_lock(&student_write_lock);
+        int listed = search_students_by_name(query, results, NAME_SEARCH_LISTED, &total);
+        if (listed > 0) {
+            screen_printf(C_BOLD "| SAP ID    | Name                                             |\n" C_RESET);
+            screen_printf(C_BLUE "|-----------|--------------------------------------------------|\n" C_RESET);
+            for (int i = 0; i < listed; i++) {
+                screen_printf("| " C_YELLOW "%09u" C_RESET " | " C_CYAN "%-48.48s" C_RESET " |\n",
+                    student_at(results[i])->sap_id, student_name(results[i]));
+            }
+        }
+        pthread_mutex_unlock(&student_write_lock);
+        if (listed < 0) {
+            screen_printf(C_RED "Error: out of memory.\n" C_RESET);
+        } else if (total == 0) {
+            screen_printf(C_YELLOW "No students match \"%s\".\n" C_RESET, query);
+        } else if (total > listed) {
+            screen_printf("Showing the first %d of %d matches by name; add more of the name to narrow it down.\n", listed, total);
+        } else {
+            screen_printf("%d match%s.\n", total, total == 1 ? "" : "es");
+        }
+    }
+}
+
+// Function to describe what the attendance log takes in memory, and a full term of it
+static void print_attendance_memory() {
+    AttendanceMemory memory;
+    pthread_mutex_lock(&student_write_lock);
+    attendance_memory(&memory);
+    pthread_mutex_unlock(&student_write_lock);
+    screen_printf("Attendance log: %d session%s held, %.1f KB of bitmaps (%.1f KB of pages resident).\n",
+        memory.sessions, memory.sessions == 1 ? "" : "s", memory.log_bytes / 1024.0, memory.resident_bytes / 1024.0);
+    screen_printf("A full term (%d sessions of each of %d subjects) for %d students: %.1f KB, "
+                  "against %.1f KB at one byte per session.\n",
+        SESSION_MAX, subject_count, student_store.count, memory.term_bytes / 1024.0,
+        memory.byte_per_session_bytes / 1024.0);
+}
+
+// Function to take attendance for a class session, or correct one student's record of one
+void teacher_take_attendance() {
+    screen_printf(C_BLUE "\n--- Take Attendance ---\n" C_RESET);
+    for (int subject = 0; subject < subject_count; subject++) {
+        screen_printf("%d. %s (%d of %d sessions held)\n", subject + 1, subject_names[subject],
+            attendance_sessions[subject], SESSION_MAX);
+    }
+    int choice;
+    screen_prompt("Enter subject choice (1-%d): ", subject_count);
+    if (!input_int(&choice) || choice < 1 || choice > subject_count) {
+        input_skip_line();
+        screen_printf(C_RED "Invalid subject choice.\n" C_RESET);
+        return;
+    }
+    input_skip_line();
+    int subject = choice - 1;
+
+    screen_printf("1. New session: everyone present, then enter who was absent\n");
+    screen_printf("2. New session: everyone absent, then enter who was present\n");
+    screen_printf("3. Correct one student at an earlier session\n");
+    screen_printf("4. Show how much memory the attendance log takes\n");
+    screen_prompt("Enter choice: ");
+    int action;
+    if (!input_int(&action) || action < 1 || action > 4) {
+        input_skip_line();
+        screen_printf(C_RED "Invalid choice.\n" C_RESET);
+        return;
+    }
+    input_skip_line();
+
+    if (action == 4) {
+        print_attendance_memory();
+        return;
+    }
+    if (action == 3) {
+        int held = attendance_sessions[subject];
+        if (held == 0) {
+            screen_printf(C_YELLOW "No sessions of %s have been held yet.\n" C_RESET, subject_names[subject]);
+            return;
+        }
+        char sap_id[SAP_ID_LENGTH + 1];
+        int session, present;
+        screen_prompt("Enter SAP ID: ");
+        input_sap_id(sap_id);
+        input_skip_line();
+        int index = find_student_index(sap_id);
+        if (index == -1) {
+            screen_printf(C_RED "Error: Student with SAP ID %s not found.\n" C_RESET, sap_id);
+            return;
+        }
+        screen_prompt("Enter session number (1-%d): ", held);
+        bool valid = input_int(&session) && session >= 1 && session <= held;
+        input_skip_line();
+        screen_prompt("Present (1) or absent (0)? ");
+        valid = input_int(&present) && (present == 0 || present == 1) && valid;
+        input_skip_line();
+        if (!valid) {
+            screen_printf(C_RED "Invalid session number or choice.\n" C_RESET);
+            return;
+        }
+        if (!set_session_attendance(index, subject, session - 1, present == 1)) {
+            screen_printf(C_RED "Error: session %d of %s has not been recorded.\n" C_RESET, session, subject_names[subject]);
+            return;
+        }
+        wal_sync();
+        screen_printf(C_GREEN "%s marked %s at session %d of %s; attendance now %d%%.\n" C_RESET, student_name(index),
+            present ? "present" : "absent", session, subject_names[subject], *student_attendance(index, subject));
+        return;
+    }
+
+    bool everyone_present = action == 1;
+    int session = take_session(subject, everyone_present);
+    if (session == -1) {
+        screen_printf(C_RED "Error: all %d sessions of %s this term have been recorded.\n" C_RESET,
+            SESSION_MAX, subject_names[subject]);
+        return;
+    }
+    screen_printf(C_GREEN "Session %d of %s recorded with everyone %s.\n" C_RESET, session + 1,
+        subject_names[subject], everyone_present ? "present" : "absent");
+    while (true) {
+        char sap_id[32];
+        screen_prompt("Enter the SAP ID of a student who was %s (or press Enter to finish): ",
+            everyone_present ? "absent" : "present");
+        if (!input_line(sap_id, sizeof sap_id) || sap_id[0] == '\0') {
+            break;
+        }
+        int index = find_student_index(sap_id);
+        if (index == -1) {
+            screen_printf(C_RED "Error: Student with SAP ID %s not found.\n" C_RESET, sap_id);
+            continue;
+        }
+        set_session_attendance(index, subject, session, !everyone_present);
+        screen_printf("%s marked %s.\n", student_name(index), everyone_present ? "absent" : "present");
+    }
+    wal_sync();
+    pthread_mutex_lock(&student_write_lock);
+    int present = attendance_session_present(subject, session);
+    pthread_mutex_unlock(&student_write_lock);
+    screen_printf(C_GREEN "Session %d of %s: %d of %d students present.\n" C_RESET, session + 1,
+        subject_names[subject], present, student_store.count);
+}
+
 void teacher_portal() {
     int choice;
     do {
-        printf(C_BLUE C_BOLD "\n========================================\n" C_RESET);
-        printf(C_CYAN C_BOLD "         TEACHER PORTAL - Menu          \n" C_RESET);
-        printf(C_BLUE C_BOLD "========================================\n" C_RESET);
-        printf("Total students currently registered: " C_CYAN "%d\n" C_RESET, student_count);
-        printf("1. " C_YELLOW "Manage Student Enrollment (Add/Remove)\n" C_RESET);
-        printf("2. " C_YELLOW "Edit Student Marks and Attendance\n" C_RESET);
-        printf("0. Logout\n");
-        printf("Enter choice: ");
-        if (scanf("%d", &choice) != 1) {
+        screen_printf(C_BLUE C_BOLD "\n========================================\n" C_RESET);
+        screen_printf(C_CYAN C_BOLD "         TEACHER PORTAL - Menu          \n" C_RESET);
+        screen_printf(C_BLUE C_BOLD "========================================\n" C_RESET);
+        screen_printf("Total students currently registered: " C_CYAN "%d\n" C_RESET, student_store.count);
+        screen_printf("1. " C_YELLOW "Manage Student Enrollment (Add/Remove)\n" C_RESET);
+        screen_printf("2. " C_YELLOW "Edit Student Marks and Attendance\n" C_RESET);
+        screen_printf("3. " C_YELLOW "View Class Summary\n" C_RESET);
+        screen_printf("4. " C_YELLOW "View Class Analytics (percentiles and histograms)\n" C_RESET);
+        screen_printf("5. " C_YELLOW "Add a Subject (%d of %d)\n" C_RESET, subject_count, SUBJECT_MAX);
+        screen_printf("6. " C_YELLOW "Apply a Grade Sheet (marks and attendance from a file)\n" C_RESET);
+        screen_printf("7. " C_YELLOW "View Leaderboards (toppers and ranks)\n" C_RESET);
+        screen_printf("8. " C_YELLOW "Search Students by Name\n" C_RESET);
+        screen_printf("9. " C_YELLOW "Take Attendance (class sessions)\n" C_RESET);
+        screen_printf("0. Logout\n");
+        screen_prompt("Enter choice: ");
+        if (!input_int(&choice)) {
             choice = -1; // Force retry
         }
-        clear_input_buffer();
+        input_skip_line();
         
         switch (choice) {
             case 1:
@@ -474,11 +9058,42 @@ void teacher_portal() {
             case 2:
                 teacher_edit_student_data();
                 break;
+            case 3:
+                teacher_class_summary();
+                break;
+            case 4:
+                screen_printf(C_BLUE "\n--- Class Analytics ---\n" C_RESET);
+                show_class_analytics();
+                break;
+            case 5:
+                teacher_add_subject();
+                break;
+            case 6:
+                teacher_apply_grade_sheet();
+                break;
+            case 7:
+                teacher_view_leaderboards();
+                break;
+            case 8:
+                teacher_search_students();
+                break;
+            case 9:
+                teacher_take_attendance();
+                break;
+            case 99: // Not listed: operation metrics, for whoever is looking after the system
+                screen_printf(C_BLUE "\n--- Operation Metrics ---\n" C_RESET);
+                screen_flush();
+                metrics_dump(stdout);
+                fflush(stdout);
+                if (metrics_write_file()) {
+                    screen_printf(C_GREEN "Also written to %s.\n" C_RESET, metrics_path);
+                }
+                break;
             case 0:
-                printf(C_YELLOW "\nLogging out from Teacher Portal. Goodbye!\n" C_RESET);
+                screen_printf(C_YELLOW "\nLogging out from Teacher Portal. Goodbye!\n" C_RESET);
                 break;
             default:
-                printf(C_RED "Invalid choice. Please try again.\n" C_RESET);
+                screen_printf(C_RED "Invalid choice. Please try again.\n" C_RESET);
         }
     } while (choice != 0);
 }
@@ -486,77 +9101,79 @@ void teacher_portal() {
 // --- Creation Functions ---
 
 void create_new_student_id() {
-    if (student_count >= MAX_STUDENTS) {
-        printf(C_RED "\nError: Maximum student capacity reached (%d). Cannot create new student ID.\n" C_RESET, MAX_STUDENTS);
+    if (student_store.count >= STORE_CAPACITY) {
+        screen_printf(C_RED "\nError: Maximum student capacity reached (%d). Cannot create new student ID.\n" C_RESET, STORE_CAPACITY);
         return;
     }
 
-    Student *s = &students[student_count];
+    StudentForm new_student;
+    StudentForm *s = &new_student;
     
-    printf(C_BLUE "\n--- Create New Student ID ---\n" C_RESET);
+    screen_printf(C_BLUE "\n--- Create New Student ID ---\n" C_RESET);
 
     // Input SAP ID
     while (true) {
-        printf("Enter new 9-digit SAP ID: ");
-        scanf("%10s", s->sap_id);
-        clear_input_buffer();
-        if (strlen(s->sap_id) == SAP_ID_LENGTH) {
-            if (find_student_index(s->sap_id) == -1) {
-                break;
-            } else {
-                printf(C_RED "Error: SAP ID already exists. Try again.\n" C_RESET);
-            }
-        } else {
-            printf(C_RED "Error: SAP ID must be exactly %d digits.\n" C_RESET, SAP_ID_LENGTH);
+        screen_prompt("Enter new 9-digit SAP ID: ");
+        input_sap_id(s->sap_id);
+        input_skip_line();
+        if (check_new_sap_id(s->sap_id)) {
+            break;
         }
     }
     
     // Input Password
-    printf("Enter Password (max 19 chars, no spaces): ");
-    scanf("%19s", s->password);
-    clear_input_buffer();
+    char password[STUDENT_PASSWORD_MAX + 1];
+    screen_prompt("Enter Password (max 19 chars, no spaces): ");
+    input_word(password, sizeof password);
+    input_skip_line();
+    hash_password(password, s->credential);
 
     // Input Name
-    printf("Enter Full Name: ");
-    if (fgets(s->name, 50, stdin)) {
+    screen_prompt("Enter Full Name: ");
+    if (input_line(s->name, sizeof s->name)) {
         s->name[strcspn(s->name, "\n")] = 0; // Remove newline
     } else {
         strcpy(s->name, "New Student");
     }
-
-    // Initialize Data
-    s->attendance_maths = s->attendance_physics = s->attendance_coding = 0;
-    s->marks_maths = s->marks_physics = s->marks_coding = 0;
     
-    student_count++;
-    printf(C_GREEN "\nStudent ID created successfully! Use SAP ID: %s to login.\n" C_RESET, s->sap_id);
+    if (add_student(s) == -1) {
+        screen_printf(C_RED "\nError: Out of memory. Student ID could not be created.\n" C_RESET);
+        return;
+    }
+    wal_sync();
+    screen_printf(C_GREEN "\nStudent ID created successfully! Use SAP ID: %s to login.\n" C_RESET, s->sap_id);
 }
 
 void create_new_teacher_id() {
-     if (teacher_count >= MAX_TEACHERS) {
-        printf(C_RED "\nError: Maximum teacher capacity reached (%d). Cannot create new teacher ID.\n" C_RESET, MAX_TEACHERS);
+     if (teacher_store.count >= STORE_CAPACITY) {
+        screen_printf(C_RED "\nError: Maximum teacher capacity reached (%d). Cannot create new teacher ID.\n" C_RESET, STORE_CAPACITY);
         return;
     }
 
-    Teacher *t = &teachers[teacher_count];
+    TeacherForm new_teacher;
+    TeacherForm *t = &new_teacher;
     
-    printf(C_BLUE "\n--- Create New Teacher ID ---\n" C_RESET);
-    printf("Enter new Username (no spaces): ");
-    scanf("%49s", t->username);
-    printf("Enter new Password (no spaces): ");
-    scanf("%49s", t->password);
-    clear_input_buffer();
+    screen_printf(C_BLUE "\n--- Create New Teacher ID ---\n" C_RESET);
+    screen_prompt("Enter new Username (no spaces): ");
+    input_word(t->username, sizeof t->username);
+    char password[TEACHER_PASSWORD_MAX + 1];
+    screen_prompt("Enter new Password (no spaces): ");
+    input_word(password, sizeof password);
+    input_skip_line();
     
     // Simple check for username uniqueness (optional for this scope, but good practice)
-    for(int i = 0; i < teacher_count; i++) {
-        if (strcmp(teachers[i].username, t->username) == 0) {
-            printf(C_RED "\nError: Username already exists. Please choose another.\n" C_RESET);
-            return;
-        }
+    if (find_teacher_index(t->username) != -1) {
+        screen_printf(C_RED "\nError: Username already exists. Please choose another.\n" C_RESET);
+        return;
     }
+    hash_password(password, t->credential);
 
-    teacher_count++;
-    printf(C_GREEN "\nTeacher ID created successfully! Username: %s.\n" C_RESET, t->username);
+    if (add_teacher(t) == -1) {
+        screen_printf(C_RED "\nError: Out of memory. Teacher ID could not be created.\n" C_RESET);
+        return;
+    }
+    wal_sync();
+    screen_printf(C_GREEN "\nTeacher ID created successfully! Username: %s.\n" C_RESET, t->username);
 }
 
 // --- Main Menu/Home Page ---
@@ -566,21 +9183,21 @@ void home_menu() {
     int student_index;
     
     do {
-        printf(C_BLUE C_BOLD "\n========================================\n" C_RESET);
-        printf(C_CYAN C_BOLD "   COLLEGE ATTENDANCE & GRADING SYSTEM  \n" C_RESET);
-        printf(C_BLUE C_BOLD "========================================\n" C_RESET);
-        printf(C_BOLD "Home Page Options:\n" C_RESET);
-        printf(C_YELLOW "1." C_RESET " Login as Student\n");
-        printf(C_YELLOW "2." C_RESET " Login as Teacher\n");
-        printf(C_YELLOW "3." C_RESET " Create New Student ID\n");
-        printf(C_YELLOW "4." C_RESET " Create New Teacher ID\n");
-        printf(C_YELLOW "0." C_RESET " Exit System\n");
-        printf("Enter your choice: ");
+        screen_printf(C_BLUE C_BOLD "\n========================================\n" C_RESET);
+        screen_printf(C_CYAN C_BOLD "   COLLEGE ATTENDANCE & GRADING SYSTEM  \n" C_RESET);
+        screen_printf(C_BLUE C_BOLD "========================================\n" C_RESET);
+        screen_printf(C_BOLD "Home Page Options:\n" C_RESET);
+        screen_printf(C_YELLOW "1." C_RESET " Login as Student\n");
+        screen_printf(C_YELLOW "2." C_RESET " Login as Teacher\n");
+        screen_printf(C_YELLOW "3." C_RESET " Create New Student ID\n");
+        screen_printf(C_YELLOW "4." C_RESET " Create New Teacher ID\n");
+        screen_printf(C_YELLOW "0." C_RESET " Exit System\n");
+        screen_prompt("Enter your choice: ");
         
-        if (scanf("%d", &choice) != 1) {
+        if (!input_int(&choice)) {
             choice = -1; // Force retry
         }
-        clear_input_buffer();
+        input_skip_line();
         
         switch (choice) {
             case 1:
@@ -601,23 +9218,196 @@ void home_menu() {
                 create_new_teacher_id();
                 break;
             case 0:
-                printf(C_YELLOW "\nExiting the system. All current data is lost.\n" C_RESET);
+                if (persistent_mode()) {
+                    screen_printf(C_YELLOW "\nExiting the system. All data is saved in '%s'.\n" C_RESET, data_dir);
+                } else {
+                    screen_printf(C_YELLOW "\nExiting the system. All current data is lost.\n" C_RESET);
+                }
                 break;
             default:
-                printf(C_RED "Invalid choice. Please select an option from 0 to 4.\n" C_RESET);
+                screen_printf(C_RED "Invalid choice. Please select an option from 0 to 4.\n" C_RESET);
         }
     } while (choice != 0);
 }
 
 // --- Main Function ---
 
-int main() {
-    printf("Starting system with fresh memory (non-persistent mode).\n");
-    
-    // This function now runs every time, prompting the user for N number of students/teachers.
-    create_initial_data();
+void print_usage(const char* program) {
+    printf("Usage: %s [--data DIR | --memory]\n", program);
+    printf("       %s [--data DIR] [--threads N] --import ROSTER\n", program);
+    printf("       %s [--data DIR] --apply-grades SHEET\n", program);
+    printf("       %s [--data DIR] --bench-wal EDITS THREADS\n", program);
+    printf("       %s [--data DIR] [--threads N] --analytics\n", program);
+    printf("       %s [--data DIR] --batch SCRIPT\n", program);
+    printf("       %s [--data DIR] --serve PORT\n", program);
+    printf("       %s --bench-layout STUDENTS\n", program);
+    printf("       %s --stress READERS WRITERS\n", program);
+    printf("       %s --bench-login LOGINS THREADS\n", program);
+    printf("       %s --bench-attendance STUDENTS SESSIONS\n", program);
+    printf("       %s --bench SIZES [--bench-out FILE]\n", program);
+    printf("       %s --generate-roster STUDENTS FILE\n", program);
+    printf("  --data DIR   Load and save records in DIR (default: " DEFAULT_DATA_DIR ")\n");
+    printf("  --memory     Keep records in memory only; everything is lost on exit\n");
+    printf("  --import     Add every student in a CSV/TSV roster file (\"-\" for stdin) and exit\n");
+    printf("  --apply-grades  Set marks and attendance from a CSV/TSV grade sheet, all rows or none, and exit\n");
+    printf("  --threads N  Worker threads for --import and analytics (default: one per CPU)\n");
+    printf("  --analytics  Print per-subject percentiles, histograms and timings, and exit\n");
+    printf("  --batch      Run the commands in SCRIPT (\"-\" for stdin) with tab-separated results, and exit\n");
+    printf("  --serve      Accept batch commands from any number of clients on 127.0.0.1:PORT\n");
+    printf("               (logins are checked on --threads worker threads)\n");
+    printf("  --bench-wal  Measure journal throughput with THREADS concurrent editors\n");
+    printf("  --bench-layout  Compare the compact student layout with the original one (in memory)\n");
+    printf("  --stress     Check lock-free reads against concurrent editors and report read scaling (in memory)\n");
+    printf("  --bench-login  Time a burst of logins checked inline and on THREADS login workers (in memory)\n");
+    printf("  --bench-attendance  Take up to %d class sessions per subject for STUDENTS and report time and memory (in memory)\n",
+        SESSION_MAX);
+    printf("  --bench      Time every core operation on synthetic rosters of each size, e.g. 1000,100000\n");
+    printf("               (in memory); results also go to FILE as JSON (default: bench.json)\n");
+    printf("  --generate-roster  Write a synthetic CSV roster for --import (\"-\" for stdout)\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* dir = DEFAULT_DATA_DIR;
+    const char* import_path = NULL;
+    const char* grades_path = NULL;
+    const char* batch_path = NULL;
+    const char* bench_sizes = NULL;
+    const char* bench_out = "bench.json";
+    int serve_port = 0;
+    bool analytics = false;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    bool persistent = true;
+
+    select_column_kernel();
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--memory") == 0) {
+            persistent = false;
+        } else if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "--bench-wal") == 0 && i + 2 < argc) {
+            int edits = atoi(argv[i + 1]);
+            int threads = atoi(argv[i + 2]);
+            if (edits < 1 || threads < 1) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            return run_wal_benchmark(dir, edits, threads);
+        } else if (strcmp(argv[i], "--bench-layout") == 0 && i + 1 < argc) {
+            int students = atoi(argv[i + 1]);
+            if (students < 1) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            return run_layout_benchmark(students);
+        } else if (strcmp(argv[i], "--stress") == 0 && i + 2 < argc) {
+            int readers = atoi(argv[i + 1]);
+            int writers = atoi(argv[i + 2]);
+            if (readers < 1 || writers < 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            return run_stress_test(readers, writers);
+        } else if (strcmp(argv[i], "--bench-login") == 0 && i + 2 < argc) {
+            int logins = atoi(argv[i + 1]);
+            int threads = atoi(argv[i + 2]);
+            if (logins < 1 || threads < 1) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            return run_login_benchmark(logins, threads);
+        } else if (strcmp(argv[i], "--bench-attendance") == 0 && i + 2 < argc) {
+            int students = atoi(argv[i + 1]);
+            int sessions = atoi(argv[i + 2]);
+            if (students < 1 || students > BENCH_MAX_STUDENTS || sessions < 1 || sessions > SESSION_MAX) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            return run_attendance_benchmark(students, sessions);
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench_sizes = argv[++i];
+        } else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc) {
+            bench_out = argv[++i];
+        } else if (strcmp(argv[i], "--generate-roster") == 0 && i + 2 < argc) {
+            long students = atol(argv[i + 1]);
+            if (students < 1) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            return run_generate_roster(students, argv[i + 2]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_path = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) < 65536) {
+            serve_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--analytics") == 0) {
+            analytics = true;
+        } else if (strcmp(argv[i], "--import") == 0 && i + 1 < argc) {
+            import_path = argv[++i];
+        } else if (strcmp(argv[i], "--apply-grades") == 0 && i + 1 < argc) {
+            grades_path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            threads = atoi(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    worker_thread_count = threads < 1 ? 1 : threads;
+    metrics_start(persistent ? dir : NULL); // Before any other thread starts
+    if (bench_sizes != NULL) {
+        return run_benchmark_suite(bench_sizes, bench_out);
+    }
+
+    if (persistent) {
+        if (!open_data_store(dir)) {
+            return 1;
+        }
+        if (analytics) {
+            show_class_analytics();
+            bool verified = running_totals_verify(stderr);
+            if (verified) {
+                screen_printf("Running totals match a full recompute.\n");
+            }
+            screen_flush();
+            close_data_store();
+            return verified ? 0 : 1;
+        }
+        if (batch_path != NULL) {
+            int status = run_batch(batch_path);
+            close_data_store();
+            return status;
+        }
+        if (serve_port != 0) {
+            int status = run_server(serve_port);
+            close_data_store();
+            return status;
+        }
+        if (import_path != NULL) {
+            int status = run_import(import_path, worker_thread_count);
+            close_data_store();
+            return status;
+        }
+        if (grades_path != NULL) {
+            int status = run_apply_grades(grades_path);
+            close_data_store();
+            return status;
+        }
+        // Only a data directory without teacher accounts needs the interactive setup
+        if (teacher_store.count == 0) {
+            create_initial_data();
+        }
+    } else if (import_path != NULL || grades_path != NULL || analytics || batch_path != NULL || serve_port != 0) {
+        error_printf(C_RED "Error: --import, --apply-grades, --analytics, --batch and --serve need a data directory; they cannot be used with --memory.\n" C_RESET);
+        return 1;
+    } else {
+        screen_printf("Starting system with fresh memory (non-persistent mode).\n");
+        create_initial_data();
+    }
     
     home_menu();
-    
+    screen_flush();
+
+    close_data_store();
     return 0;
 }